@@ -20,6 +20,8 @@ const char* parameters =
 	"{input in          |    | The name of an image file or a list of image files (seperated by \";\") that should be transformed into appearance space.}"
 	"{result r          |    | The name of the image file, the result is stored to.}"
 	"{dimensionality td | 8  | Resulting dimensionality of the result sample.}"
+	"{sampling s        | 1  | The ratio of pixels (between 0 and 1), whose neighborhoods are used to fit the projection.}"
+	"{validate v        |    | Compares the projection against an exact fit on all pixels.}"
 };
 
 // Persistence providers.
@@ -69,6 +71,10 @@ int main(int argc, const char** argv) {
 	std::string resultFileName = parser.get<std::string>("result");
 	size_t dimensionality = parser.get<size_t>("dimensionality");
 
+	NeighborhoodSampling sampling;
+	sampling.fraction = parser.get<float>("sampling");
+	sampling.validate = parser.has("validate");
+
 	// Get the individual input file names.
 	std::vector<std::string> inputFiles;
 	std::istringstream tokens(inputFileNames);
@@ -103,10 +109,16 @@ int main(int argc, const char** argv) {
 	std::unique_ptr<AppearanceSpace> dscr;
 	std::cout << "Computing appearance space descriptors...";
 	auto start = std::chrono::high_resolution_clock::now();
-	AppearanceSpace::calculate(material, dscr, dimensionality);
+	ProjectionReport report;
+	AppearanceSpace::calculate(material, dscr, dimensionality, 5, sampling, &report);
 	auto end = std::chrono::high_resolution_clock::now();
 	std::cout << " Done! (" << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms)" << std::endl;
 
+	std::cout << "Fit projection to " << report.samples << " neighborhoods, explaining " << report.explainedVariance << " of their variance." << std::endl;
+
+	if (sampling.validate)
+		std::cout << "Explained variance of all neighborhoods: " << report.validatedVariance << " (exact fit: " << report.exactVariance << ")" << std::endl;
+
 	// Save the asset.
 	AppearanceSpaceAsset asset;
 	std::shared_ptr<AppearanceSpace> descriptor{ std::move(dscr) };
@@ -245,7 +245,7 @@ int synthesize(const std::unordered_map<std::string, std::string>& exemplarMaps,
 
 	PyramidSynthesisSettings config(exemplar.width(), cv::Point2f(0.f, 0.f), randomness, kernel, seed);
 	
-	config._progressHandler.add([depth](int level, int pass, const cv::Mat& uv) -> void {
+	config._progressHandler.add([depth](int level, int pass, const cv::Mat& uv, const CorrectionStatistics& statistics) -> void {
 		if (pass == -1)
 			std::cout << "Executed level " << level + 1 << "/" << depth << " (Correction pass skipped)" << std::endl;
 		else
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 
 #include <iostream>
+#include <fstream>
 #include <chrono>
 
 #include <texturize.hpp>
@@ -19,14 +20,25 @@ const char* parameters =
 {
 	"{h help usage ?    |    | Displays this help message.}"
 	"{input in          |    | The name of an appearance space asset.}"
+	"{bundle b          |    | The name of a synthesis bundle. If the file exists and has been built from the same input and source progression, the search space and index are mapped from it. Otherwise the bundle is written after the index has been built.}"
 	"{result r          |    | The name of the image file, the result uv map stored to.}"
 	"{seed s            | 0  | The seed to initialize random number generators with.}"
+	"{count n           | 1  | The number of variations to synthesize. Variation i uses the seed s + i and its index gets appended to the result file name.}"
 	"{srcprog           |    | The name of a greyscale image, containing the source texture homogeneity progression.}"
 	"{trgprog           |    | The name of a greyscale image, containing the control homogeneity progression for the target texture.}"
 	"{inhomogeneity ih  | 0.9| The importance factor of the source and target inhomgeneneity on the result.}"
 	"{anisotropy ai     | 0.5| The importance of local anisotropy, i.e. how much weight goes into homogeneity progression and how much into orientation differences.}"
 	"{chaos c ji        | 1.0| A factor to scale the jitter amplitudes. Increasing this value will produce more random results.}"
 	"{albedo            |    | The name of an image file. If provided, the synthesizer displays feedback after each operation. Only usefull for debugging purposes.}"
+	"{scheduler         | lattice | The order in which correction sub-passes visit the sample. Can be either lattice (only visit the pixels of a sub-pass) or scan (scan the whole sample for each sub-pass).}"
+	"{correction        | subpasses | How correction passes update the sample. Can be either subpasses (sub-passes update the sample in place) or jacobi (each pass reads the previous result and writes into a second buffer).}"
+	"{deterministic     |    | If provided, the result does not depend on the number of threads.}"
+	"{converge          | 0  | If greater than zero, correction passes stop as soon as the ratio of changed pixels or the improvement of the match distance falls below this threshold.}"
+	"{maxpasses         | 0  | The maximum number of correction passes per level, if the convergence threshold is set. Allows additional passes for levels that have not converged.}"
+	"{cache             |    | The name of a directory, intermediate pyramid levels are stored to. Later runs with the same input and settings resume from the finest cached level.}"
+	"{checkpoint        |    | The name of a file, the synthesis state is stored to after each level and correction pass. If the file exists, the synthesis resumes from it.}"
+	"{stoplevel         | -1 | If not negative, the synthesis stops after this pyramid level and the uv map of the level is stored as result. Only applies to single variations.}"
+	"{profile           |    | If provided, the time of each synthesis level and correction pass is printed instead of a progress bar.}"
 };
 
 // Persistence providers.
@@ -95,17 +107,47 @@ int main(int argc, const char** argv) {
 
 	// Print parameters.
 	std::string inputFileName = parser.get<std::string>("input");
+	std::string bundleFileName = parser.get<std::string>("bundle");
 	std::string resultFileName = parser.get<std::string>("result");
 	std::string sourceProgressionFileName = parser.get<std::string>("srcprog");
 	std::string targetProgressionFileName = parser.get<std::string>("trgprog");
 	std::string albedoFileName = parser.get<std::string>("albedo");
 	unsigned int seed = parser.get<unsigned int>("seed");
+	unsigned int count = parser.get<unsigned int>("count");
 	float inhomogeneity = parser.get<float>("inhomogeneity");
 	float jitterIntensity = parser.get<float>("chaos");
+	std::string schedulerName = parser.get<std::string>("scheduler");
+	std::string correctionMode = parser.get<std::string>("correction");
+	bool deterministic = parser.has("deterministic");
+	float convergenceThreshold = parser.get<float>("converge");
+	unsigned int maxPasses = parser.get<unsigned int>("maxpasses");
+	std::string cacheDirectory = parser.get<std::string>("cache");
+	std::string checkpointFileName = parser.get<std::string>("checkpoint");
+	int stopLevel = parser.get<int>("stoplevel");
+	bool profile = parser.has("profile");
 
 	std::cout << "Input: " << inputFileName << std::endl <<
+		"Bundle: " << (bundleFileName.empty() ? "none" : bundleFileName) << std::endl <<
 		"Output: " << resultFileName << std::endl <<
-		"Seed: " << seed << std::endl;
+		"Seed: " << seed << std::endl <<
+		"Variations: " << count << std::endl <<
+		"Scheduler: " << schedulerName << std::endl <<
+		"Correction: " << correctionMode << std::endl;
+
+	if (count == 0) {
+		std::cout << "Error: At least one variation must be synthesized." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (schedulerName != "lattice" && schedulerName != "scan") {
+		std::cout << "Error: Unknown scheduler " << schedulerName << "." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (correctionMode != "subpasses" && correctionMode != "jacobi") {
+		std::cout << "Error: Unknown correction mode " << correctionMode << "." << std::endl;
+		return EXIT_FAILURE;
+	}
 
 	// Non-stationary synthesis can only be done, if a source homogeneity map is provided.
 	if (!sourceProgressionFileName.empty()) {
@@ -129,11 +171,36 @@ int main(int argc, const char** argv) {
 	Sample exemplar, result, srcProgression, trgProgression;
 	int kernel, width, height;
 	std::shared_ptr<ISearchIndex> index;
-	std::unique_ptr<AppearanceSpace> descriptor;
+	std::shared_ptr<CoherentIndex> coherentIndex;
+	std::shared_ptr<AppearanceSpace> descriptor;
+	std::unique_ptr<SynthesisBundle> bundle;
+
+	// Map the bundle, if it has been built from the same input files and inhomogeneity. Otherwise it gets rebuilt. The key only hashes the files, so the appearance 
+	// space asset does not need to be loaded, if the bundle is up to date.
+	std::uint64_t bundleKey(0);
+
+	if (!bundleFileName.empty()) {
+		std::vector<std::string> bundleInputs = { inputFileName };
+
+		if (!sourceProgressionFileName.empty())
+			bundleInputs.push_back(sourceProgressionFileName);
 
-	// Load the appearance space descriptor.
-	AppearanceSpaceAsset asset;
-	asset.read(inputFileName, descriptor);
+		bundleKey = SynthesisBundle::identify(bundleInputs, { inhomogeneity });
+
+		if (SynthesisBundle::matches(bundleFileName, bundleKey))
+			bundle = std::make_unique<SynthesisBundle>(bundleFileName);
+		else if (std::ifstream(bundleFileName).good())
+			std::cout << "The bundle does not match the input and gets rebuilt." << std::endl;
+	}
+
+	// Load the appearance space descriptor, unless it is stored within the bundle.
+	if (bundle != nullptr) {
+		descriptor = bundle->getSearchSpace();
+	} else {
+		std::unique_ptr<AppearanceSpace> asset;
+		AppearanceSpaceAsset().read(inputFileName, asset);
+		descriptor = std::move(asset);
+	}
 
 	// Get the exemplar and define the synthesis result.
 	descriptor->sample(exemplar);
@@ -148,9 +215,8 @@ int main(int argc, const char** argv) {
 	// Load the input samples, if they are provided.
 	srcProgression = Sample(cv::Mat::zeros(exemplar.size(), CV_32FC1));
 	trgProgression = Sample(cv::Mat::zeros(exemplar.size(), CV_32FC1));
+	std::optional<Sample> guidanceMap;
 
-	std::cout << "Initializing search index... ";
-	auto start = std::chrono::high_resolution_clock::now();
 	if (!sourceProgressionFileName.empty()) {
 		_persistence.loadSample(sourceProgressionFileName, srcProgression);
 		srcProgression.weight(inhomogeneity);
@@ -168,28 +234,44 @@ int main(int argc, const char** argv) {
 		TEXTURIZE_ASSERT(srcProgression.channels() == 1);
 		TEXTURIZE_ASSERT(trgProgression.channels() == 1);
 
+		guidanceMap = srcProgression;
+	}
+
+	std::cout << "Initializing search index... ";
+	auto start = std::chrono::high_resolution_clock::now();
+	if (bundle != nullptr) {
+		// The bundle already contains the index.
+		index = bundle->getSearchIndex();
+	} else if (guidanceMap.has_value()) {
 		// Build up the search index.
 		//std::unique_ptr<IDescriptorExtractor> descriptorExtractor = std::make_unique<Tapkee::PCADescriptorExtractor>();
 		//std::shared_ptr<ISearchIndex> index = std::make_shared<KNNIndex>(std::move(descriptor), std::move(descriptorExtractor));
 		//index = std::make_shared<ANNIndex>(std::move(descriptor), srcProgression);
 		//index = std::make_shared<KNNIndex>(std::move(descriptor), srcProgression);
-		index = std::make_shared<CoherentIndex>(std::move(descriptor), srcProgression, 3);
+		index = coherentIndex = std::make_shared<CoherentIndex>(descriptor, srcProgression, 3);
 		//index = std::make_shared<RandomWalkIndex>(std::move(descriptor), srcProgression);
 	} else {
 		//index = std::make_shared<ANNIndex>(std::move(descriptor));
 		//index = std::make_shared<KNNIndex>(std::move(descriptor));
-		index = std::make_shared<CoherentIndex>(std::move(descriptor), 3);
+		index = coherentIndex = std::make_shared<CoherentIndex>(descriptor, 3);
 		//index = std::make_shared<RandomWalkIndex>(std::move(descriptor));
 	}
+
+	// Store the bundle, so that subsequent runs can skip building the index.
+	if (!bundleFileName.empty() && coherentIndex != nullptr)
+		SynthesisBundle::write(bundleFileName, *descriptor, *coherentIndex, bundleKey);
+
 	auto end = std::chrono::high_resolution_clock::now();
 	std::cout << "Done! (" << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms)" << std::endl;
 
 #ifdef _DEBUG
 	auto synthesizer = PyramidSynthesizer::createSynthesizer(index);
 	//auto synthesizer = ParallelPyramidSynthesizer::createSynthesizer(index);
+	const bool parallel = false;
 #else
 	//auto synthesizer = PyramidSynthesizer::createSynthesizer(index);
 	auto synthesizer = ParallelPyramidSynthesizer::createSynthesizer(index);
+	const bool parallel = true;
 #endif
 
 	// Randomness Selector Function
@@ -221,6 +303,24 @@ int main(int argc, const char** argv) {
 
 	PyramidSynthesisSettings config(1.f, cv::Point2f(0.f, 0.f), randomnessSelector, kernel, seed);
 
+	// Select the sub-pass scheduler. The lattice scheduler is the default of the synthesizer, the scanline scheduler can be used for comparison.
+	if (schedulerName == "scan")
+		config._subpassScheduler = std::make_shared<ScanlineSubpassScheduler>(parallel);
+
+	// Select the correction mode.
+	if (correctionMode == "jacobi")
+		config._correctionMode = PyramidSynthesisSettings::CorrectionMode::Jacobi;
+
+	config._deterministic = deterministic;
+
+	// Setup the level cache.
+	if (!cacheDirectory.empty())
+		config._cache = std::make_shared<SynthesisCache>(256 << 20, cacheDirectory);
+
+	// Setup adaptive correction.
+	config._convergenceThreshold = convergenceThreshold;
+	config._maxCorrectionPasses = maxPasses;
+
 	// Toggle target guidance map.
 	if (!sourceProgressionFileName.empty())
 		config._guidanceMap = trgProgression;
@@ -235,24 +335,88 @@ int main(int argc, const char** argv) {
 
 	// Setup progress handler.
 	const int passesPerLevel = config._correctionPasses;
+	auto lastProgress = std::chrono::high_resolution_clock::now();
 	
-	config._progressHandler.add([depth, passesPerLevel](int level, int pass, const cv::Mat& uv) -> void {
+	config._progressHandler.add([depth, passesPerLevel, profile, &lastProgress](int level, int pass, const cv::Mat& uv, const CorrectionStatistics& statistics) -> void {
+		// If profiling is enabled, print the time since the last callback, i.e. the time required to synthesize the level or to perform the correction pass.
+		if (profile) {
+			auto now = std::chrono::high_resolution_clock::now();
+			auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - lastProgress).count();
+
+			if (pass == -1)
+				std::cout << "Level " << level << " (" << uv.cols << "x" << uv.rows << "): " << (elapsed / 1000.0) << "ms" << std::endl;
+			else
+				std::cout << "Level " << level << " (" << uv.cols << "x" << uv.rows << "), correction pass " << pass << ": " << (elapsed / 1000.0) << "ms (" << 
+					(statistics.changeRate() * 100.0) << "% changed, mean distance " << statistics.meanDistance() << ")" << std::endl;
+
+			lastProgress = std::chrono::high_resolution_clock::now();
+			return;
+		}
+
 		float progressPerCallback = (static_cast<float>(1.f) / static_cast<float>(depth)) / static_cast<float>(passesPerLevel);
 		float currentProgress = static_cast<float>(level) / static_cast<float>(depth);
 
 		if (pass != -1)
-			currentProgress += static_cast<float>(pass + 1) * progressPerCallback;
+			currentProgress += static_cast<float>(std::min(pass + 1, passesPerLevel)) * progressPerCallback;
 		
 		displayProgress(currentProgress);
 	});
 
 	// Perform the synthesis.
-	std::cout << "Performing synthesis..." << std::endl;
+	if (count == 1) {
+		SynthesisCheckpoint checkpoint;
+		checkpoint.size = cv::Size(width, height);
+
+		// Resume from an existing checkpoint and store the state after each level and pass.
+		if (!checkpointFileName.empty()) {
+			if (std::ifstream(checkpointFileName).good()) {
+				checkpoint = SynthesisCheckpoint::load(checkpointFileName);
+				std::cout << "Resuming from level " << checkpoint.level << ", correction pass " << checkpoint.pass << "." << std::endl;
+			}
+
+			config._checkpointHandler.add([&checkpointFileName](const SynthesisCheckpoint& state) -> void {
+				state.save(checkpointFileName);
+			});
+		}
+
+		std::cout << "Performing synthesis..." << std::endl;
+		start = lastProgress = std::chrono::high_resolution_clock::now();
+		dynamic_cast<const PyramidSynthesizer&>(*synthesizer).resume(checkpoint, config, stopLevel);
+		result = Sample(checkpoint.uv);
+		end = std::chrono::high_resolution_clock::now();
+		std::cout << std::endl << "Done! (" << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms)" << std::endl;
+
+		// Store the result uv map.
+		_persistence.saveSample(resultFileName, result);
+		return EXIT_SUCCESS;
+	}
+
+	// Synthesize all variations in one batch. The handlers would be called from multiple jobs concurrently, so they are not used.
+	config._progressHandler = PyramidSynthesisSettings::ProgressHandler();
+	config._feedbackHandler = PyramidSynthesisSettings::SubpassFeedbackHandler();
+
+	std::vector<PyramidSynthesizer::Job> jobs;
+
+	for (unsigned int v(0); v < count; ++v) {
+		PyramidSynthesisSettings variation(config);
+		variation._rngState = seed + v;
+		jobs.push_back({ cv::Size(width, height), variation });
+	}
+
+	// Store each variation as soon as it has been synthesized.
+	const size_t extension = resultFileName.find_last_of('.');
+	const std::string baseName = resultFileName.substr(0, extension);
+	const std::string suffix = extension == std::string::npos ? std::string() : resultFileName.substr(extension);
+
+	std::cout << "Performing batch synthesis..." << std::endl;
 	start = std::chrono::high_resolution_clock::now();
-	synthesizer->synthesize(width, height, result, config);
-	end = std::chrono::high_resolution_clock::now();
-	std::cout << std::endl << "Done! (" << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms)" << std::endl;
 
-	// Store the result uv map.
-	_persistence.saveSample(resultFileName, result);
+	dynamic_cast<const PyramidSynthesizer&>(*synthesizer).synthesizeBatch(jobs, [&baseName, &suffix](size_t job, const Sample& variation) -> void {
+		const std::string fileName = baseName + "_" + std::to_string(job) + suffix;
+		_persistence.saveSample(fileName, variation);
+		std::cout << "Stored variation " << job << " to " << fileName << std::endl;
+	});
+
+	end = std::chrono::high_resolution_clock::now();
+	std::cout << "Done! (" << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms)" << std::endl;
 }
\ No newline at end of file
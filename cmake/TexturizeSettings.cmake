@@ -17,6 +17,9 @@ OPTION(BUILD_APP_APPEARANCE_SPACE   "Builds app that transforms exemplars into a
 OPTION(BUILD_APP_SYNTHESIZE         "Builds synthesizer app."                                                                    ON)
 OPTION(BUILD_APP_UV_MAP             "Builds app that remaps an input based on an user-provided UV map."                          ON)
 
+OPTION(BUILD_TESTS                  "Builds the tests, that can be run with CTest."                                              ON)
+OPTION(BUILD_BENCHMARKS             "Builds the benchmarks, that measure the performance of the synthesizers."                   OFF)
+
 IF("${OpenCV_DIR}" STREQUAL "")
   SET(OpenCV_DIR "${CMAKE_MODULE_PATH}/opencv")
 ENDIF("${OpenCV_DIR}" STREQUAL "")
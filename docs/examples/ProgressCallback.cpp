@@ -26,7 +26,7 @@ int main(int argc, const char** argv)
 	Texturize::PyramidSynthesisSettings config(width, cv::Point2f(0.f, 0.f), 0.1f, 5, 0);
 	
     // Setup a progress handler, that prints information to the console and displays the current sample.
-	config._progressHandler.add([&exemplar, depth](int level, int pass, const cv::Mat& uv) -> void {
+	config._progressHandler.add([&exemplar, depth](int level, int pass, const cv::Mat& uv, const Texturize::CorrectionStatistics& statistics) -> void {
 		if (pass == -1)
 			std::cout << "Executed level " << level + 1 << "/" << depth << " (Correction pass skipped)" << std::endl;
 		else
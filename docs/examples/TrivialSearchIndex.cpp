@@ -43,7 +43,8 @@ void TrivialSearchIndex::init() {
 	const Sample* sample;
 	_searchSpace->sample(&sample);
 
-	// Form a descriptor vector from the sample.
+	// Fit the extractor to the sample and form a descriptor vector from it.
+	_descriptorExtractor->fit(*sample);
 	_exemplarDescriptors = _descriptorExtractor->calculateNeighborhoodDescriptors(*sample);
 }
 
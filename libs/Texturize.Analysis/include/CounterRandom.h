@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+/// \brief Contains a counter-based random number generator.
+///
+/// Different from a sequential generator, like `std::mt19937`, each random value is a pure function of a seed, a stream and a counter. Parallel algorithms can
+/// assign one stream to each work item (e.g. a pixel) and draw values by incrementing the counter, so that they neither share any state between threads, nor 
+/// depend on the order in which the work items are processed. The values are generated by mixing the inputs with the SplitMix64 finalizer.
+///
+/// \see Guy L. Steele, Doug Lea and Christine H. Flood. "Fast Splittable Pseudorandom Number Generators." In: Proceedings of OOPSLA 2014, pp. 453-472. doi: 10.1145/2660193.2660195
+namespace CounterRandom {
+
+	/// \brief Scrambles the bits of a 64 bit value.
+	static inline std::uint64_t mix(std::uint64_t z)
+	{
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	/// \brief Returns a random 64 bit value.
+	/// \param seed The seed of the generator.
+	/// \param stream The index of the stream, e.g. the index of a pixel.
+	/// \param counter The index of the value within the stream.
+	static inline std::uint64_t next(const std::uint64_t seed, const std::uint64_t stream, const std::uint64_t counter)
+	{
+		return mix(mix(seed * 0x9E3779B97F4A7C15ull + stream) ^ (counter * 0xD1B54A32D192ED03ull));
+	}
+
+	/// \brief Returns a random integer within the range [0, n).
+	/// \param seed The seed of the generator.
+	/// \param stream The index of the stream, e.g. the index of a pixel.
+	/// \param counter The index of the value within the stream.
+	/// \param n The exclusive upper bound of the result. Must be positive.
+	static inline int uniform(const std::uint64_t seed, const std::uint64_t stream, const std::uint64_t counter, const int n)
+	{
+		// Scale the upper 32 bits into the range, which avoids the bias and the division of a modulo operation.
+		return static_cast<int>(((next(seed, stream, counter) >> 32) * static_cast<std::uint64_t>(n)) >> 32);
+	}
+
+	/// \brief Returns a random floating point value within the range [0, 1).
+	/// \param seed The seed of the generator.
+	/// \param stream The index of the stream, e.g. the index of a pixel.
+	/// \param counter The index of the value within the stream.
+	static inline float uniform(const std::uint64_t seed, const std::uint64_t stream, const std::uint64_t counter)
+	{
+		return static_cast<float>(next(seed, stream, counter) >> 40) * (1.f / 16777216.f);
+	}
+}
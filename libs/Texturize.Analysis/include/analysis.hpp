@@ -55,17 +55,42 @@ namespace Texturize {
 		/// \brief Defines a texel as a vector of floating-point values.
 		typedef std::vector<float> Texel;
 
+		/// \brief Defines how the texels of a sample are stored in memory.
+		enum class Layout {
+			/// \brief Each channel is stored in a separate `cv::Mat` object. This layout suits filters, that operate on individual channels.
+			Planar,
+			/// \brief The channels of a texel are stored next to each other, padded to a multiple of `Sample::TexelAlignment` values. This layout suits
+			/// random access to whole texels, since reading a texel only touches one contiguous block of memory.
+			Interleaved
+		};
+
+		/// \brief The number of values, the texels of an interleaved sample are padded to.
+		static const int TexelAlignment = 4;
+
 	protected:
-		/// \brief A vector that stores each channel of the sample as a separate `cv::Mat` object.
+		/// \brief A vector that stores each channel of the sample as a separate `cv::Mat` object, if the sample has a planar layout.
 		std::vector<cv::Mat> _channels = { cv::Mat() };
 
+		/// \brief The memory layout of the sample.
+		Layout _layout = Layout::Planar;
+
+		/// \brief A single-channel matrix, that stores `width * _texelStride` values per row, if the sample has an interleaved layout.
+		cv::Mat _texels;
+
+		/// \brief The number of channels of an interleaved sample.
+		int _texelChannels = 0;
+
+		/// \brief The number of values between two texels of an interleaved sample.
+		int _texelStride = 0;
+
 	public:
 		/// \brief Creates a new `Sample` instance.
 		Sample() = default;
 
 		/// \brief Creates a new `Sample` instance.
 		/// \param raw An matrix that may contain one or multiple channels to initialize the sample with.
-		explicit Sample(const cv::Mat& raw);
+		/// \param layout The memory layout of the sample.
+		explicit Sample(const cv::Mat& raw, const Layout layout = Layout::Planar);
 
 		/// \brief Creates a new `Sample` instance.
 		/// \param channels The number of channels to initialize the sample with.
@@ -74,13 +99,15 @@ namespace Texturize {
 		/// \brief Creates a new `Sample` instance.
 		/// \param channels The number of channels to initialize the sample with.
 		/// \param size The size of the sample.
-		Sample(const size_t channels, const cv::Size& size);
+		/// \param layout The memory layout of the sample.
+		Sample(const size_t channels, const cv::Size& size, const Layout layout = Layout::Planar);
 
 		/// \brief Creates a new `Sample` instance.
 		/// \param channels The number of channels to initialize the sample with.
 		/// \param width The width of the sample.
 		/// \param height The height of the sample.
-		Sample(const size_t channels, const int width, const int height);
+		/// \param layout The memory layout of the sample.
+		Sample(const size_t channels, const int width, const int height, const Layout layout = Layout::Planar);
 
 		virtual ~Sample() = default;
 
@@ -94,6 +121,20 @@ namespace Texturize {
 		/// is the sample width and \f$h\f$ is the sample height.
 		void wrapCoords(int& x, int& y) const;
 
+		/// \brief Returns the number of values, a texel with a certain number of channels occupies within an interleaved sample.
+		/// \param channels The number of channels of the texel.
+		/// \returns The number of channels, rounded up to a multiple of `Sample::TexelAlignment`.
+		static int paddedStride(const int channels);
+
+		/// \brief Checks if the data of a matrix may be referenced by other matrices.
+		/// \param data The matrix to check.
+		/// \returns `true`, if the matrix is not the only reference to its data or does not own its data, otherwise `false`.
+		static bool isShared(const cv::Mat& data);
+
+		/// \brief Makes sure, that the sample exclusively owns the storage of a channel, before it gets modified.
+		/// \param index The index of the channel. For interleaved samples, all channels share one storage, so the index is ignored.
+		void detach(const int index);
+
 	public:
 		/// \brief Wraps a set of absolute coordinates, so that they are within the range of the sample size.
 		/// \param width The width, the x coordinate should be wraped to.
@@ -129,6 +170,15 @@ namespace Texturize {
 		/// \param to The `Sample` to map the \ref `sample` parameter to.
 		static void sample(const Sample& sample, const cv::Mat& uv, Sample& to);
 
+		/// \brief Creates an interleaved sample, that refers to existing texel storage, instead of copying it.
+		/// \param texels A single-channel floating point matrix, that stores one texel row in each row. Each texel occupies `Sample::paddedStride(channels)` values.
+		/// \param channels The number of channels of each texel.
+		/// \returns A sample, that refers to the memory of `texels`.
+		///
+		/// If the matrix does not own its memory (e.g. because it wraps a memory mapped file), the sample does not keep the memory alive. Such a sample is treated as
+		/// shared, so it gets copied before it is modified.
+		static Sample wrapTexels(const cv::Mat& texels, const size_t channels);
+
 		/// \brief Samples a provided sample using a provided uv map.
 		/// \param sample The sample to map according to the `uv` map.
 		/// \param uv A two-dimensional uv map, where a pixel contains the u and v coordinate of the \ref `sample` that should be mapped to the result.
@@ -157,18 +207,33 @@ namespace Texturize {
 		/// \brief Overwrites a single channel.
 		/// \param index The index of the channel to overwrite.
 		/// \param channel A matrix with a depth of 1 and a size equal to the current sample, that contains the pixel values to overwrite the current channel with.
+		///
+		/// Planar samples share the data of the \ref `channel` matrix, instead of copying it. The data gets copied, before the sample modifies it (copy-on-write), 
+		/// so the caller must not modify the matrix afterwards. Matrices that do not own their data are copied immediately.
 		virtual void setChannel(const int index, const cv::Mat& channel);
 
 		/// \brief Copies a channel from the current sample.
 		/// \param index The index of the channel to copy.
 		/// \param channel A buffer to copy the channel to.
+		///
+		/// Different from \ref `getChannel`, the buffer receives a copy of the channel, that can be modified freely.
 		virtual void copyChannel(const int index, cv::Mat& channel) const;
 
 		/// \brief Returns a channel from the current sample.
 		/// \param index The index of the channel to return.
-		/// \returns A copy of the channel, identified by \ref `index`.
+		/// \returns The channel, identified by \ref `index`.
+		///
+		/// Planar samples return a matrix, that shares its data with the sample, so it must be treated as read-only. Use \ref `copyChannel`, if the channel 
+		/// should be modified. Interleaved samples always return a new matrix.
 		virtual cv::Mat getChannel(const int index) const;
 
+		/// \brief Makes sure, that the current sample exclusively owns its storage.
+		///
+		/// Copies of a sample share their storage, until one of them gets modified (copy-on-write). Most modifying methods detach the sample automatically. 
+		/// Writing texels through a pointer does not, since it is called for each texel, so this method must be called beforehand. If multiple threads write to a 
+		/// sample concurrently, this method should also be called beforehand, so that the storage does not get copied by multiple threads at once.
+		void detach();
+
 		/// \brief Sets the values of a single texel within the current sample.
 		/// \param at A set of absolute coordinates that address the texel.
 		/// \param texel A vector of floating point values to overwrite the current texel values with. The vector must have the same dimensionality as the sample.
@@ -180,6 +245,15 @@ namespace Texturize {
 		/// \param texel A vector of floating point values to overwrite the current texel values with. The vector must have the same dimensionality as the sample.
 		virtual void setTexel(const int x, const int y, const std::vector<float>& texel);
 
+		/// \brief Sets the values of a single texel within the current sample.
+		/// \param x The absolute x coordinate of the texel.
+		/// \param y The absolute y coordinate of the texel.
+		/// \param texel A pointer to an array of floating point values to overwrite the current texel values with. The array must contain one value for each channel.
+		///
+		/// Different from the other overloads, this method does not detach the sample, so that it can be called within tight loops. Call \ref `detach` before 
+		/// writing into a sample, whose storage may be shared.
+		virtual void setTexel(const int x, const int y, const float* texel);
+
 		/// \brief Gets the size of the current sample.
 		/// \param width The width of the current sample.
 		/// \param height The height of the current sample.
@@ -205,6 +279,36 @@ namespace Texturize {
 		/// \returns The height of the current sample.
 		virtual int height() const;
 
+		/// \brief Returns the memory layout of the current sample.
+		/// \returns The memory layout of the current sample.
+		Layout getLayout() const;
+
+		/// \brief Converts the current sample into another memory layout.
+		/// \param layout The memory layout to convert the sample to.
+		///
+		/// If the sample already has the requested layout, the method does nothing. Otherwise the texel data gets copied, so that other samples, that shared
+		/// the data with the current instance, are not affected.
+		void setLayout(const Layout layout);
+
+		/// \brief Returns the storage of an interleaved sample.
+		/// \returns A single-channel matrix, where each row stores `width() * getTexelStride()` values.
+		///
+		/// The method must only be called on samples with an interleaved layout. It is intended for kernels, that directly operate on the texel memory.
+		const cv::Mat& getTexels() const;
+
+		/// \brief Returns the number of values between two texels of an interleaved sample.
+		/// \returns The number of values between two texels, which is `channels()` rounded up to a multiple of `Sample::TexelAlignment`.
+		int getTexelStride() const;
+
+		/// \brief Returns a pointer to a texel of an interleaved sample.
+		/// \param x The x coordinate of the texel. It must be within the sample.
+		/// \param y The y coordinate of the texel. It must be within the sample.
+		/// \returns A pointer to the first channel of the texel.
+		inline const float* ptr(const int x, const int y) const
+		{
+			return _texels.ptr<float>(y) + x * _texelStride;
+		}
+
 		/// \brief Gets a texel at a specified location.
 		/// \param x The x coordinate of the texel to return.
 		/// \param y The y coordinate of the texel to return.
@@ -227,6 +331,24 @@ namespace Texturize {
 		/// \param The texel identified by the x and y coordinates.
 		void at(const cv::Vec2f& uv, Texel& texel) const;
 
+		/// \brief Copies a texel at a specified location into a buffer.
+		/// \param x The x coordinate of the texel. If it is outside the sample, it gets wrapped.
+		/// \param y The y coordinate of the texel. If it is outside the sample, it gets wrapped.
+		/// \param texel A pointer to a buffer, that receives one value for each channel.
+		///
+		/// Different from the overloads that return a `Texel`, this method does not allocate any memory, so it should be preferred within inner loops.
+		void at(const int x, const int y, float* const texel) const;
+
+		/// \brief Copies a texel at a specified location into a buffer.
+		/// \param p The x and y coordinates of the texel. If they are outside the sample, they get wrapped.
+		/// \param texel A pointer to a buffer, that receives one value for each channel.
+		void at(const cv::Point2i& p, float* const texel) const;
+
+		/// \brief Copies a texel at a specified location into a buffer.
+		/// \param uv The u and v coordinates of the texel.
+		/// \param texel A pointer to a buffer, that receives one value for each channel.
+		void at(const cv::Vec2f& uv, float* const texel) const;
+
 		/// \brief Maps a subset of channels from the current sample to another sample.
 		/// \param fromTo A pointer to an array of channel indices, containing a set of pairs that identify a mapping between the channels.
 		/// \param pairs The number of pairs within the \ref `fromTo` array.
@@ -310,6 +432,27 @@ namespace Texturize {
 		/// are copied, before moving to the next pixel.
 		void getNeighborhood(const cv::Point& p, const int kernel, Texel& v, const bool weight = false) const;
 
+		/// \brief Copies the neighborhood of a texel into a buffer.
+		/// \param x The x coordinate of the texel.
+		/// \param y the y coordinate of the texel.
+		/// \param kernel The size of the neighborhood window. Must be an odd value.
+		/// \param v A pointer to a buffer, that receives `kernel * kernel * channels()` values.
+		/// \param weight A boolean value that toggles gaussian weighting of neighborhood values, depending on the distance to the texel identified by the provided coordinates.
+		///
+		/// The layout of the result equals the one of the other overloads. However, this method does not allocate any memory, so it should be preferred within inner loops.
+		///
+		/// \see Texturize::Sample::getNeighborhoodWeights
+		void getNeighborhood(const int x, const int y, const int kernel, float* const v, const bool weight = false) const;
+
+	public:
+		/// \brief Returns the gaussian weights, that are applied to the texels of a neighborhood.
+		/// \param kernel The size of the neighborhood window. Must be an odd value.
+		/// \returns A vector, that contains `kernel * kernel` weights in the order the neighborhood texels are stored.
+		///
+		/// The weights only depend on the kernel size, so they are calculated once and cached for subsequent calls. The returned reference stays valid for the lifetime
+		/// of the program. For kernel sizes up to 63, subsequent calls do not acquire a lock, so the method can be called from parallel loops.
+		static const std::vector<float>& getNeighborhoodWeights(const int kernel);
+
 		/// \brief Clones the current sample to a specified buffer.
 		/// \param s The buffer to clone the current sample to.
 		void clone(Sample& s) const;
@@ -872,6 +1015,80 @@ namespace Texturize {
 
 	// class TEXTURIZE_API ColorSpace : public ISearchSpace { };
 
+	/// \brief Describes which pixels are used to fit a projection of pixel neighborhoods.
+	///
+	/// For stationary textures, a projection that is fit to a stratified subset of pixels has almost the same basis as one that is fit to all pixels. However, 
+	/// the time required to fit it scales with the number of selected pixels, rather than the exemplar area. The pixels are selected by dividing the exemplar into
+	/// square cells and randomly picking one pixel from each cell, so that the whole exemplar is covered evenly.
+	///
+	/// \see Texturize::ProjectionReport
+	struct TEXTURIZE_API NeighborhoodSampling {
+		/// \brief The ratio of pixels, whose neighborhoods are used to fit the projection. Must be within the range (0, 1].
+		float fraction = 1.f;
+
+		/// \brief The seed used to pick a pixel from each cell.
+		unsigned int seed = 0;
+
+		/// \brief If set to `true`, the projection is compared against an exact fit on all pixels.
+		///
+		/// Validation requires to analyze all neighborhoods, so it is only intended to tune the \ref `fraction` for a class of exemplars.
+		bool validate = false;
+
+		/// \brief Returns the edge length of the cells, from which one pixel gets selected.
+		/// \returns The edge length of the cells, which is `1` if all pixels are selected.
+		int cellSize() const;
+
+		/// \brief Returns the number of cells along each axis of an exemplar.
+		/// \param size The size of the exemplar.
+		/// \returns The number of cells along each axis.
+		cv::Size cells(const cv::Size& size) const;
+
+		/// \brief Returns the pixel, that is selected from a cell.
+		/// \param size The size of the exemplar.
+		/// \param x The horizontal index of the cell.
+		/// \param y The vertical index of the cell.
+		/// \returns The coordinates of the selected pixel. The same cell always returns the same pixel for a given \ref `seed`.
+		cv::Point2i pick(const cv::Size& size, const int x, const int y) const;
+
+		/// \brief Returns all selected pixels of an exemplar.
+		/// \param size The size of the exemplar.
+		/// \returns The selected pixels in row-major order of their cells.
+		std::vector<cv::Point2i> select(const cv::Size& size) const;
+	};
+
+	/// \brief Reports how well a projection of pixel neighborhoods describes an exemplar.
+	///
+	/// \see Texturize::NeighborhoodSampling
+	struct TEXTURIZE_API ProjectionReport {
+		/// \brief The number of neighborhoods, the projection has been fit to.
+		size_t samples = 0;
+
+		/// \brief The number of principal components of the projection.
+		int components = 0;
+
+		/// \brief The ratio of the variance of the fitted neighborhoods, that is retained by the projection.
+		double explainedVariance = 0.;
+
+		/// \brief The ratio of the variance of all neighborhoods, that is retained by the projection, or a negative value, if the projection has not been validated.
+		double validatedVariance = -1.;
+
+		/// \brief The ratio of the variance of all neighborhoods, that is retained by an exact fit with the same number of components, or a negative value, if the
+		/// projection has not been validated.
+		double exactVariance = -1.;
+
+		/// \brief Calculates the ratio of variance, that is retained when projecting onto a basis.
+		/// \param basis A matrix that stores one basis vector per row.
+		/// \param covariance The covariance matrix of the data, that gets projected.
+		/// \returns The ratio between the variance within the subspace spanned by the \ref `basis` and the total variance.
+		static double getExplainedVariance(const cv::Mat& basis, const cv::Mat& covariance);
+
+		/// \brief Calculates the ratio of variance, that is retained by the leading principal components of a covariance matrix.
+		/// \param covariance The covariance matrix of the data.
+		/// \param components The number of principal components.
+		/// \returns The ratio between the variance of the \ref `components` largest eigenvalues and the total variance.
+		static double getExactVariance(const cv::Mat& covariance, const int components);
+	};
+
 	/// \brief A search space implementation based on pixel neighborhood appearances.
 	///
 	/// The *Appearance Space* has been first described by Sylvain Lefebvre and Hugues Hoppe and describes a search space, based on pixel neighborhood appearances, rather than 
@@ -907,6 +1124,10 @@ namespace Texturize {
 	{
 		/// \example ColorSearchSpace.cpp The example demonstrates how to implement a custom search space, that builds simple neighborhood descriptors from pixel color values.
 
+	public:
+		/// \brief The edge length of the tiles, that are processed in parallel when analyzing or projecting pixel neighborhoods.
+		static const int TileSize = 64;
+
 	private:
 		const std::shared_ptr<const cv::PCA> _projection;
 		const std::shared_ptr<const Sample> _exemplar;
@@ -920,7 +1141,9 @@ namespace Texturize {
 		///
 		/// Note: typically you do not want to directly construct an `AppearanceSpace` instance. Instead use the \ref `Texturize::AppearanceSpace::calculate` methods
 		/// to get a newly created instance or load them from a persistent asset.
-		AppearanceSpace(std::unique_ptr<const cv::PCA> projection, std::unique_ptr<const Sample> exemplar, const int kernelSize);
+		///
+		/// The projection and exemplar may be shared with other owners, e.g. a memory mapped `Texturize::SynthesisBundle`.
+		AppearanceSpace(std::shared_ptr<const cv::PCA> projection, std::shared_ptr<const Sample> exemplar, const int kernelSize);
 
 	protected:
 		/// \brief Returns a matrix, containing all the pixel neighborhoods of the provided exemplar.
@@ -929,34 +1152,81 @@ namespace Texturize {
 		/// \returns A column-major matrix containing high-dimensional vectors, that describe a pixel neighborhood. Each column represents a single pixel of the input exemplar.
 		static cv::Mat getComponents(const Sample& exemplar, int kernel);
 
+		/// \brief Calculates the mean and covariance of all pixel neighborhoods of an exemplar.
+		/// \param exemplar The exemplar sample, of which the pixel neighborhoods should be analyzed.
+		/// \param kernel The kernel size of the neighborhood window.
+		/// \param mean A row vector, that receives the mean neighborhood in double precision.
+		/// \param covariance A square matrix, that receives the covariance of the neighborhoods in double precision.
+		/// \param sampling Selects the pixels, whose neighborhoods are analyzed.
+		/// \returns The number of analyzed neighborhoods.
+		///
+		/// Different from \ref `getComponents`, the neighborhoods are never stored at once. Instead, the exemplar is processed in tiles of `TileSize` pixels, whose
+		/// moments are accumulated in parallel. The memory requirement therefore only depends on the neighborhood dimensionality, not on the exemplar size.
+		static size_t getMoments(const Sample& exemplar, int kernel, cv::Mat& mean, cv::Mat& covariance, const NeighborhoodSampling& sampling = NeighborhoodSampling());
+
+		/// \brief Creates a projection from the eigen decomposition of a neighborhood covariance matrix.
+		/// \param mean The mean neighborhood, as returned by \ref `getMoments`.
+		/// \param covariance The neighborhood covariance, as returned by \ref `getMoments`.
+		/// \param components The number of principal components to retain. If it is not positive, the number is selected from \ref `retainedVariance`.
+		/// \param retainedVariance The ratio of variance to retain, if no number of components has been provided.
+		/// \returns A projection, that is equal to a `cv::PCA` calculated from all neighborhoods with `cv::PCA::DATA_AS_COL`.
+		static std::unique_ptr<cv::PCA> getProjection(const cv::Mat& mean, const cv::Mat& covariance, int components, double retainedVariance = 1.);
+
+		/// \brief Projects all pixel neighborhoods of a sample into a new sample.
+		/// \param exemplar The sample, whose pixel neighborhoods should be projected.
+		/// \param kernel The kernel size of the neighborhood window.
+		/// \param projection The projection to apply.
+		/// \param to The sample, that receives one channel per principal component of the \ref `projection`.
+		/// \param layout The memory layout of the result sample.
+		///
+		/// The neighborhoods are gathered and projected tile by tile, so that they never need to be stored at once.
+		static void project(const Sample& exemplar, int kernel, const cv::PCA& projection, Sample& to, const Sample::Layout layout);
+
+	private:
+		/// \brief Fits the projection to an exemplar, either for a fixed number of components or for a target variance, and projects the exemplar.
+		static void fit(const Sample& exemplar, std::unique_ptr<AppearanceSpace>& descriptor, int resultDim, double targetVariance, int kernelSize, 
+			const NeighborhoodSampling& sampling, ProjectionReport* report);
+
 	public:
 		/// \brief Calculates the appearance space for an individual exemplar.
 		/// \param exemplar The exemplar sample to calculate the seach space for.
 		/// \param desc A pointer that will be initialized with the calculated search space instance.
 		/// \param resultDim The number of dimensionality retained after transforming pixel neighborhoods into search space.
 		/// \param kernel The size of the kernel window used to extract search space neighborhoods.
-		static void calculate(const Sample& exemplar, std::unique_ptr<AppearanceSpace>& descriptor, size_t resultDim = 3, int kernelSize = 5);
+		/// \param sampling Selects the pixels, whose neighborhoods are used to fit the projection.
+		/// \param report An optional pointer to a report, that receives the explained variance of the projection.
+		static void calculate(const Sample& exemplar, std::unique_ptr<AppearanceSpace>& descriptor, size_t resultDim = 3, int kernelSize = 5, 
+			const NeighborhoodSampling& sampling = NeighborhoodSampling(), ProjectionReport* report = nullptr);
 
 		/// \brief Calculates the appearance space for an individual exemplar.
 		/// \param exemplar The exemplar sample to calculate the seach space for.
 		/// \param desc A pointer that will be initialized with the calculated search space instance.
 		/// \param targetVariance The variance retained by the search space transform.
 		/// \param kernel The size of the kernel window used to extract search space neighborhoods.
-		static void calculate(const Sample& exemplar, std::unique_ptr<AppearanceSpace>& descriptor, float targetVariance = 0.9f, int kernelSize = 5);
+		/// \param sampling Selects the pixels, whose neighborhoods are used to fit the projection.
+		/// \param report An optional pointer to a report, that receives the explained variance of the projection.
+		static void calculate(const Sample& exemplar, std::unique_ptr<AppearanceSpace>& descriptor, float targetVariance = 0.9f, int kernelSize = 5,
+			const NeighborhoodSampling& sampling = NeighborhoodSampling(), ProjectionReport* report = nullptr);
 
 		/// \brief Calculates the appearance space for a set of exemplar samples.
 		/// \param exemplar The exemplar samples to calculate the seach space for.
 		/// \param desc A pointer that will be initialized with the calculated search space instance.
 		/// \param resultDim The number of dimensionality retained after transforming pixel neighborhoods into search space.
 		/// \param kernel The size of the kernel window used to extract search space neighborhoods.
-		static void calculate(std::initializer_list<const Sample> exemplarMaps, std::unique_ptr<AppearanceSpace>& descriptor, size_t resultDim, int kernelSize = 5);
+		/// \param sampling Selects the pixels, whose neighborhoods are used to fit the projection.
+		/// \param report An optional pointer to a report, that receives the explained variance of the projection.
+		static void calculate(std::initializer_list<const Sample> exemplarMaps, std::unique_ptr<AppearanceSpace>& descriptor, size_t resultDim, int kernelSize = 5,
+			const NeighborhoodSampling& sampling = NeighborhoodSampling(), ProjectionReport* report = nullptr);
 
 		/// \brief Calculates the appearance space for a set of exemplar samples.
 		/// \param exemplar The exemplar samples to calculate the seach space for.
 		/// \param desc A pointer that will be initialized with the calculated search space instance.
 		/// \param targetVariance The variance retained by the search space transform.
 		/// \param kernel The size of the kernel window used to extract search space neighborhoods.
-		static void calculate(std::initializer_list<const Sample> exemplarMaps, std::unique_ptr<AppearanceSpace>& descriptor, float targetVariance = 0.9f, int kernelSize = 5);
+		/// \param sampling Selects the pixels, whose neighborhoods are used to fit the projection.
+		/// \param report An optional pointer to a report, that receives the explained variance of the projection.
+		static void calculate(std::initializer_list<const Sample> exemplarMaps, std::unique_ptr<AppearanceSpace>& descriptor, float targetVariance = 0.9f, int kernelSize = 5,
+			const NeighborhoodSampling& sampling = NeighborhoodSampling(), ProjectionReport* report = nullptr);
 
 	public:
 		/// \brief Gets a reference of the projection matrix used to project pixel neighborhoods into the search space.
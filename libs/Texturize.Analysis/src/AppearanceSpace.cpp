@@ -4,17 +4,83 @@
 
 #include <tbb\blocked_range2d.h>
 #include <tbb\parallel_for_each.h>
+#include <tbb\parallel_reduce.h>
 
 #include <iostream>
 #include <chrono>
 
 using namespace Texturize;
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Neighborhood moments                                                                    /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// \brief Accumulates the sum and the sum of outer products of the pixel neighborhoods within a range of exemplar tiles.
+///
+/// The class implements the body of a `tbb::parallel_reduce`. Each tile is gathered into a small matrix, whose moments are added to the accumulators in double 
+/// precision, so that the memory requirement only depends on the tile size and the neighborhood dimensionality. The range addresses cells of the sampling
+/// grid, from each of which one neighborhood is gathered.
+class NeighborhoodMoments {
+private:
+	const Sample& _exemplar;
+	const int _kernel;
+	const int _dimensionality;
+	const NeighborhoodSampling& _sampling;
+
+public:
+	cv::Mat _sum;
+	cv::Mat _products;
+	double _count;
+
+public:
+	NeighborhoodMoments(const Sample& exemplar, const int kernel, const NeighborhoodSampling& sampling) :
+		_exemplar(exemplar), _kernel(kernel), _dimensionality(kernel * kernel * static_cast<int>(exemplar.channels())), _sampling(sampling),
+		_sum(cv::Mat::zeros(1, _dimensionality, CV_64FC1)), _products(cv::Mat::zeros(_dimensionality, _dimensionality, CV_64FC1)), _count(0.)
+	{
+	}
+
+	NeighborhoodMoments(NeighborhoodMoments& other, tbb::split) :
+		NeighborhoodMoments(other._exemplar, other._kernel, other._sampling)
+	{
+	}
+
+public:
+	void operator()(const tbb::blocked_range2d<int>& range)
+	{
+		// Gather the neighborhoods of the selected pixels into the rows of a matrix.
+		cv::Mat tile(static_cast<int>(range.rows().size() * range.cols().size()), _dimensionality, CV_32FC1);
+		const cv::Size size = _exemplar.size();
+
+		for (int y(range.rows().begin()), i(0); y < range.rows().end(); ++y) {
+			for (int x(range.cols().begin()); x < range.cols().end(); ++x) {
+				const cv::Point2i pixel = _sampling.pick(size, x, y);
+				_exemplar.getNeighborhood(pixel.x, pixel.y, _kernel, tile.ptr<float>(i++), true);
+			}
+		}
+
+		// Accumulate the moments of the tile.
+		cv::Mat sum, products;
+		cv::reduce(tile, sum, 0, cv::REDUCE_SUM, CV_64F);
+		cv::mulTransposed(tile, products, true, cv::noArray(), 1., CV_64F);
+
+		_sum += sum;
+		_products += products;
+		_count += tile.rows;
+	}
+
+	void join(const NeighborhoodMoments& other)
+	{
+		_sum += other._sum;
+		_products += other._products;
+		_count += other._count;
+	}
+};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///// Appearance Space implementation                                                         /////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-AppearanceSpace::AppearanceSpace(std::unique_ptr<const cv::PCA> projection, std::unique_ptr<const Sample> exemplar, const int kernelSize) :
+AppearanceSpace::AppearanceSpace(std::shared_ptr<const cv::PCA> projection, std::shared_ptr<const Sample> exemplar, const int kernelSize) :
 	_projection(std::move(projection)), _exemplar(std::move(exemplar)), _kernelSize(kernelSize)
 {
 	TEXTURIZE_ASSERT(_projection != nullptr);							// The PCA for dimensionality reduction must be initialized.
@@ -35,11 +101,13 @@ cv::Mat AppearanceSpace::getComponents(const Sample& exemplar, int ks)
 	// Extract all neighborhoods into individual texton descriptors.
 	tbb::parallel_for(tbb::blocked_range2d<size_t>(0, exemplar.height(), 0, exemplar.width()),
 		[&exemplar, &appearanceSpace, dimensionality, ks](const tbb::blocked_range2d<size_t>& range) {
+		// Allocate the neighborhood buffer once for the whole range.
+		std::vector<float> neighborhood(dimensionality);
+
 		for (int x = static_cast<int>(range.cols().begin()); x < range.cols().end(); ++x)
 		for (int y = static_cast<int>(range.rows().begin()); y < range.rows().end(); ++y) {
 			// Get the neighborhood texton.
-			std::vector<float> neighborhood(dimensionality);
-			exemplar.getNeighborhood(x, y, ks, neighborhood, true);
+			exemplar.getNeighborhood(x, y, ks, neighborhood.data(), true);
 
 			// Store each component into a separate channel.
 			for (size_t d(0); d < dimensionality; ++d)
@@ -59,75 +127,153 @@ cv::Mat AppearanceSpace::getComponents(const Sample& exemplar, int ks)
 	return components;
 }
 
-void AppearanceSpace::calculate(const Sample& exemplar, std::unique_ptr<AppearanceSpace>& descriptor, size_t rd, int ks)
+size_t AppearanceSpace::getMoments(const Sample& exemplar, int ks, cv::Mat& mean, cv::Mat& covariance, const NeighborhoodSampling& sampling)
 {
-	TEXTURIZE_ASSERT(ks % 2 == 1);										// The kernel size must be odd (extent in two opposite directions - i.e. right/left or top/down - plus 1 for the center row/column)
-	//TEXTURIZE_ASSERT(rd > 0 && rd <= exemplar.channels());			// The exemplar is required to be reduceable to a dimensionality larger than 0 and smaller than the original one.
-	TEXTURIZE_ASSERT(rd > 0);											// The exemplar is required to be reduceable to a dimensionality larger than 0.
+	// Accumulate the neighborhood moments tile by tile. Each tile contains the same number of selected pixels, independent of the sampling fraction.
+	const cv::Size cells = sampling.cells(exemplar.size());
+	const int grain = std::max(1, TileSize / sampling.cellSize());
 
-	// Get the exemplar components.
-	cv::Mat components = AppearanceSpace::getComponents(exemplar, ks);
-		
-	// Perform the principal component analysis to reduce dimensionality and extract the coefficients.
-	std::unique_ptr<cv::PCA> projector = std::make_unique<cv::PCA>(components, cv::Mat(), cv::PCA::DATA_AS_COL, static_cast<int>(rd));
-	cv::Mat projected = projector->project(components);
-	
-	// The projected component space now should have one row for each channel.
-	// In order to retain coordinate mappings between the original and the transformed exemplar, change it's shape.
-	//TEXTURIZE_ASSERT(projected.rows == exemplar.channels());
-	std::vector<cv::Mat> channels;
+	NeighborhoodMoments moments(exemplar, ks, sampling);
+	tbb::parallel_reduce(tbb::blocked_range2d<int>(0, cells.height, grain, 0, cells.width, grain), moments);
 
-	for (int c(0); c < projected.rows; ++c)
-		channels.push_back(projected.row(c));
+	TEXTURIZE_ASSERT(moments._count > 0.);								// The exemplar must contain at least one pixel.
 
-	cv::merge(channels, projected);
-	projected = projected.reshape(static_cast<int>(channels.size()), exemplar.height());
+	// Calculate mean and covariance from the moments: C = E[x * x^T] - E[x] * E[x]^T.
+	mean = moments._sum / moments._count;
+	covariance = moments._products / moments._count - mean.t() * mean;
 
-	// Setup and return a new descriptor.
-	TEXTURIZE_ASSERT(projected.channels() == channels.size());
-	TEXTURIZE_ASSERT(projected.rows == exemplar.height());
-	std::unique_ptr<Sample> transformedExemplar = std::make_unique<Sample>(projected);
-	descriptor = std::make_unique<AppearanceSpace>(std::move(projector), std::move(transformedExemplar), ks);
+	return static_cast<size_t>(moments._count);
 }
 
-void AppearanceSpace::calculate(const Sample& exemplar, std::unique_ptr<AppearanceSpace>& descriptor, float tv, int ks)
+std::unique_ptr<cv::PCA> AppearanceSpace::getProjection(const cv::Mat& mean, const cv::Mat& covariance, int components, double retainedVariance)
 {
-	TEXTURIZE_ASSERT(ks % 2 == 1);										// The kernel size must be odd (extent in two opposite directions - i.e. right/left or top/down - plus 1 for the center row/column)
-	TEXTURIZE_ASSERT(tv > 0 && tv <= 1);								// Variance must be a value between 0.0 and 1.0.
+	// The covariance matrix is symmetric, so its eigenvectors are the principal components. They are returned in descending order of their eigenvalues.
+	cv::Mat eigenvalues, eigenvectors;
+	cv::eigen(covariance, eigenvalues, eigenvectors);
+
+	// If no number of components has been provided, select them from the retained variance, the same way `cv::PCA` does.
+	if (components <= 0)
+	{
+		const double total = cv::sum(eigenvalues)[0];
+		double energy(0.);
 
-	// Get the exemplar components.
-	cv::Mat components = AppearanceSpace::getComponents(exemplar, ks);
+		for (components = 0; components < eigenvalues.rows; ++components)
+			if ((energy += eigenvalues.at<double>(components)) / total > retainedVariance)
+				break;
 
-	// Perform the principal component analysis to reduce dimensionality and extract the coefficients.
-	std::unique_ptr<cv::PCA> projector = std::make_unique<cv::PCA>(components, cv::Mat(), cv::PCA::DATA_AS_COL, static_cast<double>(tv));
-	cv::Mat projected = projector->project(components);
+		components = std::max(2, components);
+	}
 
-	// The projected component space now should have one row for each channel.
-	// In order to retain coordinate mappings between the original and the transformed exemplar, change it's shape.
-	//TEXTURIZE_ASSERT(projected.rows == exemplar.channels());
-	std::vector<cv::Mat> channels;
+	components = std::min(components, eigenvalues.rows);
 
-	for (int c(0); c < projected.rows; ++c)
-		channels.push_back(projected.row(c));
+	// Setup a projector, that equals one calculated from the neighborhoods with `cv::PCA::DATA_AS_COL`.
+	std::unique_ptr<cv::PCA> projection = std::make_unique<cv::PCA>();
+	mean.reshape(1, mean.cols).convertTo(projection->mean, CV_32F);
+	eigenvalues.rowRange(0, components).convertTo(projection->eigenvalues, CV_32F);
+	eigenvectors.rowRange(0, components).convertTo(projection->eigenvectors, CV_32F);
 
-	cv::merge(channels, projected);
-	projected = projected.reshape(static_cast<int>(channels.size()), exemplar.height());
+	return projection;
+}
 
-	// Setup and return a new descriptor.
-	TEXTURIZE_ASSERT(projected.channels() == channels.size());
-	TEXTURIZE_ASSERT(projected.rows == exemplar.height());
-	std::unique_ptr<Sample> transformedExemplar = std::make_unique<Sample>(projected);
-	descriptor = std::make_unique<AppearanceSpace>(std::move(projector), std::move(transformedExemplar), ks);
+void AppearanceSpace::project(const Sample& exemplar, int ks, const cv::PCA& projection, Sample& to, const Sample::Layout layout)
+{
+	const int dimensionality = ks * ks * static_cast<int>(exemplar.channels());
+	const int components = projection.eigenvectors.rows;
+
+	TEXTURIZE_ASSERT(projection.eigenvectors.cols == dimensionality);		// The projection must have been calculated for neighborhoods of the same dimensionality.
+
+	// Project the mean once, so that each neighborhood x can be projected by calculating E * x - E * mean.
+	cv::Mat bias = projection.eigenvectors * projection.mean;
+
+	to = Sample(components, exemplar.width(), exemplar.height(), layout);
+	to.detach();
+
+	tbb::parallel_for(tbb::blocked_range2d<int>(0, exemplar.height(), TileSize, 0, exemplar.width(), TileSize),
+		[&exemplar, &projection, &bias, &to, ks, dimensionality](const tbb::blocked_range2d<int>& range) {
+		// Gather the neighborhoods of the tile and project them at once.
+		cv::Mat tile(static_cast<int>(range.rows().size() * range.cols().size()), dimensionality, CV_32FC1), projected;
+
+		for (int y(range.rows().begin()), i(0); y < range.rows().end(); ++y)
+			for (int x(range.cols().begin()); x < range.cols().end(); ++x)
+				exemplar.getNeighborhood(x, y, ks, tile.ptr<float>(i++), true);
+
+		cv::gemm(tile, projection.eigenvectors, 1., cv::noArray(), 0., projected, cv::GEMM_2_T);
+
+		// Store the projected neighborhoods.
+		const float* offset = bias.ptr<float>();
+
+		for (int y(range.rows().begin()), i(0); y < range.rows().end(); ++y) {
+			for (int x(range.cols().begin()); x < range.cols().end(); ++x) {
+				float* texel = projected.ptr<float>(i++);
+
+				for (int c(0); c < projected.cols; ++c)
+					texel[c] -= offset[c];
+
+				to.setTexel(x, y, texel);
+			}
+		}
+	});
 }
 
-void AppearanceSpace::calculate(std::initializer_list<const Sample> exemplarMaps, std::unique_ptr<AppearanceSpace>& descriptor, size_t rd, int ks)
+void AppearanceSpace::calculate(const Sample& exemplar, std::unique_ptr<AppearanceSpace>& descriptor, size_t rd, int ks, const NeighborhoodSampling& sampling, ProjectionReport* report)
 {
-	AppearanceSpace::calculate(Sample::mergeSamples(exemplarMaps), descriptor, rd, ks);
+	TEXTURIZE_ASSERT(ks % 2 == 1);										// The kernel size must be odd (extent in two opposite directions - i.e. right/left or top/down - plus 1 for the center row/column)
+	//TEXTURIZE_ASSERT(rd > 0 && rd <= exemplar.channels());			// The exemplar is required to be reduceable to a dimensionality larger than 0 and smaller than the original one.
+	TEXTURIZE_ASSERT(rd > 0);											// The exemplar is required to be reduceable to a dimensionality larger than 0.
+
+	AppearanceSpace::fit(exemplar, descriptor, static_cast<int>(rd), 1., ks, sampling, report);
+}
+
+void AppearanceSpace::calculate(const Sample& exemplar, std::unique_ptr<AppearanceSpace>& descriptor, float tv, int ks, const NeighborhoodSampling& sampling, ProjectionReport* report)
+{
+	TEXTURIZE_ASSERT(ks % 2 == 1);										// The kernel size must be odd (extent in two opposite directions - i.e. right/left or top/down - plus 1 for the center row/column)
+	TEXTURIZE_ASSERT(tv > 0 && tv <= 1);								// Variance must be a value between 0.0 and 1.0.
+
+	AppearanceSpace::fit(exemplar, descriptor, 0, static_cast<double>(tv), ks, sampling, report);
 }
 
-void AppearanceSpace::calculate(std::initializer_list<const Sample> exemplarMaps, std::unique_ptr<AppearanceSpace>& descriptor, float tv, int ks)
+void AppearanceSpace::calculate(std::initializer_list<const Sample> exemplarMaps, std::unique_ptr<AppearanceSpace>& descriptor, size_t rd, int ks, const NeighborhoodSampling& sampling, ProjectionReport* report)
 {
-	AppearanceSpace::calculate(Sample::mergeSamples(exemplarMaps), descriptor, tv, ks);
+	AppearanceSpace::calculate(Sample::mergeSamples(exemplarMaps), descriptor, rd, ks, sampling, report);
+}
+
+void AppearanceSpace::calculate(std::initializer_list<const Sample> exemplarMaps, std::unique_ptr<AppearanceSpace>& descriptor, float tv, int ks, const NeighborhoodSampling& sampling, ProjectionReport* report)
+{
+	AppearanceSpace::calculate(Sample::mergeSamples(exemplarMaps), descriptor, tv, ks, sampling, report);
+}
+
+void AppearanceSpace::fit(const Sample& exemplar, std::unique_ptr<AppearanceSpace>& descriptor, int rd, double tv, int ks, const NeighborhoodSampling& sampling, ProjectionReport* report)
+{
+	// Perform the principal component analysis on the neighborhood covariance, without storing the neighborhoods of all pixels.
+	cv::Mat mean, covariance;
+	const size_t samples = AppearanceSpace::getMoments(exemplar, ks, mean, covariance, sampling);
+	std::unique_ptr<cv::PCA> projector = AppearanceSpace::getProjection(mean, covariance, rd, tv);
+
+	// Report the variance retained by the projection and, if requested, compare it against an exact fit to all neighborhoods.
+	if (report != nullptr)
+	{
+		report->samples = samples;
+		report->components = projector->eigenvectors.rows;
+		report->explainedVariance = ProjectionReport::getExplainedVariance(projector->eigenvectors, covariance);
+		report->validatedVariance = report->exactVariance = -1.;
+
+		if (sampling.validate)
+		{
+			cv::Mat exactMean, exactCovariance;
+			AppearanceSpace::getMoments(exemplar, ks, exactMean, exactCovariance);
+
+			report->validatedVariance = ProjectionReport::getExplainedVariance(projector->eigenvectors, exactCovariance);
+			report->exactVariance = ProjectionReport::getExactVariance(exactCovariance, report->components);
+		}
+	}
+
+	// Project the neighborhoods tile by tile into the transformed exemplar.
+	std::unique_ptr<Sample> transformedExemplar = std::make_unique<Sample>();
+	AppearanceSpace::project(exemplar, ks, *projector, *transformedExemplar, Sample::Layout::Interleaved);
+
+	// Setup and return a new descriptor.
+	TEXTURIZE_ASSERT(transformedExemplar->height() == exemplar.height());
+	descriptor = std::make_unique<AppearanceSpace>(std::move(projector), std::move(transformedExemplar), ks);
 }
 
 void AppearanceSpace::getProjector(std::shared_ptr<const cv::PCA>& projection) const
@@ -187,20 +333,7 @@ void AppearanceSpace::transform(const Sample& sample, const cv::Point& texelCoor
 
 void AppearanceSpace::transform(const Sample& sample, Sample& to, const int ks) const
 {
-	cv::Mat components = AppearanceSpace::getComponents(sample, ks);
-	cv::Mat projected = _projection->project(components);
-	std::vector<cv::Mat> channels;
-
-	for (int c(0); c < projected.rows; ++c)
-		channels.push_back(projected.row(c));
-
-	cv::merge(channels, projected);
-	projected = projected.reshape(static_cast<int>(channels.size()), sample.height());
-
-	TEXTURIZE_ASSERT(projected.channels() == channels.size());
-	TEXTURIZE_ASSERT(projected.rows == sample.height());
-
-	to = (Sample)projected;
+	AppearanceSpace::project(sample, ks, *_projection, to, Sample::Layout::Planar);
 }
 
 void AppearanceSpace::sample(Sample& sample) const
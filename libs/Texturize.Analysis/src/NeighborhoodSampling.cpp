@@ -0,0 +1,88 @@
+#include "stdafx.h"
+
+#include <analysis.hpp>
+
+#include "CounterRandom.h"
+
+using namespace Texturize;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Neighborhood sampling implementation                                                    /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int NeighborhoodSampling::cellSize() const
+{
+	TEXTURIZE_ASSERT(fraction > 0.f && fraction <= 1.f);					// The sampling fraction must be within (0, 1].
+
+	// Each cell contributes one pixel, so a cell must contain 1 / fraction pixels.
+	return std::max(1, static_cast<int>(std::round(1.f / std::sqrt(fraction))));
+}
+
+cv::Size NeighborhoodSampling::cells(const cv::Size& size) const
+{
+	const int cell = this->cellSize();
+	return cv::Size((size.width + cell - 1) / cell, (size.height + cell - 1) / cell);
+}
+
+cv::Point2i NeighborhoodSampling::pick(const cv::Size& size, const int x, const int y) const
+{
+	const int cell = this->cellSize();
+
+	if (cell == 1)
+		return cv::Point2i(x, y);
+
+	// Draw the offsets from the stream of the cell, so that the selection does not depend on the order in which cells are visited.
+	const cv::Size grid = this->cells(size);
+	const std::uint64_t stream = static_cast<std::uint64_t>(y) * grid.width + x;
+
+	// Clamp the pixel to the exemplar, since cells at the border may be partially outside of it.
+	const int px = std::min(x * cell + CounterRandom::uniform(seed, stream, 0, cell), size.width - 1);
+	const int py = std::min(y * cell + CounterRandom::uniform(seed, stream, 1, cell), size.height - 1);
+
+	return cv::Point2i(px, py);
+}
+
+std::vector<cv::Point2i> NeighborhoodSampling::select(const cv::Size& size) const
+{
+	const cv::Size grid = this->cells(size);
+	std::vector<cv::Point2i> pixels;
+	pixels.reserve(static_cast<size_t>(grid.area()));
+
+	for (int y(0); y < grid.height; ++y)
+		for (int x(0); x < grid.width; ++x)
+			pixels.push_back(this->pick(size, x, y));
+
+	return pixels;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Projection report implementation                                                        /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+double ProjectionReport::getExplainedVariance(const cv::Mat& basis, const cv::Mat& covariance)
+{
+	TEXTURIZE_ASSERT(covariance.rows == covariance.cols);					// The covariance matrix must be square.
+	TEXTURIZE_ASSERT(basis.cols == covariance.cols);						// The basis vectors must have the dimensionality of the covariance matrix.
+
+	// The variance along a unit basis vector e equals e^T * C * e, so the retained variance is the trace of B * C * B^T.
+	cv::Mat b, c;
+	basis.convertTo(b, CV_64F);
+	covariance.convertTo(c, CV_64F);
+
+	const double total = cv::trace(c)[0];
+	return total > 0. ? cv::trace(b * c * b.t())[0] / total : 1.;
+}
+
+double ProjectionReport::getExactVariance(const cv::Mat& covariance, const int components)
+{
+	TEXTURIZE_ASSERT(covariance.rows == covariance.cols);					// The covariance matrix must be square.
+
+	cv::Mat c, eigenvalues;
+	covariance.convertTo(c, CV_64F);
+	cv::eigen(c, eigenvalues);
+
+	const double total = cv::sum(eigenvalues)[0];
+	const double retained = cv::sum(eigenvalues.rowRange(0, std::min(components, eigenvalues.rows)))[0];
+
+	return total > 0. ? retained / total : 1.;
+}
@@ -3,15 +3,20 @@
 #include <analysis.hpp>
 
 #include <tbb\blocked_range2d.h>
+#include <tbb\parallel_for.h>
 #include <tbb\parallel_for_each.h>
 
+#include <atomic>
+#include <mutex>
+#include <cstring>
+
 using namespace Texturize;
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///// Sample implementation                                                                   /////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-Sample::Sample(const cv::Mat& raw) :
+Sample::Sample(const cv::Mat& raw, const Layout layout) :
 	_channels(raw.channels())
 {
 	auto cn = raw.channels();
@@ -25,9 +30,13 @@ Sample::Sample(const cv::Mat& raw) :
 			channels[c].convertTo(_channels[c], CV_32F, 1.f / static_cast<float>(std::numeric_limits<TX_BYTE>::max()));
 		else if (channels[c].depth() == CV_16U || channels[c].depth() == CV_16S)
 			channels[c].convertTo(_channels[c], CV_32F, 1.f / static_cast<float>(std::numeric_limits<TX_WORD>::max()));
+		else if (channels[c].depth() == CV_32F)
+			_channels[c] = channels[c];									// The channels have already been copied by `cv::split`, so they can be used directly.
 		else
 			channels[c].convertTo(_channels[c], CV_32F);
 	}
+
+	this->setLayout(layout);
 }
 
 Sample::Sample(const size_t channels) : 
@@ -39,27 +48,90 @@ Sample::Sample(const size_t channels) :
 		_channels[c] = cv::Mat(cv::Size(), CV_32FC1);
 }
 
-Sample::Sample(const size_t channels, const cv::Size& size) :
-	_channels(channels)
+Sample::Sample(const size_t channels, const cv::Size& size, const Layout layout) :
+	Sample(channels, size.width, size.height, layout)
+{
+}
+
+Sample::Sample(const size_t channels, const int width, const int height, const Layout layout) :
+	_layout(layout)
 {
 	TEXTURIZE_ASSERT(channels > 0);										// There must be at least one channel in the sample.
 
-	for (int c(0); c < channels; c++)
-		_channels[c] = cv::Mat(size, CV_32FC1);
+	if (layout == Layout::Interleaved)
+	{
+		// Allocate all texels at once. The padding gets initialized, so that kernels can safely read whole blocks of `TexelAlignment` values.
+		_channels.clear();
+		_texelChannels = static_cast<int>(channels);
+		_texelStride = Sample::paddedStride(_texelChannels);
+		_texels = cv::Mat::zeros(height, width * _texelStride, CV_32FC1);
+	}
+	else
+	{
+		_channels.resize(channels);
+
+		for (int c(0); c < channels; c++)
+			_channels[c] = cv::Mat(height, width, CV_32FC1);
+	}
 }
 
-Sample::Sample(const size_t channels, const int width, const int height) :
-	_channels(channels)
+Sample Sample::wrapTexels(const cv::Mat& texels, const size_t channels)
 {
+	const int stride = Sample::paddedStride(static_cast<int>(channels));
+
 	TEXTURIZE_ASSERT(channels > 0);										// There must be at least one channel in the sample.
+	TEXTURIZE_ASSERT(texels.type() == CV_32FC1);						// The texels must be stored as single-precision floating point values.
+	TEXTURIZE_ASSERT(texels.cols % stride == 0);						// Each row must contain whole texels.
 
-	for (int c(0); c < channels; c++)
-		_channels[c] = cv::Mat(height, width, CV_32FC1);
+	Sample sample;
+	sample._channels.clear();
+	sample._layout = Layout::Interleaved;
+	sample._texels = texels;
+	sample._texelChannels = static_cast<int>(channels);
+	sample._texelStride = stride;
+
+	return sample;
+}
+
+int Sample::paddedStride(const int channels)
+{
+	return (channels + TexelAlignment - 1) / TexelAlignment * TexelAlignment;
+}
+
+bool Sample::isShared(const cv::Mat& data)
+{
+	// Matrices that do not own their data (i.e. that wrap a user-provided buffer) have no reference counter and are treated as shared.
+	return !data.empty() && (data.u == nullptr || data.u->refcount > 1);
+}
+
+void Sample::detach(const int index)
+{
+	if (_layout == Layout::Interleaved)
+	{
+		if (Sample::isShared(_texels))
+			_texels = _texels.clone();
+	}
+	else if (Sample::isShared(_channels[index]))
+	{
+		_channels[index] = _channels[index].clone();
+	}
+}
+
+void Sample::detach()
+{
+	if (_layout == Layout::Interleaved)
+		this->detach(0);
+	else
+		for (int c(0); c < static_cast<int>(_channels.size()); ++c)
+			this->detach(c);
 }
 
 void Sample::wrapCoords(int& x, int& y) const
 {
-	Sample::wrapCoords(_channels[0].cols, _channels[0].rows, x, y);
+	if (_layout == Layout::Interleaved)
+		Sample::wrapCoords(_texels.cols / _texelStride, _texels.rows, x, y);
+	else
+		Sample::wrapCoords(_channels[0].cols, _channels[0].rows, x, y);
 }
 
 void Sample::wrapCoords(int width, int height, int& x, int& y)
@@ -90,7 +162,7 @@ void Sample::wrapCoords(cv::Vec2f& coords)
 
 size_t Sample::channels() const
 {
-	return _channels.size();
+	return _layout == Layout::Interleaved ? static_cast<size_t>(_texelChannels) : _channels.size();
 }
 
 cv::Size Sample::size() const
@@ -114,47 +186,163 @@ int Sample::height() const
 	return y;
 }
 
+Sample::Layout Sample::getLayout() const
+{
+	return _layout;
+}
+
+void Sample::setLayout(const Layout layout)
+{
+	if (layout == _layout)
+		return;
+
+	cv::Size size = this->size();
+	const int cn = static_cast<int>(this->channels());
+
+	if (layout == Layout::Interleaved)
+	{
+		// Copy each channel into the texels. Since the interleaved storage is a new allocation, samples that share the planar channels are not affected.
+		const int stride = Sample::paddedStride(cn);
+		cv::Mat texels = cv::Mat::zeros(size.height, size.width * stride, CV_32FC1);
+
+		tbb::parallel_for(0, size.height, [this, &texels, &size, cn, stride](int y) {
+			float* row = texels.ptr<float>(y);
+
+			for (int c(0); c < cn; ++c)
+			{
+				const float* channel = _channels[c].ptr<float>(y);
+
+				for (int x(0); x < size.width; ++x)
+					row[x * stride + c] = channel[x];
+			}
+		});
+
+		_channels.clear();
+		_texels = texels;
+		_texelChannels = cn;
+		_texelStride = stride;
+	}
+	else
+	{
+		std::vector<cv::Mat> channels(cn);
+
+		for (int c(0); c < cn; ++c)
+			this->copyChannel(c, channels[c]);
+
+		_channels = channels;
+		_texels.release();
+		_texelChannels = _texelStride = 0;
+	}
+
+	_layout = layout;
+}
+
+const cv::Mat& Sample::getTexels() const
+{
+	TEXTURIZE_ASSERT(_layout == Layout::Interleaved);					// Only interleaved samples store their texels in a single matrix.
+	return _texels;
+}
+
+int Sample::getTexelStride() const
+{
+	TEXTURIZE_ASSERT(_layout == Layout::Interleaved);					// Only interleaved samples store their texels in a single matrix.
+	return _texelStride;
+}
+
 void Sample::setChannel(const int index, const cv::Mat& channel)
 {
-	TEXTURIZE_ASSERT(index >= 0 && index < _channels.size());			// The channel index must address an existing channel.
-	_channels[index] = channel.clone();
+	TEXTURIZE_ASSERT(index >= 0 && index < this->channels());			// The channel index must address an existing channel.
+
+	if (_layout == Layout::Interleaved)
+	{
+		TEXTURIZE_ASSERT(channel.type() == CV_32FC1);					// Interleaved samples only store single-precision floating point values.
+
+		// Samples that have been created without a size, take the size of the first channel, that gets written.
+		if (_texels.empty())
+			_texels = cv::Mat::zeros(channel.rows, channel.cols * _texelStride, CV_32FC1);
+
+		TEXTURIZE_ASSERT(channel.size() == this->size());				// The channel must have the same size as the sample.
+		this->detach(index);
+
+		tbb::parallel_for(0, channel.rows, [this, &channel, index](int y) {
+			const float* source = channel.ptr<float>(y);
+			float* row = _texels.ptr<float>(y) + index;
+
+			for (int x(0); x < channel.cols; ++x)
+				row[x * _texelStride] = source[x];
+		});
+	}
+	else
+	{
+		// Share the channel data, unless it is owned by someone else (e.g. an external buffer), that may release it. The data is copied, before the sample
+		// modifies it.
+		_channels[index] = channel.u != nullptr ? channel : channel.clone();
+	}
 }
 
 void Sample::setTexel(const cv::Point2i& at, const std::vector<float>& texel)
 {
-	TEXTURIZE_ASSERT(texel.size() == this->channels());					// A texel must provide a value for each channel.
-
-	for (size_t cn(0); cn < _channels.size(); ++cn)
-		_channels[cn].at<float>(at) = texel[cn];
+	this->setTexel(at.x, at.y, texel);
 }
 
 void Sample::setTexel(const int x, const int y, const std::vector<float>& texel)
 {
 	TEXTURIZE_ASSERT(texel.size() == this->channels());					// A texel must provide a value for each channel.
 
-	for (size_t cn(0); cn < _channels.size(); ++cn)
-		_channels[cn].at<float>(cv::Point2i(x, y)) = texel[cn];
+	this->detach();
+	this->setTexel(x, y, texel.data());
+}
+
+void Sample::setTexel(const int x, const int y, const float* texel)
+{
+	// The storage is not detached here, since the method is called for each texel within parallel loops. Callers detach the sample once beforehand.
+	if (_layout == Layout::Interleaved)
+		std::memcpy(_texels.ptr<float>(y) + x * _texelStride, texel, _texelChannels * sizeof(float));
+	else
+		for (size_t cn(0); cn < _channels.size(); ++cn)
+			_channels[cn].at<float>(y, x) = texel[cn];
 }
 
 void Sample::copyChannel(const int index, cv::Mat& channel) const
 {
-	channel = this->getChannel(index).clone();
+	// Interleaved channels are gathered into a new matrix anyway, so they do not need to be cloned again.
+	channel = _layout == Layout::Planar ? this->getChannel(index).clone() : this->getChannel(index);
 }
 
 cv::Mat Sample::getChannel(const int index) const
 {
-	TEXTURIZE_ASSERT(index >= 0 && index < _channels.size());			// The channel index must address an existing channel.
-	return _channels[index].clone();
+	TEXTURIZE_ASSERT(index >= 0 && index < this->channels());			// The channel index must address an existing channel.
+
+	// Planar channels are shared with the caller. They get copied, before the sample modifies them.
+	if (_layout == Layout::Planar)
+		return _channels[index];
+
+	// Gather the channel from the interleaved texels.
+	cv::Mat channel(this->size(), CV_32FC1);
+
+	tbb::parallel_for(0, channel.rows, [this, &channel, index](int y) {
+		const float* row = _texels.ptr<float>(y) + index;
+		float* target = channel.ptr<float>(y);
+
+		for (int x(0); x < channel.cols; ++x)
+			target[x] = row[x * _texelStride];
+	});
+
+	return channel;
 }
 
 void Sample::getSize(cv::Size& size) const
 {
-	size = _channels[0].size();
+	if (_layout == Layout::Interleaved)
+		size = cv::Size(_texelStride > 0 ? _texels.cols / _texelStride : 0, _texels.rows);
+	else
+		size = _channels[0].size();
 }
 
 void Sample::getSize(int& width, int& height) const
 {
-	cv::Size s = _channels[0].size();
+	cv::Size s;
+	this->getSize(s);
 	width = s.width;
 	height = s.height;
 }
@@ -164,12 +352,9 @@ void Sample::at(int& x, int& y, Texel& texel) const
 	// Get the wrapped coords.
 	this->wrapCoords(x, y);
 
-	// Setup the texel.
-	texel = Texel(_channels.size());
-
-	// NOTE: OpenCV accesses pixels in row-major order.
-	for (int i(0); i < _channels.size(); ++i)
-		texel[i] = _channels[i].at<float>(y, x);
+	// Setup the texel. Resizing does not re-allocate, if the texel already has the right size.
+	texel.resize(this->channels());
+	this->at(x, y, texel.data());
 }
 
 void Sample::at(cv::Point& p, Texel& texel) const
@@ -195,6 +380,37 @@ void Sample::at(const cv::Vec2f& uv, Texel& texel) const
 	this->at(uv[0], uv[1], texel);
 }
 
+void Sample::at(const int x, const int y, float* const texel) const
+{
+	// Get the wrapped coords.
+	int _x(x), _y(y);
+	this->wrapCoords(_x, _y);
+
+	// Interleaved texels can be copied at once.
+	if (_layout == Layout::Interleaved)
+	{
+		std::memcpy(texel, this->ptr(_x, _y), _texelChannels * sizeof(float));
+		return;
+	}
+
+	// NOTE: OpenCV accesses pixels in row-major order.
+	for (size_t i(0); i < _channels.size(); ++i)
+		texel[i] = _channels[i].at<float>(_y, _x);
+}
+
+void Sample::at(const cv::Point2i& p, float* const texel) const
+{
+	this->at(p.x, p.y, texel);
+}
+
+void Sample::at(const cv::Vec2f& uv, float* const texel) const
+{
+	int x = static_cast<int>(this->width() * uv[0]);
+	int y = static_cast<int>(this->height() * uv[1]);
+
+	this->at(x, y, texel);
+}
+
 void Sample::extract(const int* fromTo, const size_t pairs, Sample& sample) const
 {
 	TEXTURIZE_ASSERT(fromTo != nullptr);								// The mapping array must be initialized.
@@ -207,15 +423,15 @@ void Sample::extract(const int* fromTo, const size_t pairs, Sample& sample) cons
 void Sample::extract(const std::vector<int>& fromTo, Sample& sample) const
 {
 	TEXTURIZE_ASSERT(fromTo.size() > 0 && fromTo.size() % 2 == 0);		// The vector contains pairs and there must be at least one pair and no value without counter-part.
-	TEXTURIZE_ASSERT(sample.size() == this->size());					// The target sample should have the same size as the current sample.
+	TEXTURIZE_ASSERT(sample.size() == this->size() || sample.size().empty());	// The target sample should have the same size as the current sample or no size at all.
 
 	for (int i(0); i < fromTo.size(); i += 2)
 	{
 		int from = fromTo[i], to = fromTo[i + 1];
-		TEXTURIZE_ASSERT(from >= 0 && from < _channels.size());			// The source index must address a valid channel within the current sample.
+		TEXTURIZE_ASSERT(from >= 0 && from < this->channels());			// The source index must address a valid channel within the current sample.
 		TEXTURIZE_ASSERT(to >= 0 && to < sample.channels());			// The target index must address a valid channel within the target sample.
 
-		sample.setChannel(to, _channels[from]);
+		sample.setChannel(to, this->getChannel(from));
 	}
 }
 
@@ -242,9 +458,9 @@ void Sample::map(const std::vector<int>& fromTo, const Sample& sample)
 	{
 		int from = fromTo[i], to = fromTo[i + 1];
 		TEXTURIZE_ASSERT(from >= 0 && from < sample.channels());		// The source index must address a valid channel within the target sample.
-		TEXTURIZE_ASSERT(to >= 0 && to < _channels.size());				// The target index must address a valid channel within the current sample.
+		TEXTURIZE_ASSERT(to >= 0 && to < this->channels());				// The target index must address a valid channel within the current sample.
 
-		sample.copyChannel(from, _channels[to]);
+		this->setChannel(to, sample.getChannel(from));
 	}
 }
 
@@ -258,13 +474,13 @@ void Sample::merge(const Sample& with, Sample& to) const
 {
 	TEXTURIZE_ASSERT(with.size() == this->size());
 
-	// Create a new sample that can contain all channels.
-	Sample result = Sample(with.channels() + _channels.size(), with.width(), with.height());
+	// Create a new sample that can contain all channels. The channels are shared with the merged samples, so no storage needs to be allocated.
+	Sample result = Sample(with.channels() + this->channels());
 
 	// Copy the channels of the current sample first.
-	std::vector<int> channelMap(_channels.size() * 2);
+	std::vector<int> channelMap(this->channels() * 2);
 
-	for (int c(0); c < _channels.size(); ++c)
+	for (int c(0); c < this->channels(); ++c)
 		channelMap[c * 2] = channelMap[c * 2 + 1] = c;
 
 	// Map the channels to the result.
@@ -276,7 +492,7 @@ void Sample::merge(const Sample& with, Sample& to) const
 	for (int c(0); c < with.channels(); ++c)
 	{
 		channelMap[c * 2] = c;
-		channelMap[c * 2 + 1] = static_cast<int>(_channels.size()) + c;
+		channelMap[c * 2 + 1] = static_cast<int>(this->channels()) + c;
 	}
 
 	with.extract(channelMap, result);
@@ -286,11 +502,18 @@ void Sample::merge(const Sample& with, Sample& to) const
 }
 
 void Sample::getNeighborhood(const int x, const int y, const int k, Texel& neighborhood, const bool weight) const
+{
+	// Resizing does not re-allocate, if the neighborhood already has the right size.
+	neighborhood.resize(k * k * this->channels());
+	this->getNeighborhood(x, y, k, neighborhood.data(), weight);
+}
+
+void Sample::getNeighborhood(const int x, const int y, const int k, float* const neighborhood, const bool weight) const
 {
 	TEXTURIZE_ASSERT(k % 2 == 1);									// Only allow odd kernel sizes (even steps into each direction, plus the current pixel row/col)
-	int extent = (k - 1) / 2, w(0), wx(0), wy(0);
-	neighborhood = Texel(k * k * _channels.size());
-	cv::Mat kernel = weight ? cv::getGaussianKernel(k, 0, CV_32F) : cv::Mat::ones(k, k, CV_32F);
+	int extent = (k - 1) / 2, w(0), i(0), wx(0), wy(0);
+	const int cn = static_cast<int>(this->channels());
+	const float* weights = weight ? Sample::getNeighborhoodWeights(k).data() : nullptr;
 
 	for (int _x(-extent); _x <= extent; ++_x)
 	{
@@ -300,17 +523,69 @@ void Sample::getNeighborhood(const int x, const int y, const int k, Texel& neigh
 			wx = x + _x; wy = y + _y;
 			this->wrapCoords(wx, wy);
 
-			// Calculate the weight of the pixel values.
-			float g = weight ? kernel.at<float>(_x + extent) * kernel.at<float>(_y + extent) : 1.f;
+			// Get the weight of the pixel values.
+			float g = weight ? weights[i++] : 1.f;
 
 			// Extract the value from each channel individually.
 			// NOTE: OpenCV accesses pixels in row-major order.
-			for (int c(0); c < _channels.size(); ++c)
-				neighborhood[w++] = g * _channels[c].at<float>(wy, wx);
+			if (_layout == Layout::Interleaved)
+			{
+				const float* texel = this->ptr(wx, wy);
+
+				for (int c(0); c < cn; ++c)
+					neighborhood[w++] = g * texel[c];
+			}
+			else
+			{
+				for (int c(0); c < cn; ++c)
+					neighborhood[w++] = g * _channels[c].at<float>(wy, wx);
+			}
 		}
 	}
 }
 
+const std::vector<float>& Sample::getNeighborhoodWeights(const int k)
+{
+	TEXTURIZE_ASSERT(k % 2 == 1);									// Only allow odd kernel sizes (even steps into each direction, plus the current pixel row/col)
+
+	// Tables of common kernel sizes are published to lock-free slots, after they have been calculated. Parallel callers only read the slot, so they do not contend 
+	// on the lock below.
+	static std::atomic<const std::vector<float>*> published[32];
+	const size_t slot = static_cast<size_t>(k - 1) / 2;
+
+	if (slot < std::size(published)) {
+		const std::vector<float>* table = published[slot].load(std::memory_order_acquire);
+
+		if (table != nullptr)
+			return *table;
+	}
+
+	// The weights are cached per kernel size. Since the map stores pointers, references remain valid when new kernel sizes are inserted.
+	static std::map<int, std::unique_ptr<const std::vector<float>>> cache;
+	static std::mutex cacheLock;
+
+	std::lock_guard<std::mutex> lock(cacheLock);
+	auto& weights = cache[k];
+
+	if (weights == nullptr)
+	{
+		// Calculate the weights from the outer product of a one-dimensional gaussian kernel, in the order the neighborhood is traversed.
+		cv::Mat kernel = cv::getGaussianKernel(k, 0, CV_32F);
+		std::unique_ptr<std::vector<float>> table = std::make_unique<std::vector<float>>(k * k);
+
+		for (int x(0), i(0); x < k; ++x)
+			for (int y(0); y < k; ++y)
+				(*table)[i++] = kernel.at<float>(x) * kernel.at<float>(y);
+
+		weights = std::move(table);
+	}
+
+	if (slot < std::size(published))
+		published[slot].store(weights.get(), std::memory_order_release);
+
+	return *weights;
+}
+
 void Sample::getNeighborhood(const cv::Point& p, const int k, Texel& v, const bool weight) const
 {
 	return this->getNeighborhood(p.x, p.y, k, v, weight);
@@ -318,7 +593,11 @@ void Sample::getNeighborhood(const cv::Point& p, const int k, Texel& v, const bo
 
 void Sample::clone(Sample& s) const
 {
-	s = Sample(_channels.size(), this->size());
+	s._layout = _layout;
+	s._channels.resize(_channels.size());
+	s._texels = _texels.clone();
+	s._texelChannels = _texelChannels;
+	s._texelStride = _texelStride;
 
 	for (size_t cn(0); cn < _channels.size(); ++cn)
 		s._channels[cn] = _channels[cn].clone();
@@ -326,10 +605,8 @@ void Sample::clone(Sample& s) const
 
 void Sample::clone(Sample** const s) const
 {
-	std::unique_ptr<Sample> copy = std::make_unique<Sample>(_channels.size(), this->size());
-
-	for (size_t cn(0); cn < _channels.size(); ++cn)
-		copy->_channels[cn] = _channels[cn].clone();
+	std::unique_ptr<Sample> copy = std::make_unique<Sample>();
+	this->clone(*copy);
 
 	*s = copy.release();
 }
@@ -343,8 +620,29 @@ Sample Sample::clone() const
 
 inline Sample::operator cv::Mat() const
 {
-	cv::Mat result(this->size(), CV_32FC(static_cast<int>(this->channels())));
-	cv::merge(_channels, result);
+	const int cn = static_cast<int>(this->channels());
+	cv::Mat result(this->size(), CV_32FC(cn));
+
+	if (_layout == Layout::Planar)
+	{
+		cv::merge(_channels, result);
+	}
+	else if (_texelStride == cn)
+	{
+		// Without padding, the texels already have the layout of the result.
+		_texels.reshape(cn).copyTo(result);
+	}
+	else
+	{
+		// Strip the padding from each texel.
+		tbb::parallel_for(0, result.rows, [this, &result, cn](int y) {
+			const float* row = _texels.ptr<float>(y);
+			float* target = result.ptr<float>(y);
+
+			for (int x(0); x < result.cols; ++x)
+				std::memcpy(target + x * cn, row + x * _texelStride, cn * sizeof(float));
+		});
+	}
 
 	//std::vector<int> channelMap(this->channels() * 2);
 
@@ -358,8 +656,14 @@ inline Sample::operator cv::Mat() const
 
 void Sample::weight(const float weight)
 {
-	for each(auto& channel in _channels)
-		channel *= weight;
+	this->detach();
+
+	// NOTE: The padding of interleaved texels is zero, so it is not affected.
+	if (_layout == Layout::Interleaved)
+		_texels *= weight;
+	else
+		for each(auto& channel in _channels)
+			channel *= weight;
 }
 
 void Sample::sample(const Sample& sample, const cv::Mat& uv, Sample& to)
@@ -386,19 +690,37 @@ void Sample::sample(const Sample& sample, const cv::Mat& uv, std::initializer_li
 	else
 		channelMap = std::vector<int>(fromTo);
 			
-	to = Sample(channelMap.size() / 2, uv.cols, uv.rows);
+	to = Sample(channelMap.size() / 2, uv.cols, uv.rows, sample.getLayout());
+
+	// Each pair must address an existing channel of both samples.
+	for (size_t i(0); i < channelMap.size(); i += 2)
+		TEXTURIZE_ASSERT(channelMap[i] >= 0 && channelMap[i] < static_cast<int>(sample.channels()) && channelMap[i + 1] >= 0 && channelMap[i + 1] < static_cast<int>(to.channels()));
+
+	// Without a mapping, each texel is copied as a whole. Otherwise the channels of each texel are copied pair by pair.
+	const bool copyTexels = fromTo.size() == 0;
+	to.detach();
 
 	// Sample each pixel of the uv map.
 	tbb::parallel_for(tbb::blocked_range2d<size_t>(0, uv.rows, 0, uv.cols),
-		[&sample, &uv, &channelMap, &to](const tbb::blocked_range2d<size_t>& range) {
+		[&sample, &uv, &channelMap, &to, copyTexels](const tbb::blocked_range2d<size_t>& range) {
+		// Allocate the texel buffers once for the whole range.
+		Texel texel(sample.channels()), mapped(copyTexels ? 0 : to.channels(), 0.f);
+
 		for (size_t x = range.cols().begin(); x < range.cols().end(); ++x) {
 			for (size_t y = range.rows().begin(); y < range.rows().end(); ++y) {
 				// Get the coordinates and the texel.
-				cv::Point2i pos = cv::Point2i(static_cast<int>(x), static_cast<int>(y));
-				cv::Vec2f coords = uv.at<cv::Vec2f>(pos);
-				std::vector<float> texel;
-				sample.at(coords, texel);
-				to.setTexel(pos, texel);
+				const int px = static_cast<int>(x), py = static_cast<int>(y);
+				sample.at(uv.at<cv::Vec2f>(py, px), texel.data());
+
+				if (copyTexels) {
+					to.setTexel(px, py, texel.data());
+					continue;
+				}
+
+				for (size_t i(0); i < channelMap.size(); i += 2)
+					mapped[channelMap[i + 1]] = texel[channelMap[i]];
+
+				to.setTexel(px, py, mapped.data());
 			}
 		}
 	});
@@ -436,8 +758,8 @@ Sample Sample::mergeSamples(std::initializer_list<const Sample>& samples)
 		cn += static_cast<int>(ex.channels());
 	}
 
-	// Create a new exemplar by merging the provided channels.
-	Sample target(cn, width, height);
+	// Create a new exemplar by merging the provided channels. The channels are shared with the provided samples, so no storage needs to be allocated.
+	Sample target(cn);
 
 	for (auto ex : samples)
 	{
@@ -77,7 +77,7 @@ void AppearanceSpaceAsset::restore(std::shared_ptr<const IFileStorage> storage,
 	TEXTURIZE_ASSERT(size == ex.size());
 
 	// Initialize a new descriptor instance.
-	std::unique_ptr<Sample> exemplar = std::make_unique<Sample>(ex);
+	std::unique_ptr<Sample> exemplar = std::make_unique<Sample>(ex, Sample::Layout::Interleaved);
 	asset = std::make_unique<AppearanceSpace>(std::move(projector), std::move(exemplar), kernel);
 }
 
@@ -40,10 +40,10 @@ void DefaultCodec::save(const std::string& fileName, const Sample& sample, const
 	}
 	else if (sample.channels() == 2)
 	{
-		cv::Mat r = sample.getChannel(0);
-		cv::Mat g = sample.getChannel(1);
-		r.convertTo(r, depth, alpha);
-		g.convertTo(g, depth, alpha);
+		// NOTE: The channels are shared with the sample, so they must not be converted in-place.
+		cv::Mat r, g;
+		sample.getChannel(0).convertTo(r, depth, alpha);
+		sample.getChannel(1).convertTo(g, depth, alpha);
 		std::vector<cv::Mat> cn{ cv::Mat::zeros(sample.size(), CV_MAKETYPE(depth, 1)), g, r };
 		cv::merge(cn, s);
 	}
@@ -90,6 +90,13 @@ namespace Texturize {
 			_callbacks.erase(callback);
 		}
 
+		/// \brief Returns `true`, if no callback has been added to the event dispatcher.
+		/// \returns `true`, if no callback has been added to the event dispatcher, otherwise `false`.
+		bool empty() const
+		{
+			return _callbacks.empty();
+		}
+
 		/// \brief Sends the arguments to all callbacks.
 		/// \param args The arguments to send to all callbacks.
 		///
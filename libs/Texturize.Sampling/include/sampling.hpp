@@ -4,7 +4,14 @@
 #include <analysis.hpp>
 
 #include <vector>
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+#include <iostream>
 #include <random>
+#include <limits>
+#include <mutex>
+#include <atomic>
 #include <optional>
 
 #include <opencv2\core.hpp>
@@ -25,6 +32,13 @@ namespace Texturize {
 	///
 	class TEXTURIZE_API IDescriptorExtractor {
 	public:
+		/// \brief Fits the extractor to a search space exemplar.
+		/// \param exemplar A sample, containing the search space descriptors of the exemplar.
+		///
+		/// Search indices call this method from their initialization, before they calculate the exemplar descriptors. Extractors that project the neighborhoods into a
+		/// basis learned from the exemplar must fit it here, so that the descriptor methods do not modify the extractor and can be called from multiple threads.
+		virtual void fit(const Sample& exemplar) = 0;
+
 		/// \brief Calculates the runtime neighborhood descriptors of a search space exemplar.
 		/// \param exemplar A sample, containing the search space descriptors of the exemplar.
 		/// \returns A matrix, containing the runtime neighborhood descriptors of the provided sample.
@@ -35,6 +49,29 @@ namespace Texturize {
 		/// \param uv The uv map used to resolve the pixel coordinates inside the exemplar sample.
 		/// \returns A matrix, containing the runtime neighborhood descriptors of the provided sample.
 		virtual cv::Mat calculateNeighborhoodDescriptors(const Sample& exemplar, const cv::Mat& uv) const = 0;
+
+		/// \brief Refreshes the runtime neighborhood descriptors of a search space exemplar, after parts of the uv map have changed.
+		/// \param exemplar A sample, containing the search space descriptors of the exemplar.
+		/// \param uv The uv map used to resolve the pixel coordinates inside the exemplar sample.
+		/// \param changed A single-channel 8 bit mask, with the same size as `uv`, that contains non-zero values for each uv texel that has changed since the descriptors
+		///		   have been calculated.
+		/// \param descriptors The runtime neighborhood descriptors, previously returned by `calculateNeighborhoodDescriptors` for the same exemplar and uv map. The 
+		///		   descriptors are updated in place, so the matrix may also be a column range of a larger matrix.
+		///
+		/// Each runtime neighborhood descriptor depends on a small footprint of uv texels around its pixel. Implementations should only recompute the descriptors whose 
+		/// footprint overlaps a changed uv texel. During synthesis most pixels converge quickly, so the cost of the refresh shrinks with each correction sub-pass.
+		virtual void updateNeighborhoodDescriptors(const Sample& exemplar, const cv::Mat& uv, const cv::Mat& changed, cv::Mat& descriptors) const = 0;
+
+		/// \brief Writes the state of the extractor to a stream.
+		/// \param stream The stream to write the state to.
+		///
+		/// Extractors, that fit a projection to the exemplar, must store it, so that a search index, that is restored from a file, calculates runtime descriptors in the
+		/// same basis as the stored exemplar descriptors.
+		virtual void save(std::ostream& stream) const = 0;
+
+		/// \brief Restores the state of the extractor from a stream.
+		/// \param stream A stream, that contains the state, written by `save`.
+		virtual void restore(std::istream& stream) = 0;
 	};
 
 	class TEXTURIZE_API DescriptorExtractor :
@@ -92,9 +129,32 @@ namespace Texturize {
 
 		// IDescriptorExtractor
 	public:
+		/// \brief Fits the extractor to a search space exemplar.
+		///
+		/// The default extractor does not fit any model, so nothing is done.
+		void fit(const Sample& exemplar) override;
+
 		cv::Mat calculateNeighborhoodDescriptors(const Sample& exemplar) const override;
 		cv::Mat calculateNeighborhoodDescriptors(const Sample& exemplar, const cv::Mat& uv) const override;
 
+		/// \brief Refreshes the runtime neighborhood descriptors of a search space exemplar, after parts of the uv map have changed.
+		///
+		/// The default implementation simply recalculates all descriptors. Extractors that are able to compute descriptors for individual pixels should override this
+		/// method and only refresh the pixels returned by `getAffectedPixels`.
+		///
+		/// \see Texturize::IDescriptorExtractor::updateNeighborhoodDescriptors
+		void updateNeighborhoodDescriptors(const Sample& exemplar, const cv::Mat& uv, const cv::Mat& changed, cv::Mat& descriptors) const override;
+
+		/// \brief Writes the state of the extractor to a stream.
+		///
+		/// The default extractor does not have any state, so nothing is written. Extractors that derive from it and fit a model to the exemplar should override this.
+		void save(std::ostream& stream) const override;
+
+		/// \brief Restores the state of the extractor from a stream.
+		///
+		/// The default extractor does not have any state, so nothing is read.
+		void restore(std::istream& stream) override;
+
 	protected:
 		/// \brief Generates a simple UV map, that reproduces the exemplar.
 		/// \param exemplar The exemplar sample to generate the UV map for.
@@ -106,6 +166,21 @@ namespace Texturize {
 		/// \param uv The uv map used to resolve the pixel coordinates inside the exemplar sample.
 		/// \returns A column-major matrix, containing the pixel neighborhoods for each exemplar pixel.
 		cv::Mat getPixelNeighborhoods(const Sample& exemplar, const cv::Mat& uv) const;
+
+		/// \brief Extracts the pixel neighborhoods for a set of pixels.
+		/// \param exemplar The exemplar sample to extract the pixel neighborhoods from.
+		/// \param uv The uv map used to resolve the pixel coordinates inside the exemplar sample.
+		/// \param pixels The x and y coordinates of the pixels to extract the neighborhoods for.
+		/// \returns A row-major matrix, containing the pixel neighborhood of each requested pixel in a row.
+		cv::Mat getPixelNeighborhoods(const Sample& exemplar, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels) const;
+
+		/// \brief Returns all pixels, whose runtime neighborhood descriptor depends on a set of changed uv texels.
+		/// \param changed A single-channel 8 bit mask, that contains non-zero values for each uv texel that has changed.
+		/// \returns The x and y coordinates of all pixels, whose proxy pixel footprint contains a changed uv texel.
+		///
+		/// The proxy pixels of a descriptor are gathered from a 5x5 window around the center pixel, so the changed mask is dilated by this window. Since the uv map is
+		/// toroidal, the dilation wraps around the borders.
+		std::vector<cv::Point2i> getAffectedPixels(const cv::Mat& changed) const;
 	};
 
 	/// \brief Provides access to runtime neighborhood descriptors during synthesis.
@@ -119,18 +194,72 @@ namespace Texturize {
 	class TEXTURIZE_API PCADescriptorExtractor :
 		public DescriptorExtractor 
 	{
+		friend class SynthesisBundle;
+
 	private:
-		// TODO: Re-use projector from search space. Currently, the PCA matrix will be re-evaluated.
+		/// \brief The projector that maps pixel neighborhoods to descriptors.
+		///
+		/// The projector is fit by `fit`, which the search index calls for the exemplar, before it calculates the exemplar descriptors. It is re-used for all subsequent
+		/// calls, so that runtime descriptors share the basis of the indexed ones and can be refreshed per pixel.
 		std::unique_ptr<cv::PCA> _projector;
 
+		/// \brief The eigenvectors of the projector, stored row-wise and padded with zeros, so that they can be processed by vector instructions.
+		cv::Mat _basis;
+
+		/// \brief The projected mean of the projector, that is added to each projected descriptor.
+		cv::Mat _bias;
+
+		/// \brief Selects the pixels, whose neighborhoods are used to fit the projector.
+		const NeighborhoodSampling _sampling;
+
+		/// \brief Describes how well the projector represents the neighborhoods, it has been fit to.
+		ProjectionReport _report;
+
+		/// \brief The exemplar, the projector has been fit to. It shares the texels of the sample passed to `fit`.
+		Sample _exemplar;
+
+		/// \brief The texels of the fitted exemplar in interleaved layout, as they are read by the descriptor kernels.
+		///
+		/// Planar exemplars are converted once when the projector gets fit, instead of on each call. Extractors that have been restored have not seen the exemplar,
+		/// so they convert planar exemplars on each call.
+		Sample _texels;
+
+	public:
+		/// \brief Initializes a new PCA descriptor extractor.
+		/// \param sampling Selects the pixels, whose neighborhoods are used to fit the projector.
+		explicit PCADescriptorExtractor(const NeighborhoodSampling& sampling = NeighborhoodSampling());
+
+	public:
+		/// \brief Returns a report on the variance, that is retained by the projector.
+		/// \returns A report, that is filled when the projector gets fit. Before, its sample count is zero.
+		const ProjectionReport& getProjectionReport() const;
+
 		// IDescriptorExtractor
 	public:
+		/// \brief Fits the projector to the pixel neighborhoods, selected by the sampling settings, and prepares the projection basis.
+		///
+		/// Fitting the projector again replaces the basis, so descriptors, that have been calculated before, are no longer comparable to new ones.
+		void fit(const Sample& exemplar) override;
+
+		/// \brief Calculates the runtime neighborhood descriptors of a search space exemplar.
+		///
+		/// The projector must have been fit before.
 		cv::Mat calculateNeighborhoodDescriptors(const Sample& exemplar) const override;
 		cv::Mat calculateNeighborhoodDescriptors(const Sample& exemplar, const cv::Mat& uv) const override;
+		void updateNeighborhoodDescriptors(const Sample& exemplar, const cv::Mat& uv, const cv::Mat& changed, cv::Mat& descriptors) const override;
+
+		/// \brief Writes the projector and the projection report to a stream.
+		///
+		/// If the projector has not been fit yet, only this fact is stored, so that the restored extractor must be fit before it can be used.
+		void save(std::ostream& stream) const override;
+		void restore(std::istream& stream) override;
 
 	private:
-		cv::Mat calculateNeighborhoodDescriptors(const Sample& exemplar, const cv::Mat& uv, std::unique_ptr<cv::PCA>& projector) const;
-		cv::Mat calculateNeighborhoodDescriptors(const Sample& exemplar, const cv::Mat& uv, const std::unique_ptr<cv::PCA>& projector) const;
+		/// \brief Returns the texels of an exemplar in interleaved layout.
+		/// \param exemplar The exemplar, whose texels should be read.
+		/// \param converted A sample, that receives an interleaved copy of the exemplar, if it is neither interleaved, nor shares the texels of the fitted exemplar.
+		/// \returns Either the exemplar itself, the cached texels of the fitted exemplar, or `converted`.
+		const Sample& getInterleaved(const Sample& exemplar, Sample& converted) const;
 	};
 
 	/// \brief
@@ -185,6 +314,49 @@ namespace Texturize {
 		/// \see Texturize::ISearchSpace
 		/// \see Texturize::ISearchIndex::findNearestNeighbor
 		virtual bool findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& matches, const unsigned int k = 1, DistanceType minDist = 0) const = 0;
+
+		/// \brief Finds the best match for each pixel of a batch of pixel neighborhoods.
+		/// \param descriptors An array, containing all neighborhood descriptors of the currently synthesized sample.
+		/// \param uv A two-dimensional map, where each pixel contains the continuous u and v coordinates of the exemplar texel at the pixel's location.
+		/// \param pixels The x and y coordinates of the pixels to match.
+		/// \param matches A matrix with one row for each pixel, that receives the coordinates of the best match. It is only re-allocated, if it does not match the 
+		///                number of pixels or the position type.
+		/// \param distances A matrix with one row for each pixel, that receives the distance between the best match and the sample descriptor. It is only re-allocated,
+		///                  if it does not match the number of pixels or the distance type.
+		/// \param minDist The minimum distance between the source texel and match within the exemplar.
+		/// \param key A key, that selects the random streams of randomized indices. Equal keys reproduce equal matches.
+		/// \returns The number of pixels, for which a match has been found.
+		///
+		/// If no match has been found for a pixel, its distance is set to infinity and its coordinates are left undefined. Matching a batch of pixels at once amortizes
+		/// the cost of each individual query and allows implementations to process the queries in parallel. Hence, the pixels of one batch must not depend on each other,
+		/// i.e. the uv map must not be changed before all matches have been returned. The default implementation calls `findNearestNeighbor` for each pixel.
+		///
+		/// Synthesizers pass a different key for each pyramid level and correction pass, so that randomized indices, like `Texturize::PatchMatchIndex` or 
+		/// `Texturize::RandomWalkIndex`, do not repeat the same random search in each pass. Other indices ignore the key.
+		///
+		/// \see Texturize::ISearchIndex::findNearestNeighbor
+		virtual int findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist = 0, const std::uint64_t key = 0) const
+		{
+			const int count = static_cast<int>(pixels.size());
+			int found(0);
+
+			matches.create(count, 1, cv::DataType<PositionType>::type);
+			distances.create(count, 1, cv::DataType<DistanceType>::type);
+
+			for (int p(0); p < count; ++p) {
+				MatchType match;
+
+				if (this->findNearestNeighbor(descriptors, uv, pixels[p], match, minDist)) {
+					matches.at<PositionType>(p) = match.first;
+					distances.at<DistanceType>(p) = match.second;
+					++found;
+				} else {
+					distances.at<DistanceType>(p) = std::numeric_limits<DistanceType>::infinity();
+				}
+			}
+
+			return found;
+		}
 	};
 
 	/// \brief A search index interface that uses single precision distances and coordinates.
@@ -216,6 +388,39 @@ namespace Texturize {
 		/// \brief Returns a reference of the descriptor extractor, that is used to extract runtime neighborhood descriptors.
 		/// \returns A reference of the descriptor extractor, that is used to extract runtime neighborhood descriptors.
 		virtual std::shared_ptr<IDescriptorExtractor> getDescriptorExtractor() const = 0;
+
+		/// \brief Returns a hash, that identifies the index, the exemplar it has been built from and all parameters, that influence its matches.
+		/// \returns A hash, that identifies the index, the exemplar it has been built from and all parameters, that influence its matches.
+		///
+		/// The identity is used to key cached synthesis results, so it must be stable between runs and processes and it must differ, if two indices can return 
+		/// different matches for the same query. 
+		///
+		/// \see Texturize::SynthesisCache
+		virtual std::uint64_t getIdentity() const = 0;
+
+		/// \brief Returns `true`, if the index keeps state between queries, that depends on the sample it is matched against.
+		/// \returns `true`, if the index keeps state between queries, otherwise `false`.
+		///
+		/// Stateless indices only read their data during queries, so they can be shared between syntheses, that run concurrently. A stateful index must only be
+		/// queried by one synthesis at a time. The default implementation returns `false`.
+		virtual bool isStateful() const { return false; }
+
+		/// \brief Discards the state, that has been collected by previous queries.
+		///
+		/// Synthesizers call this method before they start a new synthesis with a stateful index, so that the result does not depend on previous syntheses. The 
+		/// default implementation does nothing.
+		///
+		/// \see Texturize::ISearchIndex::isStateful
+		virtual void reset() { }
+
+		/// \brief Returns `true`, if the matches of a pixel depend on its position within the sample, rather than only on its neighborhood.
+		/// \returns `true`, if the matches depend on the pixel position, otherwise `false`.
+		///
+		/// Such indices, e.g. ones that draw random numbers from streams keyed by the pixel index or treat the sample borders differently, return different matches for 
+		/// a pixel, if only a window of the sample is synthesized. The default implementation returns `false`.
+		///
+		/// \see Texturize::PyramidSynthesizer::synthesizeRegion
+		virtual bool isPositionDependent() const { return false; }
 	};
 
 	/// \brief Implements a search index, based on pixel neighborhood appearances.
@@ -273,6 +478,13 @@ namespace Texturize {
 		/// \brief Returns a reference of the descriptor extractor, that is used to extract runtime neighborhood descriptors.
 		/// \returns A reference of the descriptor extractor, that is used to extract runtime neighborhood descriptors.
 		std::shared_ptr<IDescriptorExtractor> getDescriptorExtractor() const override;
+
+		/// \brief Returns a hash of the exemplar, the state of the descriptor extractor and the norm.
+		/// \returns A hash of the exemplar, the state of the descriptor extractor and the norm.
+		///
+		/// Implementations, that have additional parameters, should override this method and combine the result with the name of the implementation and those 
+		/// parameters.
+		std::uint64_t getIdentity() const override;
 	};
 	
 	class TEXTURIZE_API ANNIndex :
@@ -344,12 +556,26 @@ namespace Texturize {
 		typedef typename TDistance::ElementType           TElement;
 		typedef typename ::cvflann::Matrix<TElement>      TMatrix;
 
+	public:
+		/// \brief The minimum number of queries, that are passed to the index at once, when matching a batch of pixels.
+		static const int QueryGrain = 64;
+
 	private:
 		std::unique_ptr<TIndex> _index;
 		cv::Mat _descriptors;
-		int _sampleWidth{ 0 };
+		int _sampleWidth{ 0 }, _sampleHeight{ 0 };
+		int _weightChannels{ -1 };
+
+	private:
+		PositionType getPosition(const int index) const;
+
+		/// \brief Restores the descriptors, the extractor state and the FLANN index from a file, written by `save`.
+		void restore(const std::string& fileName);
 
 	protected:
+		/// \brief Creates an index without building it. The index must be restored before it can be queried.
+		ANNIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, cv::NormTypes normType);
+
 		void init(const cv::flann::IndexParams& indexParams);
 		void init(const cv::flann::IndexParams& indexParams, std::optional<std::reference_wrapper<const Sample>> weightMap);
 
@@ -360,14 +586,40 @@ namespace Texturize {
 		ANNIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const Sample& guidanceMap, const cv::Ptr<const cv::flann::IndexParams> indexParams = cv::makePtr<const cv::flann::KDTreeIndexParams>(), cv::NormTypes normType = cv::NORM_L2SQR);
 		ANNIndex(std::shared_ptr<ISearchSpace> searchSpace, const Sample& guidanceMap, const cv::Ptr<const cv::flann::IndexParams> indexParams = cv::makePtr<const cv::flann::KDTreeIndexParams>(), cv::NormTypes normType = cv::NORM_L2SQR);
 
+		/// \brief Restores a search index from a file, instead of building it.
+		/// \param searchSpace The search space, the index has been built for.
+		/// \param descriptorExtractor The descriptor extractor, whose state is restored from the file. It must be of the same type as the extractor, the index has been
+		///		   built with.
+		/// \param fileName The name of a file, written by `ANNIndex::save`.
+		/// \param normType The norm used to compare descriptors.
+		/// \returns The restored search index.
+		///
+		/// Building the index requires to compute all exemplar descriptors and to cluster them, which can take longer than the synthesis itself. Applications, that
+		/// synthesize from the same exemplar multiple times, can build the index once, store it and restore it for each subsequent run. The file contains a hash of the
+		/// search space exemplar. If it does not match the provided search space, an `TEXTURIZE_ERROR_IO` error is raised. Note that the file also contains the weight 
+		/// channels (if any), since they are part of the descriptors.
+		///
+		/// Indices of all algorithms, including the ones built by `KNNIndex`, can be restored with this method.
+		static std::unique_ptr<ANNIndex> load(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const std::string& fileName, cv::NormTypes normType = cv::NORM_L2SQR);
+		static std::unique_ptr<ANNIndex> load(std::shared_ptr<ISearchSpace> searchSpace, const std::string& fileName, cv::NormTypes normType = cv::NORM_L2SQR);
+
+	public:
+		/// \brief Stores the index, the exemplar descriptors and the state of the descriptor extractor to a file.
+		/// \param fileName The name of the file to write to. If the file exists, it gets overwritten.
+		///
+		/// \see Texturize::ANNIndex::load
+		void save(const std::string& fileName) const;
+
 	public:
 		bool findNearestNeighbor(const std::vector<float>& descriptor, MatchType& match, DistanceType minDist = 0.0f) const;
 		bool findNearestNeighbors(const std::vector<float>& descriptor, std::vector<MatchType>& matches, const int k = 1, DistanceType minDist = 0.0f) const;
 
 		// ISearchIndex
 	public:
+		std::uint64_t getIdentity() const override;
 		bool findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist = 0) const override;
 		bool findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& matches, const unsigned int k = 1, DistanceType minDist = 0) const override;
+		int findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist = 0, const std::uint64_t key = 0) const override;
 	};
 
 	/// \brief A search index implementation that clusters the search space using a quantized kd-tree, which allows for fast neighborhood queries.
@@ -397,6 +649,375 @@ namespace Texturize {
 		KNNIndex(std::shared_ptr<ISearchSpace> searchSpace, const Sample& weightMap);
 	};
 
+	/// \brief A search index, that finds exact matches by comparing runtime descriptors against all exemplar descriptors.
+	///
+	/// After dimensionality reduction, descriptors typically only have a few components. For those, a linear scan over all exemplar descriptors is often faster than
+	/// traversing a kd-tree, since it does not branch and can be vectorized well. The index stores the exemplar descriptors component-wise (i.e. one row for each 
+	/// component), padded to the widest supported vector width, so that each instruction compares a query against multiple exemplar pixels. The scan discards a block
+	/// of exemplar pixels early, if all partial distances already exceed the best matches. Batch queries are processed in groups, so that each tile of exemplar 
+	/// descriptors is reused for multiple queries, while it resides in the cache.
+	///
+	/// The instruction set is selected at runtime, depending on the capabilities of the CPU. The index only supports the `cv::NORM_L2` and `cv::NORM_L2SQR` norms and
+	/// does not support guidance channels. Since the cost of each query grows linearly with the exemplar size, it is best suited for exemplars up to about 512x512 
+	/// pixels, or as an exact baseline for approximate indices.
+	///
+	/// \see Texturize::KNNIndex
+	class TEXTURIZE_API BruteForceIndex :
+		public SearchIndex
+	{
+	public:
+		/// \brief Defines the instruction sets, the index is able to use.
+		enum class InstructionSet {
+			/// \brief Plain C++ code.
+			Scalar,
+			/// \brief 128 bit vectors.
+			SSE2,
+			/// \brief 256 bit vectors with fused multiply-add.
+			AVX2,
+			/// \brief 512 bit vectors with fused multiply-add.
+			AVX512
+		};
+
+		/// \brief The number of exemplar descriptors, the components are padded to. Matches the widest supported vector width.
+		static const int Lanes = 16;
+
+		/// \brief The number of queries, that share each load of exemplar descriptor components.
+		static const int QueryBlock = 4;
+
+		/// \brief The number of queries of a batch, that are matched against one tile of exemplar descriptors, before moving on to the next tile.
+		static const int QueryGroup = 64;
+
+		/// \brief The number of exemplar descriptors within one tile.
+		static const int Tile = 4096;
+
+		/// \brief The number of components, after which the partial distances of a block of exemplar descriptors are compared against the best matches.
+		static const int EarlyExitInterval = 4;
+
+	private:
+		cv::Mat _components;
+		int _count{ 0 }, _width{ 0 }, _height{ 0 };
+		InstructionSet _instructionSet;
+
+	public:
+		/// \brief Creates a new search index.
+		/// \param searchSpace A reference of a search space instance.
+		/// \param descriptorExtractor The descriptor extractor, used to calculate the neighborhood descriptors.
+		/// \param normType The norm used to measure the distance between descriptors. Must be either `cv::NORM_L2` or `cv::NORM_L2SQR`.
+		BruteForceIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, cv::NormTypes normType = cv::NORM_L2);
+
+		/// \brief Creates a new search index.
+		/// \param searchSpace A reference of a search space instance.
+		/// \param normType The norm used to measure the distance between descriptors. Must be either `cv::NORM_L2` or `cv::NORM_L2SQR`.
+		BruteForceIndex(std::shared_ptr<ISearchSpace> searchSpace, cv::NormTypes normType = cv::NORM_L2);
+
+	private:
+		void init();
+		PositionType getPosition(const int index) const;
+
+	public:
+		/// \brief Returns the instruction set, that is used to scan the exemplar descriptors.
+		/// \returns The instruction set, that is used to scan the exemplar descriptors.
+		InstructionSet getInstructionSet() const;
+
+		// ISearchIndex
+	public:
+		std::uint64_t getIdentity() const override;
+		bool findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist = 0) const override;
+		bool findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& matches, const unsigned int k = 1, DistanceType minDist = 0) const override;
+		int findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist = 0, const std::uint64_t key = 0) const override;
+	};
+
+	/// \brief Implements a search index, that approximates nearest neighbors by navigating a hierarchical small-world graph.
+	///
+	/// Each exemplar descriptor is a node of a graph, that is connected to up to `M` close nodes on each layer it belongs to. Nodes are assigned to a random number of
+	/// layers with exponentially decreasing probability, so that upper layers form sparse, long-range graphs. A query greedily descends the upper layers, before it
+	/// performs a best-first search with a candidate list of `efSearch` nodes on the bottom layer. Different from kd-trees, the search quality does not degrade with
+	/// the number of descriptor dimensions, so the index is well suited for large exemplars and descriptors with appended guidance channels.
+	///
+	/// The graph is built by inserting the nodes in parallel, hence its structure depends on the thread schedule. It can be stored to a stream and restored later, as
+	/// long as the search space, descriptor extractor and guidance map produce the same descriptors.
+	///
+	/// \see Yu A. Malkov and D. A. Yashunin. "Efficient and robust approximate nearest neighbor search using Hierarchical Navigable Small World graphs." In: IEEE 
+	///      Transactions on Pattern Analysis and Machine Intelligence 42.4 (2020), pp. 824-836. doi: 10.1109/TPAMI.2018.2889473.
+	class TEXTURIZE_API HNSWIndex :
+		public SearchIndex
+	{
+	public:
+		/// \brief Stores the parameters, used to build and search the graph.
+		struct TEXTURIZE_API Parameters {
+			/// \brief The maximum number of connections of each node on the upper layers. The bottom layer allows twice as many connections.
+			int M{ 16 };
+
+			/// \brief The number of candidates, that are tracked when searching the neighbors of a node during construction.
+			int efConstruction{ 200 };
+
+			/// \brief The number of candidates, that are tracked when searching the bottom layer during a query. Higher values improve recall at the cost of speed.
+			int efSearch{ 64 };
+
+			/// \brief The seed used to assign the layers of each node.
+			unsigned int seed{ 0 };
+		};
+
+	private:
+		struct State;
+
+	private:
+		cv::Mat _descriptors;
+		int _width{ 0 }, _height{ 0 };
+		Parameters _parameters;
+		std::vector<int> _levels, _links;
+		std::vector<std::vector<int>> _upperLinks;
+		int _entryPoint{ -1 }, _maxLevel{ -1 };
+		std::unique_ptr<State> _state;
+
+	public:
+		/// \brief Creates a new search index and builds the graph.
+		/// \param searchSpace A reference of a search space instance.
+		/// \param descriptorExtractor The descriptor extractor, used to calculate the neighborhood descriptors.
+		/// \param parameters The parameters used to build and search the graph.
+		/// \param normType The norm used to measure the distance between descriptors.
+		HNSWIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const Parameters& parameters = Parameters(), cv::NormTypes normType = cv::NORM_L2);
+		HNSWIndex(std::shared_ptr<ISearchSpace> searchSpace, const Parameters& parameters = Parameters());
+
+		/// \brief Creates a new search index and builds the graph.
+		/// \param searchSpace A reference of a search space instance.
+		/// \param descriptorExtractor The descriptor extractor, used to calculate the neighborhood descriptors.
+		/// \param guidanceMap A map, that contains guidance channels for each exemplar pixel. The channels are appended to the descriptors.
+		/// \param parameters The parameters used to build and search the graph.
+		/// \param normType The norm used to measure the distance between descriptors.
+		HNSWIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const Sample& guidanceMap, const Parameters& parameters = Parameters(), cv::NormTypes normType = cv::NORM_L2);
+		HNSWIndex(std::shared_ptr<ISearchSpace> searchSpace, const Sample& guidanceMap, const Parameters& parameters = Parameters());
+
+		/// \brief Creates a new search index and restores the graph from a stream.
+		/// \param searchSpace A reference of a search space instance.
+		/// \param descriptorExtractor The descriptor extractor, used to calculate the neighborhood descriptors.
+		/// \param stream A stream, that contains a graph, written by `HNSWIndex::save`.
+		/// \param normType The norm used to measure the distance between descriptors.
+		HNSWIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, std::istream& stream, cv::NormTypes normType = cv::NORM_L2);
+
+		/// \brief Creates a new search index and restores the graph from a stream.
+		/// \param searchSpace A reference of a search space instance.
+		/// \param descriptorExtractor The descriptor extractor, used to calculate the neighborhood descriptors.
+		/// \param guidanceMap A map, that contains guidance channels for each exemplar pixel. The channels are appended to the descriptors.
+		/// \param stream A stream, that contains a graph, written by `HNSWIndex::save`.
+		/// \param normType The norm used to measure the distance between descriptors.
+		HNSWIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const Sample& guidanceMap, std::istream& stream, cv::NormTypes normType = cv::NORM_L2);
+
+		virtual ~HNSWIndex();
+
+	private:
+		void init(std::optional<std::reference_wrapper<const Sample>> guidanceMap);
+		void build();
+		void insert(const int node);
+		void restore(std::istream& stream);
+		
+		int* getLinks(const int node, const int level);
+		const int* getLinks(const int node, const int level) const;
+		float distance(const float* query, const int node) const;
+		PositionType getPosition(const int index) const;
+
+		/// \brief Greedily moves towards the query on one layer.
+		int descend(const float* query, int entryPoint, const int level, const bool building) const;
+
+		/// \brief Performs a best-first search on one layer and returns the `ef` closest nodes, sorted by increasing distance.
+		void searchLayer(const float* query, const int entryPoint, const int ef, const int level, const bool building, std::vector<std::pair<float, int>>& result) const;
+
+		/// \brief Selects up to `count` diverse neighbors from a set of candidates, sorted by increasing distance to the node.
+		void selectNeighbors(const std::vector<std::pair<float, int>>& candidates, const int count, std::vector<int>& neighbors) const;
+
+		/// \brief Finds the `k` closest nodes to a query, sorted by increasing distance.
+		int search(const float* query, const int k, const float minimum, float* distances, int* indices) const;
+
+	public:
+		/// \brief Writes the graph to a stream.
+		///
+		/// The stream also stores a hash of the exemplar, so that the graph can only be restored for the search space it has been built for.
+		///
+		/// \param stream The stream to write the graph to.
+		void save(std::ostream& stream) const;
+
+		/// \brief Returns the parameters, used to build and search the graph.
+		const Parameters& getParameters() const;
+
+		/// \brief Sets the number of candidates, that are tracked when searching the bottom layer during a query.
+		void setSearchBreadth(const int efSearch);
+
+		// ISearchIndex
+	public:
+		std::uint64_t getIdentity() const override;
+		bool findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist = 0) const override;
+		bool findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& matches, const unsigned int k = 1, DistanceType minDist = 0) const override;
+		int findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist = 0, const std::uint64_t key = 0) const override;
+	};
+
+	/// \brief Implements a search index, that stores compressed exemplar descriptors using product quantization.
+	///
+	/// The index first assigns each descriptor to the closest centroid of a coarse quantizer, which partitions the descriptors into inverted lists. The residual between
+	/// the descriptor and its coarse centroid is split into sub-vectors, each of which is encoded by the index of the closest entry of a codebook, trained for the 
+	/// sub-space. Each code is stored as one byte, so that the index only keeps one byte per sub-space and an exemplar pixel index for each descriptor. The descriptors
+	/// themselves are discarded after encoding.
+	///
+	/// A query visits the inverted lists of the closest coarse centroids. For each list, it pre-computes a table of the distances between the query residual and all
+	/// codebook entries, so that the (asymmetric) distance to each encoded descriptor is the sum of one table lookup per sub-space. The returned distances are 
+	/// approximations of the actual distances. The index only supports the `cv::NORM_L2` and `cv::NORM_L2SQR` norms.
+	///
+	/// \see Herve Jegou, Matthijs Douze and Cordelia Schmid. "Product Quantization for Nearest Neighbor Search." In: IEEE Transactions on Pattern Analysis and Machine
+	///      Intelligence 33.1 (2011), pp. 117-128. doi: 10.1109/TPAMI.2010.57.
+	class TEXTURIZE_API PQIndex :
+		public SearchIndex
+	{
+	public:
+		/// \brief Stores the parameters, used to train the quantizers and to search the index.
+		struct TEXTURIZE_API Parameters {
+			/// \brief The number of sub-spaces, each descriptor is split into. If set to `0`, each sub-space covers two descriptor components.
+			int subspaces{ 0 };
+
+			/// \brief The number of inverted lists of the coarse quantizer. If set to `0`, the square root of the number of descriptors is used.
+			int lists{ 0 };
+
+			/// \brief The number of inverted lists, that are visited for each query. Higher values improve recall at the cost of speed.
+			int probes{ 8 };
+
+			/// \brief The maximum number of descriptors, that are used to train the quantizers.
+			int trainingSamples{ 65536 };
+
+			/// \brief The seed used to initialize the k-means clustering of the quantizers.
+			unsigned int seed{ 0 };
+		};
+
+		/// \brief The maximum number of entries of each codebook, so that each code fits into one byte.
+		static const int Centroids = 256;
+
+	private:
+		Parameters _parameters;
+		int _width{ 0 }, _height{ 0 }, _dimensions{ 0 }, _subDimensions{ 0 }, _centroids{ 0 };
+		cv::Mat _coarseCentroids, _codebooks;
+		std::vector<std::vector<int>> _listIndices;
+		std::vector<std::vector<uchar>> _listCodes;
+
+	public:
+		/// \brief Creates a new search index and encodes the exemplar descriptors.
+		/// \param searchSpace A reference of a search space instance.
+		/// \param descriptorExtractor The descriptor extractor, used to calculate the neighborhood descriptors.
+		/// \param parameters The parameters used to train the quantizers and to search the index.
+		/// \param normType The norm used to measure the distance between descriptors. Must be either `cv::NORM_L2` or `cv::NORM_L2SQR`.
+		PQIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const Parameters& parameters = Parameters(), cv::NormTypes normType = cv::NORM_L2);
+		PQIndex(std::shared_ptr<ISearchSpace> searchSpace, const Parameters& parameters = Parameters());
+
+		/// \brief Creates a new search index and encodes the exemplar descriptors.
+		/// \param searchSpace A reference of a search space instance.
+		/// \param descriptorExtractor The descriptor extractor, used to calculate the neighborhood descriptors.
+		/// \param guidanceMap A map, that contains guidance channels for each exemplar pixel. The channels are appended to the descriptors.
+		/// \param parameters The parameters used to train the quantizers and to search the index.
+		/// \param normType The norm used to measure the distance between descriptors. Must be either `cv::NORM_L2` or `cv::NORM_L2SQR`.
+		PQIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const Sample& guidanceMap, const Parameters& parameters = Parameters(), cv::NormTypes normType = cv::NORM_L2);
+		PQIndex(std::shared_ptr<ISearchSpace> searchSpace, const Sample& guidanceMap, const Parameters& parameters = Parameters());
+
+	private:
+		void init(std::optional<std::reference_wrapper<const Sample>> guidanceMap);
+		PositionType getPosition(const int index) const;
+
+		/// \brief Finds the `k` encoded descriptors with the lowest approximate squared distances to a query, sorted by increasing distance.
+		int search(const float* query, const int k, const float minimum, float* distances, int* indices) const;
+
+	public:
+		/// \brief Returns the parameters, used to train the quantizers and to search the index.
+		const Parameters& getParameters() const;
+
+		/// \brief Sets the number of inverted lists, that are visited for each query.
+		void setProbes(const int probes);
+
+		/// \brief Returns the number of bytes, occupied by the quantizers and the encoded descriptors.
+		size_t getMemoryUsage() const;
+
+		// ISearchIndex
+	public:
+		std::uint64_t getIdentity() const override;
+		bool findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist = 0) const override;
+		bool findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& matches, const unsigned int k = 1, DistanceType minDist = 0) const override;
+		int findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist = 0, const std::uint64_t key = 0) const override;
+	};
+
+	/// \brief Implements a search index, that maintains a nearest neighbor field between the synthesized sample and the exemplar and improves it using PatchMatch.
+	///
+	/// The nearest neighbor field stores the best known exemplar pixel for each pixel of the synthesized sample. Whenever a pixel is matched, its entry is improved by 
+	/// comparing it against the current uv coordinates, the entries of the four neighbors (shifted by the offset to the neighbor, so that they are *propagated*) and a
+	/// set of random pixels, whose distance to the best match shrinks exponentially. The field persists between queries: if the uv map keeps its size (i.e. during the
+	/// sub-passes of one level), it is reused, and if the size doubles (i.e. on the next level), it gets upsampled. Odd levels, whose size has been rounded up when 
+	/// halving them, are upsampled the same way. Other sizes reset it. Synthesizers discard the field by calling `reset` before each synthesis, so that subsequent 
+	/// syntheses with the same seed produce the same result.
+	///
+	/// Batch queries perform a fixed number of iterations, each divided into a red and a black pass over the checkerboard of pixels. Each pass only reads entries of the
+	/// other color, so that all pixels of a pass can be improved in parallel. Since the field wraps around, the last column or row of an odd-sized field is colored 
+	/// with a second checkerboard and improved in separate passes. Different queries do not synchronize with each other, so neighboring pixels must not
+	/// be matched by concurrent queries. The random offsets only depend on the seed, the pixel and its current field entry, so that the result does not depend on the order in 
+	/// which the pixels are processed.
+	///
+	/// The index supports all norms that are supported by `DescriptorKernel::distance`, but does not support guidance channels.
+	///
+	/// \see Connelly Barnes et al. "PatchMatch: A Randomized Correspondence Algorithm for Structural Image Editing." In: ACM Trans. Graph. 28.3 (July 2009), 24:1-24:11. doi: 10.1145/1531326.1531330.
+	class TEXTURIZE_API PatchMatchIndex :
+		public SearchIndex
+	{
+	private:
+		struct Selection;
+
+	private:
+		cv::Mat _exemplarDescriptors;
+		int _width{ 0 }, _height{ 0 };
+		const int _iterations;
+		const unsigned int _seed;
+
+		mutable cv::Mat _field;
+		mutable std::atomic<long long> _fieldSize{ 0 };
+		mutable std::mutex _fieldMutex;
+
+	public:
+		/// \brief Creates a new search index.
+		/// \param searchSpace A reference of a search space instance.
+		/// \param descriptorExtractor The descriptor extractor, used to calculate the neighborhood descriptors.
+		/// \param iterations The number of propagation and random search iterations, that are performed for each query.
+		/// \param seed The seed used to draw the random search candidates.
+		/// \param normType The norm used to measure the distance between descriptors.
+		PatchMatchIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const int iterations = 2, const unsigned int seed = 0, cv::NormTypes normType = cv::NORM_L2);
+
+		/// \brief Creates a new search index.
+		/// \param searchSpace A reference of a search space instance.
+		/// \param iterations The number of propagation and random search iterations, that are performed for each query.
+		/// \param seed The seed used to draw the random search candidates.
+		PatchMatchIndex(std::shared_ptr<ISearchSpace> searchSpace, const int iterations = 2, const unsigned int seed = 0);
+
+	private:
+		void init();
+		PositionType getPosition(const int index) const;
+		int getIndex(const PositionType& position) const;
+
+		/// \brief Resizes the nearest neighbor field to match the size of a uv map.
+		void prepare(const cv::Size& size) const;
+
+		/// \brief Improves the nearest neighbor field entry of a pixel and collects the best matches.
+		/// \param target The runtime descriptor of the pixel.
+		/// \param uv The uv map of the synthesized sample.
+		/// \param at The pixel coordinates within the uv map.
+		/// \param iteration The current iteration, which selects the random search candidates.
+		/// \param selection The selection, that receives the best matches.
+		/// \param key The key of the query, which selects the random streams together with the pixel.
+		void improve(const float* target, const cv::Mat& uv, const cv::Point2i& at, const int iteration, Selection& selection, const std::uint64_t key) const;
+
+	public:
+		// ISearchIndex
+	public:
+		std::uint64_t getIdentity() const override;
+		bool isStateful() const override;
+		bool isPositionDependent() const override;
+
+		/// \brief Discards the nearest neighbor field, e.g. before synthesizing a new sample.
+		void reset() override;
+		bool findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist = 0) const override;
+		bool findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& matches, const unsigned int k = 1, DistanceType minDist = 0) const override;
+		int findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist = 0, const std::uint64_t key = 0) const override;
+	};
+
 	/// \brief Implements a search index, that matches pixel neighborhoods based on coherent pixels.
 	///
 	/// Coherent pixels have first been described by Michael Ashikhmin and are based on the observation that typically good match candidates are direct neighbors of already
@@ -409,32 +1030,113 @@ namespace Texturize {
 	class TEXTURIZE_API CoherentIndex :
 		public SearchIndex
 	{
+		friend class SynthesisBundle;
+
+	public:
+		/// \brief Defines how the k-coherent candidates of each exemplar pixel are found, when the index gets built.
+		enum class CandidateSeeding {
+			/// \brief Each candidate is the best match of a set of random probes.
+			Random,
+			/// \brief The candidates are the nearest neighbors, queried from a kd-tree. The tree is built without random numbers, so the candidates do not depend
+			///		   on the seed.
+			Approximate
+		};
+
+		/// \brief The number of random probes, that are evaluated for each candidate, if the candidates are seeded randomly.
+		static const int RandomProbes = 64;
+
+		/// \brief The number of candidate indices, that are evaluated without allocating heap memory, when looking up a pixel.
+		///
+		/// Each lookup evaluates up to `8 * (k + 1)` candidates, so the buffer covers indices with up to 15 candidates per exemplar pixel.
+		static const int CandidateBufferSize = 128;
+
 	private:
 		cv::Mat _candidates, _exemplarDescriptors;
 		const std::optional<const Sample> _guidanceMap;
 		const unsigned int _candidatesPerDescriptor;
+		const CandidateSeeding _seeding;
 
 	protected:
-		mutable std::mt19937 _rng;
+		const unsigned int _seed;
+		int _exemplarWidth, _exemplarHeight;
 
 	public:
 		/// \brief Creates a new search index.
 		/// \param searchSpace A reference of a search space instance.
-		/// \param distanceMeasure The type of norm to use to measure similarity between a candidate and a descriptor.
-		CoherentIndex(std::shared_ptr<ISearchSpace> searchSpace, const int k = 10);
-		CoherentIndex(std::shared_ptr<ISearchSpace> searchSpace, const Sample& guidanceMap, const int k = 3);
+		/// \param k The number of candidates, that are stored for each exemplar pixel.
+		/// \param seed The seed used to select the candidates. Indices built with the same seed contain the same candidates.
+		/// \param seeding Defines how the candidates are found.
+		CoherentIndex(std::shared_ptr<ISearchSpace> searchSpace, const int k = 10, const unsigned int seed = 0, const CandidateSeeding seeding = CandidateSeeding::Random);
+
+		/// \brief Creates a new search index.
+		/// \param searchSpace A reference of a search space instance.
+		/// \param guidanceMap A map, that contains guidance channels for each exemplar pixel.
+		/// \param k The number of candidates, that are stored for each exemplar pixel.
+		/// \param seed The seed used to select the candidates. Indices built with the same seed contain the same candidates.
+		/// \param seeding Defines how the candidates are found.
+		CoherentIndex(std::shared_ptr<ISearchSpace> searchSpace, const Sample& guidanceMap, const int k = 3, const unsigned int seed = 0, const CandidateSeeding seeding = CandidateSeeding::Random);
 
 	private:
+		/// \brief Creates a search index from candidates and exemplar descriptors, that have already been calculated.
+		/// \param searchSpace A reference of a search space instance.
+		/// \param descriptorExtractor The extractor, that has been used to calculate the exemplar descriptors.
+		/// \param exemplarDescriptors The neighborhood descriptors of the exemplar pixels. The matrix is not copied.
+		/// \param candidates The candidates of each exemplar pixel. The matrix is not copied.
+		/// \param guidanceMap An optional map, that contains guidance channels for each exemplar pixel.
+		/// \param seed The seed, the candidates have been selected with.
+		/// \param seeding Defines how the candidates have been found.
+		CoherentIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<PCADescriptorExtractor> descriptorExtractor, const cv::Mat& exemplarDescriptors, const cv::Mat& candidates,
+			std::optional<Sample> guidanceMap, const unsigned int seed, const CandidateSeeding seeding);
+
 		void init(const int& k);
 
+		/// \brief Selects each candidate as the best match from a set of random probes.
+		/// \param k The number of candidates per exemplar pixel.
+		///
+		/// Each pixel draws its probes from an individual stream of a counter-based random number generator, so that the candidates do not depend on the number
+		/// of threads or the order in which the pixels are processed.
+		void initRandomCandidates(const int k);
+
+		/// \brief Selects the candidates as the nearest neighbors of each exemplar pixel.
+		/// \param k The number of candidates per exemplar pixel.
+		///
+		/// The candidates are queried from a single kd-tree, which splits the descriptors deterministically. Randomized FLANN trees would draw from the global 
+		/// `rand` state, which can not be replaced by a counter-based generator and would have to be re-seeded, changing the random sequence of the caller.
+		void initApproximateCandidates(const int k);
+
 	protected:
 		cv::Mat getDescriptor(int index) const;
 		void getCoherentCandidates(const cv::Point2i& exemplarCoords, const cv::Vec2i& delta, std::vector<int>& candidates) const;
 
+		/// \brief Returns the uv coordinates of an exemplar pixel index.
+		PositionType getPosition(const int index) const;
+
+		/// \brief Collects the unique coherent candidates of all neighbors of a pixel.
+		/// \param uv The uv map of the synthesized sample.
+		/// \param at The pixel coordinates within the uv map.
+		/// \param candidates A buffer, that receives the exemplar pixel indices of the candidates. It must be able to store `8 * (k + 1)` indices.
+		/// \returns The number of unique candidates.
+		int collectCoherentCandidates(const cv::Mat& uv, const cv::Point2i& at, int* candidates) const;
+
+		/// \brief Evaluates the coherent candidates of a pixel and selects the best matches.
+		/// \param descriptors The runtime neighborhood descriptors of the synthesized sample.
+		/// \param uv The uv map of the synthesized sample.
+		/// \param at The pixel coordinates within the uv map.
+		/// \param indices A buffer, that receives the exemplar pixel indices of up to `k` matches.
+		/// \param distances A buffer, that receives the distances of up to `k` matches.
+		/// \param k The maximum number of matches.
+		/// \param minDist The minimum distance of a match.
+		/// \returns The number of matches, that have been written to the buffers, sorted by increasing distance.
+		///
+		/// The method does not allocate any heap memory, as long as the number of candidates does not exceed `CandidateBufferSize`.
+		int selectNearestCandidates(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, int* indices, DistanceType* distances, const int k, DistanceType minDist) const;
+
 		// ISearchIndex
 	public:
+		std::uint64_t getIdentity() const override;
 		bool findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist = 0) const override;
 		bool findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& matches, const unsigned int k = 1, DistanceType minDist = 0) const override;
+		int findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist = 0, const std::uint64_t key = 0) const override;
 	};
 
 	// class TEXTURIZE_API kCoherentIndex : public SearchIndex { };
@@ -458,13 +1160,104 @@ namespace Texturize {
 		RandomWalkIndex(std::shared_ptr<ISearchSpace> searchSpace, const Sample& guidanceMap, const int k = 3);
 
 	private:
-		PositionType getRandomPixelAround(const PositionType& point, int radius, int dominantDimensionExtent) const;
-		PositionType getRandomPixelAround(const PositionType& point, CoordinateType radius) const;
+		PositionType getRandomPixelAround(const PositionType& point, int radius, int dominantDimensionExtent, const std::uint64_t stream, const int counter) const;
+		PositionType getRandomPixelAround(const PositionType& point, CoordinateType radius, const std::uint64_t stream, const int counter) const;
+
+		/// \brief Randomly walks the environment of a candidate, trying to find a better match.
+		/// \param descriptors The runtime neighborhood descriptors of the synthesized sample.
+		/// \param uv The uv map of the synthesized sample.
+		/// \param at The pixel coordinates within the uv map.
+		/// \param candidate The number of the candidate, which selects the random stream used to walk its environment.
+		/// \param index The exemplar pixel index of the candidate. Receives the index of the refined candidate.
+		/// \param distance The distance of the candidate. Receives the distance of the refined candidate.
+		/// \param key The key of the query, which selects the random stream together with the pixel.
+		///
+		/// The random offsets only depend on the seed of the index, the key, the pixel and the candidate, so that pixels can be refined in parallel. Pixels, whose
+		/// neighborhood crosses the border of the uv map, i.e. that are closer to it than half the kernel size of the search space, keep their candidate.
+		void walk(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, const int candidate, int& index, DistanceType& distance, const std::uint64_t key = 0) const;
 
 		// ISearchIndex
 	public:
+		std::uint64_t getIdentity() const override;
+
+		/// \brief Returns `true`, since the random walk is keyed by the pixel index and skipped close to the borders of the sample.
+		bool isPositionDependent() const override;
 		bool findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist = 0) const override;
 		bool findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& matches, const unsigned int k = 1, DistanceType minDist = 0) const override;
+		int findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist = 0, const std::uint64_t key = 0) const override;
+	};
+
+	/// \brief A prebuilt set of synthesis inputs, that is loaded from a memory mapped file.
+	///
+	/// Before the first pixel can be synthesized, an appearance space asset must be read, the exemplar descriptors must be calculated and the coherent candidates must 
+	/// be searched. A bundle stores the results of all those steps: the appearance space exemplar and projection, the descriptor projector, the exemplar descriptors 
+	/// and the candidates of a `Texturize::CoherentIndex`. Each of them is stored in an individual section, that starts at a page boundary, so that the search space, 
+	/// the descriptor extractor and the search index can be constructed directly over the mapped memory, without parsing or copying it. Processes, that synthesize
+	/// from the same bundle, share the pages within the page cache of the operating system.
+	///
+	/// The file is mapped copy-on-write, so modifying the exemplar never changes the bundle. The objects, returned by a bundle, keep the mapping alive, so they may 
+	/// outlive the bundle instance itself. Since the values are stored in the native byte order, bundles are only exchangeable between machines of the same 
+	/// architecture.
+	///
+	/// \see Texturize::AppearanceSpace
+	/// \see Texturize::CoherentIndex
+	class TEXTURIZE_API SynthesisBundle
+	{
+	public:
+		/// \brief The alignment of each section within the file.
+		static const int SectionAlignment = 4096;
+
+	private:
+		std::shared_ptr<AppearanceSpace> _searchSpace;
+		std::shared_ptr<PCADescriptorExtractor> _descriptorExtractor;
+		std::shared_ptr<CoherentIndex> _searchIndex;
+
+	public:
+		/// \brief Maps a bundle file and constructs the synthesis inputs over it.
+		/// \param fileName The name of a file, written by `SynthesisBundle::write`.
+		///
+		/// If the file cannot be mapped or does not contain a bundle, an `TEXTURIZE_ERROR_IO` error is raised. The bundle is not validated against the inputs,
+		/// it has been built from. Call `SynthesisBundle::matches` before, to detect outdated bundles.
+		explicit SynthesisBundle(const std::string& fileName);
+
+	public:
+		/// \brief Writes a bundle file.
+		/// \param fileName The name of the file to write to. If the file exists, it gets replaced.
+		/// \param searchSpace The appearance space, the index has been built for.
+		/// \param searchIndex A coherent search index, whose descriptors and candidates are stored.
+		/// \param key A key, that identifies the inputs, the bundle has been built from, e.g. calculated by `SynthesisBundle::identify`.
+		///
+		/// The bundle is first written to a temporary file, that replaces the target file afterwards, so that processes, which still map the previous bundle, are 
+		/// not affected. The index must use a `Texturize::PCADescriptorExtractor`, which is the default. Derived indices, like `Texturize::RandomWalkIndex` are stored as plain
+		/// coherent indices.
+		static void write(const std::string& fileName, const AppearanceSpace& searchSpace, const CoherentIndex& searchIndex, const std::uint64_t key);
+
+		/// \brief Checks, if a bundle file has been built from a set of inputs.
+		/// \param fileName The name of a file, written by `SynthesisBundle::write`.
+		/// \param key The key of the inputs, the bundle is expected to be built from.
+		/// \returns `true`, if the file contains a bundle, that has been written with the key, or `false`, if it does not exist, does not contain a bundle or
+		///			  has been built from other inputs.
+		///
+		/// Only the header of the file is read, so the inputs do not need to be loaded, if the bundle is up to date.
+		static bool matches(const std::string& fileName, const std::uint64_t key);
+
+		/// \brief Calculates a key, that identifies the input files and parameters, a bundle is built from.
+		/// \param fileNames The names of the input files, e.g. the appearance space asset and the guidance map.
+		/// \param parameters Parameters, that are applied to the inputs, before the bundle is built from them, e.g. the weight of the guidance map.
+		/// \returns A hash over the contents of the files and the parameters.
+		///
+		/// The files are hashed without decoding them, which is much cheaper than loading the inputs. The hash is not suitable to detect deliberate modifications.
+		static std::uint64_t identify(const std::vector<std::string>& fileNames, const std::vector<float>& parameters = std::vector<float>());
+
+	public:
+		/// \brief Returns the appearance space, stored within the bundle.
+		std::shared_ptr<AppearanceSpace> getSearchSpace() const;
+
+		/// \brief Returns the descriptor extractor, stored within the bundle.
+		std::shared_ptr<PCADescriptorExtractor> getDescriptorExtractor() const;
+
+		/// \brief Returns the coherent search index, stored within the bundle.
+		std::shared_ptr<CoherentIndex> getSearchIndex() const;
 	};
 
 	/// \brief Generates a permutation vector from a set of coordinates.
@@ -501,6 +1294,81 @@ namespace Texturize {
 		cv::Vec2i calculate(const cv::Vec2i& v) const;
 	};
 
+	/// \brief Defines the order, in which the pixels of a correction sub-pass are visited.
+	///
+	/// A correction pass is divided into \f$ n^2 \f$ sub-passes, where \f$ n \f$ is the number of sub-passes along one axis. The pixels that belong to a sub-pass form a
+	/// regular lattice: sub-pass `s` contains all pixels, whose row is congruent to `s / n` and whose column is congruent to `s % n` (modulo `n`). A scheduler visits
+	/// this lattice and reports it to a callback as a set of horizontal spans. Each span is described by its row, the first column, the (exclusive) end column and the
+	/// column stride. Implementations are free to decide on the order and the concurrency, in which spans are reported, so callbacks must not depend on either.
+	///
+	/// \see Texturize::PyramidSynthesisSettings::_subpassScheduler
+	class TEXTURIZE_API ISubpassScheduler {
+	public:
+		/// \brief A callback that processes a span of pixels within one row.
+		///
+		/// The callback gets passed the row, the first column, the end column (exclusive) and the stride between two columns.
+		typedef std::function<void(int, int, int, int)> SpanFunction;
+
+	public:
+		virtual ~ISubpassScheduler() = default;
+
+	public:
+		/// \brief Visits all pixels of a sub-pass.
+		/// \param size The size of the sample that gets corrected.
+		/// \param subPasses The number of sub-passes along one axis.
+		/// \param subPass The index of the current sub-pass. Must be less than `subPasses * subPasses`.
+		/// \param fn The callback that processes the spans of the sub-pass.
+		virtual void schedule(const cv::Size& size, unsigned int subPasses, unsigned int subPass, const SpanFunction& fn) const = 0;
+	};
+
+	/// \brief Visits the pixel lattice of a sub-pass sequentially in row-major order.
+	class TEXTURIZE_API SequentialSubpassScheduler :
+		public ISubpassScheduler
+	{
+	public:
+		void schedule(const cv::Size& size, unsigned int subPasses, unsigned int subPass, const SpanFunction& fn) const override;
+	};
+
+	/// \brief Visits the pixel lattice of a sub-pass in parallel.
+	///
+	/// The lattice is split into two-dimensional blocks of lattice rows and columns, which are distributed among worker threads. Each block is reported as a set of
+	/// strided spans, so that pixels of one row are processed by the same thread in a cache-friendly order. The grain sizes control the minimum block extent and can
+	/// be used to tune the trade-off between load balancing and scheduling overhead.
+	class TEXTURIZE_API ParallelSubpassScheduler :
+		public ISubpassScheduler
+	{
+	private:
+		int _rowGrain, _colGrain;
+
+	public:
+		/// \brief Creates a new parallel sub-pass scheduler.
+		/// \param rowGrain The minimum number of lattice rows per block.
+		/// \param colGrain The minimum number of lattice columns per block.
+		ParallelSubpassScheduler(int rowGrain = 4, int colGrain = 256);
+
+	public:
+		void schedule(const cv::Size& size, unsigned int subPasses, unsigned int subPass, const SpanFunction& fn) const override;
+	};
+
+	/// \brief Visits a sub-pass by scanning each pixel of the sample and skipping pixels of other sub-passes.
+	///
+	/// This scheduler resembles the iteration scheme that has been used by the synthesizers before sub-pass scheduling was introduced. Each sub-pass touches all pixels
+	/// of the sample, so it is \f$ n^2 \f$ times more expensive than lattice-based schedulers. It is only kept as a reference, i.e. for comparing results and profiling.
+	class TEXTURIZE_API ScanlineSubpassScheduler :
+		public ISubpassScheduler
+	{
+	private:
+		bool _parallel;
+
+	public:
+		/// \brief Creates a new scanline sub-pass scheduler.
+		/// \param parallel True, if the rows of the sample should be scanned in parallel.
+		ScanlineSubpassScheduler(bool parallel = false);
+
+	public:
+		void schedule(const cv::Size& size, unsigned int subPasses, unsigned int subPass, const SpanFunction& fn) const override;
+	};
+
 	/// \brief A set of settings to initialize a synthesizer with.
 	///
 	/// Note that not all synthesizers require nor use all of the settings provided here. Also the function of the member variables might vary between synthesizer
@@ -546,6 +1414,135 @@ namespace Texturize {
 		static SynthesisSettings random(int kernel = 5, unsigned int state = 0);
 	};
 
+	/// \brief Stores the uv maps of pyramid levels, so that a synthesis can resume from the finest level, whose inputs did not change.
+	///
+	/// Each uv map is stored under a key, that identifies the search index, the seed, the synthesis settings (including the guidance map) and the inputs of all 
+	/// levels up to the cached one, i.e. their sizes and jitter amplitudes. Variations, that only differ in the randomness of fine levels, share the coarse levels. 
+	/// The cache keeps the most recently used uv maps in memory, until their total size exceeds the capacity. If a directory is provided, the uv maps are also
+	/// written to files within this directory, so that they are available to later runs. Each file is written to a temporary file first, that replaces it 
+	/// afterwards, and files, that can not be read, are treated like missing entries, so an interrupted writer does not break later runs.
+	///
+	/// The cache can be shared between multiple synthesizers, threads and processes.
+	///
+	/// \see Texturize::PyramidSynthesisSettings::_cache
+	class TEXTURIZE_API SynthesisCache {
+	private:
+		typedef std::list<std::pair<std::uint64_t, cv::Mat>> EntryList;
+
+	private:
+		size_t _capacity, _size{ 0 };
+		std::string _directory;
+		EntryList _entries;
+		std::unordered_map<std::uint64_t, EntryList::iterator> _lookup;
+		mutable std::mutex _mutex;
+
+	public:
+		/// \brief Creates a new cache.
+		/// \param capacity The maximum number of bytes of the uv maps, that are kept in memory.
+		/// \param directory A directory to store the uv maps in, or an empty string, if they should only be kept in memory.
+		SynthesisCache(size_t capacity = 256 << 20, const std::string& directory = std::string());
+
+	private:
+		std::string getFileName(const std::uint64_t key) const;
+		void insert(const std::uint64_t key, const cv::Mat& uv);
+
+	public:
+		/// \brief Looks up a uv map.
+		/// \param key The key of the uv map.
+		/// \param uv Receives a copy of the uv map, if it has been found.
+		/// \returns `true`, if the uv map has been found, otherwise `false`.
+		bool find(const std::uint64_t key, cv::Mat& uv);
+
+		/// \brief Stores a uv map.
+		/// \param key The key of the uv map.
+		/// \param uv The uv map to store. The cache stores a copy of it.
+		void store(const std::uint64_t key, const cv::Mat& uv);
+
+		/// \brief Removes all uv maps from memory. Files within the cache directory are not removed.
+		void clear();
+
+		/// \brief Returns the number of bytes of the uv maps, that are currently kept in memory.
+		/// \returns The number of bytes of the uv maps, that are currently kept in memory.
+		size_t size() const;
+	};
+
+	/// \brief Stores the state of a pyramid synthesis, so that it can be interrupted and resumed later.
+	///
+	/// A checkpoint contains the uv map of the last synthesized pyramid level and the number of correction passes, that have been applied to it. The jitter and the
+	/// search indices draw their random numbers from generators, that are keyed by the seed and the pixel coordinates, so the seed and the uv map are sufficient to 
+	/// continue the synthesis. A checkpoint can only be resumed with the same search index and settings, it has been created with. Stateful search indices, like
+	/// `Texturize::PatchMatchIndex`, keep state between levels and passes, which is not stored within the checkpoint, so checkpoints of such syntheses can not be
+	/// resumed.
+	///
+	/// \see Texturize::PyramidSynthesizer::resume
+	/// \see Texturize::PyramidSynthesisSettings::_checkpointHandler
+	struct TEXTURIZE_API SynthesisCheckpoint {
+		/// \brief The size of the result sample.
+		cv::Size size;
+
+		/// \brief The pyramid level of the uv map, or -1, if the synthesis has not been started yet.
+		int level{ -1 };
+
+		/// \brief The index of the last correction pass, that has been applied to the uv map, or -1, if no correction pass has been executed on the level.
+		int pass{ -1 };
+
+		/// \brief `true`, if all correction passes of the level have been executed.
+		bool finished{ false };
+
+		/// \brief The mean match distance of the last correction pass. Adaptive correction compares the next pass against it.
+		double distance{ 0. };
+
+		/// \brief The seed of the synthesis.
+		unsigned int rngState{ 0 };
+
+		/// \brief A hash of the search index and all settings, that influence the uv map.
+		std::uint64_t settings{ 0 };
+
+		/// \brief The uv map of the pyramid level.
+		cv::Mat uv;
+
+		/// \brief Writes the checkpoint to a file.
+		/// \param fileName The name of the file. 
+		///
+		/// The checkpoint is first written to a temporary file, that replaces the target file afterwards. If the process gets interrupted whilst writing, the 
+		/// previous checkpoint stays intact.
+		void save(const std::string& fileName) const;
+
+		/// \brief Reads a checkpoint from a file.
+		/// \param fileName The name of a file, written by `save`.
+		/// \returns The checkpoint, stored in the file.
+		static SynthesisCheckpoint load(const std::string& fileName);
+	};
+
+	/// \brief Reports how much a correction pass has changed a sample.
+	///
+	/// The statistics are accumulated over all sub-passes of a correction pass. Pixels, for which the search index did not find a match, are not counted.
+	///
+	/// \see Texturize::PyramidSynthesisSettings::_convergenceThreshold
+	struct TEXTURIZE_API CorrectionStatistics {
+		/// \brief The number of pixels, that have been matched.
+		size_t pixels = 0;
+
+		/// \brief The number of matched pixels, whose coordinates have been replaced by a different match.
+		size_t changed = 0;
+
+		/// \brief The sum of the distances between the runtime descriptors of the matched pixels and their matches.
+		double distance = 0.;
+
+		/// \brief Returns the ratio of matched pixels, whose coordinates have changed.
+		/// \returns A value between 0.0 and 1.0, or 0.0, if no pixel has been matched.
+		double changeRate() const;
+
+		/// \brief Returns the mean distance between the runtime descriptors of the matched pixels and their matches.
+		/// \returns The mean match distance, or 0.0, if no pixel has been matched.
+		double meanDistance() const;
+
+		/// \brief Adds the statistics of another (sub-)pass.
+		/// \param other The statistics to add.
+		/// \returns A reference of the current instance.
+		CorrectionStatistics& operator+=(const CorrectionStatistics& other);
+	};
+
 	/// \brief A set of settings to initialize instances of \ref `Texturize::PyramidSynthesizer` with.
 	///
 	/// \see Texturize::PyramidSynthesizer
@@ -564,14 +1561,15 @@ namespace Texturize {
 		/// - The current pyramid level
 		/// - The correction pass index
 		/// - The current uv map
+		/// - The statistics of the correction pass
 		/// It gets called after a synthesis pass has finished, i.e. the algorithm wants to continue with the next pyramid level or has completed a correction pass. In
-		/// case no correction pass has been executed, the parameter is -1.
+		/// case no correction pass has been executed, the parameter is -1 and the statistics are empty.
 		///
 		/// **Example**
 		///
 		/// The following code demonstrates how to setup a callback, that displays the result after each synthesis level.
 		/// \include ProgressCallback.cpp
-		typedef EventDispatcher<void, int, int, const cv::Mat&> ProgressHandler;
+		typedef EventDispatcher<void, int, int, const cv::Mat&, const CorrectionStatistics&> ProgressHandler;
 
 		/// \brief A callback that reports the result of a sub-pass.
 		///
@@ -583,6 +1581,26 @@ namespace Texturize {
 		/// \see Texturize::PyramidSynthesisSettings::ProgressHandler
 		typedef EventDispatcher<void, const std::string&, const cv::Mat&> SubpassFeedbackHandler;
 
+		/// \brief A callback that receives the state of the synthesis, after a pyramid level or correction pass has finished.
+		///
+		/// The checkpoint shares its uv map with the synthesizer, so it must be stored or copied, before the callback returns.
+		///
+		/// \see Texturize::SynthesisCheckpoint
+		typedef EventDispatcher<void, const SynthesisCheckpoint&> CheckpointHandler;
+
+		/// \brief Defines, how a correction pass updates the uv map.
+		///
+		/// \see _correctionMode
+		enum class CorrectionMode {
+			/// \brief Divides each pass into sub-passes, that are executed subsequently and write their matches directly into the uv map (Gauss-Seidel iteration). 
+			///        Later sub-passes see the matches of earlier ones, which typically improves convergence.
+			SubPasses,
+			/// \brief Executes each pass as a single sweep, that reads the uv map of the previous pass and writes its matches into a second buffer (Jacobi iteration).
+			///        The sweep requires no barriers between sub-passes and its result does not depend on the order, in which pixels are visited, as long as the
+			///        search index does not depend on it either (see `_deterministic`).
+			Jacobi
+		};
+
 	public:
 		/// \brief A callback that get's called to inform clients about the current synthesis progress.
 		///
@@ -594,6 +1612,13 @@ namespace Texturize {
 		/// \see Texturize::PyramidSynthesisSettings::ProgressHandler
 		SubpassFeedbackHandler _feedbackHandler;
 
+		/// \brief A callback that get's called to inform a client about the state of the synthesis, so that it can be resumed later.
+		///
+		/// The handler is only called by `PyramidSynthesizer::synthesize` and `PyramidSynthesizer::resume`.
+		///
+		/// \see Texturize::PyramidSynthesisSettings::CheckpointHandler
+		CheckpointHandler _checkpointHandler;
+
 		/// \brief A function that returns the amount of randomness per pyramid level.
 		///
 		/// The randomness selector function is used to control the amount of jitter per pyramid level. It is a function that returns a value between 0.0 and 1.0, based on
@@ -636,6 +1661,61 @@ namespace Texturize {
 		/// Values greater than 3 typically do not improve synthesis quality significantly.
 		unsigned int _correctionSubPasses = 2;
 
+		/// \brief The threshold, below which a pyramid level is considered to be converged.
+		///
+		/// If this value is 0, each level executes `_correctionPasses` correction passes. Otherwise the synthesizer stops correcting a level, as soon as the ratio of 
+		/// pixels that changed during a pass, or the relative improvement of the mean match distance over the previous pass, falls below this threshold. Most samples 
+		/// converge after one or two passes at fine levels, where correction is most expensive. A value of 0.01 is a reasonable starting point.
+		///
+		/// \see Texturize::CorrectionStatistics
+		float _convergenceThreshold = 0.f;
+
+		/// \brief The maximum number of correction passes per pyramid level, if `_convergenceThreshold` is set.
+		///
+		/// If this value is greater than `_correctionPasses`, additional passes are executed for levels that have not converged after `_correctionPasses` passes. 
+		/// Otherwise `_correctionPasses` is the upper bound.
+		unsigned int _maxCorrectionPasses = 0;
+
+		/// \brief The scheduler that defines the order, in which the pixels of a correction sub-pass are visited.
+		///
+		/// If no scheduler is provided, the synthesizer uses its default scheduler. The `PyramidSynthesizer` visits the sub-pass lattice sequentially, whilst the
+		/// `ParallelPyramidSynthesizer` distributes it among multiple threads.
+		///
+		/// \see Texturize::ISubpassScheduler
+		std::shared_ptr<const ISubpassScheduler> _subpassScheduler;
+
+		/// \brief Defines, how a correction pass updates the uv map.
+		///
+		/// In `CorrectionMode::Jacobi` mode, `_correctionSubPasses` is ignored and the scheduler is asked to visit all pixels within one sub-pass. 
+		///
+		/// \see Texturize::PyramidSynthesisSettings::CorrectionMode
+		CorrectionMode _correctionMode = CorrectionMode::SubPasses;
+
+		/// \brief If set to `true`, the result does not depend on the number of threads or the order, in which the scheduler visits the pixels of a sub-pass.
+		///
+		/// By default, the matches of a sub-pass are written directly into the uv map, whilst other pixels of the same sub-pass may read them. In deterministic mode,
+		/// each sub-pass reads a snapshot of the uv map and its matches are merged after it has finished. All built-in search indices draw their random numbers from
+		/// counter-based generators, that are keyed by the seed and the pixel, so together with the snapshots a seed yields identical results on any number of threads.
+		///
+		/// Jacobi correction does not require this setting, since each pass already reads a snapshot of the previous one. Both modes rely on the search index to be 
+		/// deterministic: a stateless index must not depend on the order of its queries. Stateful indices, like the `PatchMatchIndex`, propagate matches between 
+		/// neighboring pixels of their own state, so the synthesizer passes all pixels of a sub-pass to them within one batch, regardless of the scheduler. The index 
+		/// must then process the batch independently of the number of threads, which the `PatchMatchIndex` does by alternating between red and black pixels.
+		///
+		/// \see Texturize::ISearchIndex::isStateful
+		bool _deterministic = false;
+
+		/// \brief A cache of intermediate uv maps, or `nullptr`, if each synthesis should start from the coarsest level.
+		///
+		/// If a cache is provided, `PyramidSynthesizer::synthesize` looks up each level before synthesizing it and stores each synthesized level. Levels that are 
+		/// found in the cache are reported to the progress handler without correction pass.
+		///
+		/// Stateful search indices, like `Texturize::PatchMatchIndex`, carry state from one level to the next, which is not stored in the cache. Skipping a level 
+		/// would therefore change the result of the following levels, so the cache is bypassed for such indices.
+		///
+		/// \see Texturize::SynthesisCache
+		/// \see Texturize::ISearchIndex::isStateful
+		std::shared_ptr<SynthesisCache> _cache;
 
 
 		std::optional<Sample> _guidanceMap;
@@ -729,8 +1809,8 @@ namespace Texturize {
 
 	public:
 		/// \brief Returns the settings, the synthesizer has been configured with.
-		/// \returns The settings, the synthesizer has been configured with.
-		SynthesisSettings config() const;
+		/// \returns A reference of the settings, the synthesizer has been configured with. It is valid as long as the state object.
+		const SynthesisSettings& config() const;
 
 		/// \brief Gets a reference of the settings, the synthesizer has been configured with.
 		/// \param config The settings, the synthesizer has been configured with.
@@ -758,8 +1838,8 @@ namespace Texturize {
 
 	public:
 		/// \brief Returns the settings, the synthesizer has been configured with.
-		/// \returns The settings, the synthesizer has been configured with.
-		PyramidSynthesisSettings config() const;
+		/// \returns A reference of the settings, the synthesizer has been configured with. It is valid as long as the state object.
+		const PyramidSynthesisSettings& config() const;
 
 		/// \brief Gets a reference of the settings, the synthesizer has been configured with.
 		/// \param config The settings, the synthesizer has been configured with.
@@ -777,6 +1857,9 @@ namespace Texturize {
 		/// \brief Returns the synthesis scale factor.
 		/// \returns The synthesis scale factor.
 		///
+		/// The spacing only depends on the pyramid level, not on its size. Levels of rectangular or non-power-of-two samples are covered by the levels of a square,
+		/// power-of-two pyramid with the same depth, so they use the same spacing.
+		///
 		/// \see Texturize::PyramidSynthesisSettings::_scale
 		float getSpacing() const;
 
@@ -784,13 +1867,39 @@ namespace Texturize {
 		cv::Mat _sample = cv::Mat();
 		unsigned int _level = 0;
 		float _randomness = 0.f;
+		cv::Rect _window;
+		cv::Size _extent;
 
 	public:
 		/// \brief Updates the synthesizer state.
 		/// \param level The pyramid level of the current synthesizer pass.
 		/// \param sample The uv map, that resembles the currently synthesized sample.
+		///
+		/// The level is synthesized as a whole, i.e. the window equals the upsampled size of the sample.
 		void update(const int level, const cv::Mat& sample);
 
+		/// \brief Updates the synthesizer state for a pass, that only synthesizes a window of the pyramid level.
+		/// \param level The pyramid level of the current synthesizer pass.
+		/// \param sample The uv map, that gets upsampled into the window.
+		/// \param window The window of the pyramid level, that is synthesized. Its origin must be within the level extent.
+		/// \param extent The size of the whole pyramid level. The level wraps around at its borders.
+		///
+		/// \see Texturize::PyramidSynthesizer::synthesizeRegion
+		void update(const int level, const cv::Mat& sample, const cv::Rect& window, const cv::Size& extent);
+
+		/// \brief Returns the window of the pyramid level, the current synthesizer pass is working on.
+		/// \returns The window of the pyramid level, the current synthesizer pass is working on.
+		cv::Rect getWindow() const;
+
+		/// \brief Returns the size of the whole pyramid level, the current synthesizer pass is working on.
+		/// \returns The size of the whole pyramid level, the current synthesizer pass is working on.
+		cv::Size getExtent() const;
+
+		/// \brief Maps a pixel of the current window to its position within the whole pyramid level.
+		/// \param at The x and y coordinate of the pixel within the current window.
+		/// \returns The x and y coordinate of the pixel within the whole pyramid level.
+		cv::Point2i getPosition(const cv::Point2i& at) const;
+
 		/// \brief Returns a copy of the currently synthesized sample.
 		/// \returns A copy of the currently synthesized sample.
 		///
@@ -891,6 +2000,9 @@ namespace Texturize {
 	/// Lefebvre and Hoppe originally based their synthesizer on image pyramids and later introduced an hierarchy, called "gaussian stack", that, instead of traversing
 	/// a pyramidal hierarchy, uses a stack of increasingly blurred samples. This implementation does not use the stack, but instead uses simple pyramids.
 	///
+	/// The pyramid levels are not required to be square or to have power-of-two sizes. Each level is half as large as the next one along each axis, whereby odd sizes
+	/// are rounded up. Levels wrap around at their borders, so results with power-of-two sizes can be tiled.
+	///
 	/// **Example**
 	///
 	/// The following example shows how to create a synthesizer and synthesize a new texture from an indexed exemplar.
@@ -901,6 +2013,23 @@ namespace Texturize {
 	class TEXTURIZE_API PyramidSynthesizer :
 		public SynthesizerBase
 	{
+	public:
+		/// \brief Describes one output of a batch synthesis.
+		///
+		/// \see Texturize::PyramidSynthesizer::synthesizeBatch
+		struct TEXTURIZE_API Job {
+			/// \brief The size of the result sample.
+			cv::Size size;
+
+			/// \brief The settings used to synthesize the result, i.e. its seed, seed coordinates and guidance map.
+			PyramidSynthesisSettings settings;
+		};
+
+		/// \brief A callback that receives the result of a batch job.
+		///
+		/// The callback gets passed the index of the job and its result. It is called from the thread, that has started the batch.
+		typedef std::function<void(size_t, const Sample&)> BatchResultCallback;
+
 	protected:
 		/// \brief Creates a new synthesizer instance.
 		/// \param catalog An index, that provides access to exemplar pixel neighborhoods and implements neighborhood matching.
@@ -910,7 +2039,9 @@ namespace Texturize {
 		/// \brief Performs synthesis for the next level of the image pyramid.
 		/// \param sample The current result sample.
 		/// \param state An object, that provides access to the runtime state of the synthesizer.
-		virtual void synthesizeLevel(cv::Mat& sample, const PyramidSynthesizerState& state) const;
+		/// \param checkpoint A checkpoint, that gets updated and passed to the checkpoint handler after each correction pass, or `nullptr`. If the checkpoint 
+		///                   contains an unfinished pass of the current level, the sample is not upsampled and correction continues after the last executed pass.
+		virtual void synthesizeLevel(cv::Mat& sample, const PyramidSynthesizerState& state, SynthesisCheckpoint* checkpoint = nullptr) const;
 
 		/// \brief Doubles the effective resolution of the result sample.
 		/// \param sample The current result sample.
@@ -931,12 +2062,14 @@ namespace Texturize {
 		/// \brief Corrects the current result sample by searching for close pixel neighborhoods for each texel.
 		/// \param sample The current result sample.
 		/// \param state An object, that provides access to the runtime state of the synthesizer.
+		/// \param pass The index of the correction pass within the current level. Together with the level and the seed, it selects the random streams of the search index.
+		/// \param statistics Receives the statistics of the correction pass.
 		///
 		/// This method is called multiple times in order to let the result sample converge agains a "best match". The number of correction passes can be configured within
 		/// the `PyramidSynthesizerConfig`. For each texel, it asks the search index for a good candidate to replace it with, based on the current neighborhood. This process
 		/// is not done sequentially, but rather the method divides the image into a set of sub-passes that are then executed sequentially. The number of sub-passes can be
 		/// configured within the `PyramidSynthesizerConfig`.
-		virtual void correct(cv::Mat& sample, const PyramidSynthesizerState& state) const;
+		virtual void correct(cv::Mat& sample, const PyramidSynthesizerState& state, const unsigned int pass, CorrectionStatistics& statistics) const;
 
 		/// \brief Interpolates a pixel coordinate to fill the space created during upsampling.
 		/// \param uv The uv coordinates of the origin texel from the previous pyramid level.
@@ -957,11 +2090,84 @@ namespace Texturize {
 
 		virtual void transferTo(const Sample& target, Sample& result, const PyramidSynthesizerState& state) const;
 
+		/// \brief Returns the scheduler, that is used to visit the pixels of a correction sub-pass.
+		/// \param state An object, that provides access to the runtime state of the synthesizer.
+		/// \returns The scheduler provided by the synthesis settings or a sequential scheduler, if none has been provided.
+		///
+		/// \see Texturize::PyramidSynthesisSettings::_subpassScheduler
+		virtual std::shared_ptr<const ISubpassScheduler> getSubpassScheduler(const PyramidSynthesizerState& state) const;
+
 	public:
 		void synthesize(int width, int height, Sample& result, const SynthesisSettings& config = SynthesisSettings()) const override;
 		void synthesize(const cv::Size& size, Sample& result, const SynthesisSettings& config = SynthesisSettings()) const override;
 		void transferStyle(const Sample& target, Sample& result, const SynthesisSettings& config = SynthesisSettings()) const override;
 
+		/// \brief Synthesizes a window of a texture, without synthesizing the whole texture.
+		/// \param window The window of the texture, that should be synthesized. Must be located within a rectangle of `size`.
+		/// \param size The size of the whole texture, the window is part of.
+		/// \param result A reference to the result sample. It has the same size as the window.
+		/// \param config The configuration to initialize the synthesizer with.
+		///
+		/// Jitter is calculated by a deterministic hash of the pixel coordinates and each correction sub-pass only depends on a small neighborhood around each pixel. 
+		/// Hence, a window of the result only depends on a bounded window of each previous pyramid level. This method computes this dependency cone backwards from the
+		/// requested window and only synthesizes the padded windows on each level, so the costs scale with the size of the window rather than the size of the texture. 
+		/// Windows of coarse levels, that would exceed the level, are synthesized as a whole and windows crossing the level border wrap around, just like the full 
+		/// synthesis does.
+		///
+		/// The result equals the texels, that `synthesize` would produce for the window, if the following conditions are met:
+		/// - The randomness selector does not depend on the contents of the sample, it gets passed. Only the window is provided to it.
+		/// - The search index does not depend on the position of a pixel within the sample or on state from earlier queries. Indices, for which 
+		///   `ISearchIndex::isPositionDependent` or `ISearchIndex::isStateful` return `true`, like the `RandomWalkIndex` and the `PatchMatchIndex`, are rejected.
+		/// - The number of correction passes is fixed, i.e. `_convergenceThreshold` is 0, since convergence is measured over the whole level. Otherwise the windows are
+		///   padded for `_maxCorrectionPasses`, but convergence is measured over the windows only, so a level may stop after a different number of passes.
+		///
+		/// The progress and feedback handlers receive the windows, instead of the whole pyramid levels.
+		void synthesizeRegion(const cv::Rect& window, const cv::Size& size, Sample& result, const SynthesisSettings& config = SynthesisSettings()) const;
+
+		/// \brief Synthesizes multiple textures from the same search index.
+		/// \param jobs The size and settings of each result.
+		/// \param callback A callback, that receives each result as soon as it has been synthesized.
+		///
+		/// The jobs are synthesized level by level: each pyramid level is synthesized for all jobs, that have not finished yet, before the synthesizer continues with
+		/// the next level. The jobs of a level are distributed among the same thread pool, the correction of each job uses, so running many jobs does not 
+		/// oversubscribe the machine and the setup of the index is shared between them. Jobs with fewer levels finish earlier and their results are passed to the
+		/// callback immediately, so that they can be stored and released, whilst other jobs are still running.
+		///
+		/// Only the levels are synchronized between the jobs. Each job extracts its own descriptors and queries the index with its own batches, since a batch query 
+		/// resolves candidates through a single uv map and the jobs may perform a different number of correction passes, if their settings are adaptive. Hence, the 
+		/// throughput gain stems from sharing the index and the thread pool, not from gathering the queries of multiple jobs.
+		///
+		/// The search index and the randomness selectors are queried from multiple jobs concurrently, so they must not modify shared state. Hence, batches with more
+		/// than one job require a stateless search index, i.e. they can not be synthesized with the `PatchMatchIndex`, which stores a field of matches for the
+		/// sample it is currently correcting. The progress and feedback handlers of the jobs are called from worker threads.
+		///
+		/// \see Texturize::ISearchIndex::isStateful
+		void synthesizeBatch(const std::vector<Job>& jobs, const BatchResultCallback& callback) const;
+
+		/// \brief Starts or continues a synthesis from a checkpoint and stops after a certain pyramid level.
+		/// \param checkpoint The checkpoint to continue from. If its level is -1, a new synthesis of `checkpoint.size` is started. Receives the state of the 
+		///                   synthesis, after the method has returned.
+		/// \param config The configuration to initialize the synthesizer with. Must equal the configuration, the checkpoint has been created with.
+		/// \param lastLevel The last pyramid level to synthesize, or -1, if all levels should be synthesized.
+		///
+		/// The checkpoint handler of the configuration is called after each level and correction pass, so that the state can be stored and the synthesis can be 
+		/// resumed from it, if the process gets interrupted. Resuming produces the same result as an uninterrupted synthesis, as long as the synthesis is 
+		/// deterministic, i.e. `_deterministic` is set or the correction mode is `CorrectionMode::Jacobi`. If the checkpoint has reached the last level, its uv map 
+		/// contains the result. Levels, that are synthesized after resuming an existing checkpoint, are not looked up in the cache. A started checkpoint can not be
+		/// resumed with a stateful search index, since its state is not stored within the checkpoint.
+		///
+		/// \see Texturize::PyramidSynthesisSettings::_checkpointHandler
+		/// \see Texturize::ISearchIndex::isStateful
+		void resume(SynthesisCheckpoint& checkpoint, const SynthesisSettings& config, const int lastLevel = -1) const;
+
+	private:
+		/// \brief Starts or continues a synthesis from a checkpoint.
+		/// \param identify If `false`, the hash of the search index and settings is only calculated, if the cache, the checkpoint handler or the checkpoint 
+		///                 itself require it. The hash covers the whole exemplar, so plain syntheses skip it.
+		///
+		/// \see Texturize::PyramidSynthesizer::resume
+		void continueFrom(SynthesisCheckpoint& checkpoint, const SynthesisSettings& config, const int lastLevel, const bool identify) const;
+
 	public:
 		/// \brief A factory method that creates a new synthesizer and initializes with a search index, that provides access to exemplar neighborhoods.
 		/// \param catalog An search index, that provides access to exemplar neighborhoods and provides runtime pixel neighborhood matching.
@@ -997,8 +2203,7 @@ namespace Texturize {
 	protected:
 		void upsample(cv::Mat& sample, const PyramidSynthesizerState& state) const override;
 		void jitter(cv::Mat& sample, const PyramidSynthesizerState& state) const override;
-		void correct(cv::Mat& sample, const PyramidSynthesizerState& state) const override;
-		void transferTo(const Sample& target, Sample& result, const PyramidSynthesizerState& state) const override;
+		std::shared_ptr<const ISubpassScheduler> getSubpassScheduler(const PyramidSynthesizerState& state) const override;
 
 	public:
 		/// \brief A factory method that creates a new synthesizer and initializes with a search index, that provides access to exemplar neighborhoods.
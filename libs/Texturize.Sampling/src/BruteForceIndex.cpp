@@ -0,0 +1,354 @@
+#include "stdafx.h"
+
+#include <sampling.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include "DescriptorKernel.h"
+#include "Serialization.h"
+
+// The vectorized scan kernels are compiled for all supported instruction sets and selected at runtime. MSVC allows to use all intrinsics without enabling them for
+// the whole translation unit, other compilers require them to be enabled for each function. Flattening the kernels inlines the generic scan into a function, that
+// is allowed to use the instruction set.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TEXTURIZE_SCAN_X86
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#define TEXTURIZE_SCAN_TARGET(isa)
+#else
+#define TEXTURIZE_SCAN_TARGET(isa) __attribute__((target(isa), flatten))
+#endif
+
+using namespace Texturize;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Scan kernels                                                                            /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+	using DescriptorKernel::Selection;
+
+	/// \brief Describes the component-wise exemplar descriptors.
+	struct Components {
+		const float* data;
+		int stride;
+		int dimensions;
+		int count;
+	};
+
+	// The lanes pass vectors by reference, since the generic scan is compiled without the instruction set, before it gets inlined into the dispatched kernel. Passing
+	// them by value would change the calling convention of the generic scan, depending on the instruction set.
+	struct ScalarLanes {
+		typedef float Type;
+		static const int Width = 1;
+
+		static inline void zero(Type& v) { v = 0.f; }
+		static inline void load(Type& v, const float* p) { v = *p; }
+		static inline void accumulate(Type& acc, const Type& a, const float b) { const float d = a - b; acc += d * d; }
+		static inline int less(const Type& a, const float b) { return a < b ? 1 : 0; }
+		static inline void store(float* p, const Type& v) { *p = v; }
+	};
+
+#ifdef TEXTURIZE_SCAN_X86
+	struct SSE2Lanes {
+		typedef __m128 Type;
+		static const int Width = 4;
+
+		static inline void zero(Type& v) { v = _mm_setzero_ps(); }
+		static inline void load(Type& v, const float* p) { v = _mm_loadu_ps(p); }
+		static inline void accumulate(Type& acc, const Type& a, const float b) { const Type d = _mm_sub_ps(a, _mm_set1_ps(b)); acc = _mm_add_ps(acc, _mm_mul_ps(d, d)); }
+		static inline int less(const Type& a, const float b) { return _mm_movemask_ps(_mm_cmplt_ps(a, _mm_set1_ps(b))); }
+		static inline void store(float* p, const Type& v) { _mm_storeu_ps(p, v); }
+	};
+
+	struct AVX2Lanes {
+		typedef __m256 Type;
+		static const int Width = 8;
+
+		TEXTURIZE_SCAN_TARGET("avx2,fma") static inline void zero(Type& v) { v = _mm256_setzero_ps(); }
+		TEXTURIZE_SCAN_TARGET("avx2,fma") static inline void load(Type& v, const float* p) { v = _mm256_loadu_ps(p); }
+		TEXTURIZE_SCAN_TARGET("avx2,fma") static inline void accumulate(Type& acc, const Type& a, const float b) { const Type d = _mm256_sub_ps(a, _mm256_set1_ps(b)); acc = _mm256_fmadd_ps(d, d, acc); }
+		TEXTURIZE_SCAN_TARGET("avx2,fma") static inline int less(const Type& a, const float b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, _mm256_set1_ps(b), _CMP_LT_OQ)); }
+		TEXTURIZE_SCAN_TARGET("avx2,fma") static inline void store(float* p, const Type& v) { _mm256_storeu_ps(p, v); }
+	};
+
+	struct AVX512Lanes {
+		typedef __m512 Type;
+		static const int Width = 16;
+
+		TEXTURIZE_SCAN_TARGET("avx512f") static inline void zero(Type& v) { v = _mm512_setzero_ps(); }
+		TEXTURIZE_SCAN_TARGET("avx512f") static inline void load(Type& v, const float* p) { v = _mm512_loadu_ps(p); }
+		TEXTURIZE_SCAN_TARGET("avx512f") static inline void accumulate(Type& acc, const Type& a, const float b) { const Type d = _mm512_sub_ps(a, _mm512_set1_ps(b)); acc = _mm512_fmadd_ps(d, d, acc); }
+		TEXTURIZE_SCAN_TARGET("avx512f") static inline int less(const Type& a, const float b) { return static_cast<int>(_mm512_cmp_ps_mask(a, _mm512_set1_ps(b), _CMP_LT_OQ)); }
+		TEXTURIZE_SCAN_TARGET("avx512f") static inline void store(float* p, const Type& v) { _mm512_storeu_ps(p, v); }
+	};
+#endif
+
+	/// \brief Compares a block of up to `BruteForceIndex::QueryBlock` queries against a range of exemplar descriptors.
+	/// \param components The component-wise exemplar descriptors.
+	/// \param begin The first exemplar descriptor. Must be a multiple of `BruteForceIndex::Lanes`.
+	/// \param end The end of the range of exemplar descriptors. Must be a multiple of `BruteForceIndex::Lanes`.
+	/// \param queries The queries, stored as one row of components for each query.
+	/// \param queryCount The number of queries.
+	/// \param selections The selections of the queries, that receive the squared distances of the best matches.
+	template <typename TLanes>
+	static inline void scan(const Components& components, const int begin, const int end, const float* queries, const int queryCount, Selection* selections)
+	{
+		typedef typename TLanes::Type TVector;
+		const int dimensions = components.dimensions;
+		float lanes[TLanes::Width];
+
+		for (int j(begin); j < end; j += TLanes::Width) {
+			TVector acc[BruteForceIndex::QueryBlock];
+			int d(0);
+
+			for (int q(0); q < queryCount; ++q)
+				TLanes::zero(acc[q]);
+
+			for (; d < dimensions; ++d) {
+				// Load the components of the block once and compare them against all queries.
+				TVector values;
+				TLanes::load(values, components.data + static_cast<size_t>(d) * components.stride + j);
+
+				for (int q(0); q < queryCount; ++q)
+					TLanes::accumulate(acc[q], values, queries[q * dimensions + d]);
+
+				// Skip the block, if none of the partial distances is able to improve any selection.
+				if ((d + 1) % BruteForceIndex::EarlyExitInterval == 0 && d + 1 < dimensions) {
+					int improves(0);
+
+					for (int q(0); q < queryCount && !improves; ++q)
+						improves = TLanes::less(acc[q], selections[q].worst());
+
+					if (!improves)
+						break;
+				}
+			}
+
+			if (d < dimensions)
+				continue;
+
+			// Insert all descriptors, that improve the selection. The lanes of the last block, that exceed the number of descriptors, only contain padding.
+			const int width = components.count - j < TLanes::Width ? components.count - j : TLanes::Width;
+
+			for (int q(0); q < queryCount; ++q) {
+				const int mask = TLanes::less(acc[q], selections[q].worst());
+
+				if (mask == 0)
+					continue;
+
+				TLanes::store(lanes, acc[q]);
+
+				for (int l(0); l < width; ++l)
+					if (mask & (1 << l))
+						selections[q].insert(lanes[l], j + l);
+			}
+		}
+	}
+
+	typedef void(*ScanFunction)(const Components&, const int, const int, const float*, const int, Selection*);
+
+	static void scanScalar(const Components& components, const int begin, const int end, const float* queries, const int queryCount, Selection* selections)
+	{
+		scan<ScalarLanes>(components, begin, end, queries, queryCount, selections);
+	}
+
+#ifdef TEXTURIZE_SCAN_X86
+	static void scanSSE2(const Components& components, const int begin, const int end, const float* queries, const int queryCount, Selection* selections)
+	{
+		scan<SSE2Lanes>(components, begin, end, queries, queryCount, selections);
+	}
+
+	TEXTURIZE_SCAN_TARGET("avx2,fma") static void scanAVX2(const Components& components, const int begin, const int end, const float* queries, const int queryCount, Selection* selections)
+	{
+		scan<AVX2Lanes>(components, begin, end, queries, queryCount, selections);
+	}
+
+	TEXTURIZE_SCAN_TARGET("avx512f") static void scanAVX512(const Components& components, const int begin, const int end, const float* queries, const int queryCount, Selection* selections)
+	{
+		scan<AVX512Lanes>(components, begin, end, queries, queryCount, selections);
+	}
+#endif
+
+	static ScanFunction getScanFunction(const BruteForceIndex::InstructionSet instructionSet)
+	{
+		switch (instructionSet)
+		{
+#ifdef TEXTURIZE_SCAN_X86
+		case BruteForceIndex::InstructionSet::AVX512:
+			return scanAVX512;
+		case BruteForceIndex::InstructionSet::AVX2:
+			return scanAVX2;
+		case BruteForceIndex::InstructionSet::SSE2:
+			return scanSSE2;
+#endif
+		default:
+			return scanScalar;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Brute-force search index implementation                                                 /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+BruteForceIndex::BruteForceIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, cv::NormTypes normType) :
+	SearchIndex(searchSpace, descriptorExtractor, normType)
+{
+	this->init();
+}
+
+BruteForceIndex::BruteForceIndex(std::shared_ptr<ISearchSpace> searchSpace, cv::NormTypes normType) :
+	BruteForceIndex(searchSpace, std::make_unique<PCADescriptorExtractor>(), normType)
+{
+}
+
+void BruteForceIndex::init()
+{
+	TEXTURIZE_ASSERT(_normType == cv::NORM_L2 || _normType == cv::NORM_L2SQR);		// Only euclidean distances are supported.
+
+	// Precompute the neighborhood descriptors of the exemplar.
+	std::shared_ptr<const Sample> sample;
+	_searchSpace->sample(sample);
+	sample->getSize(_width, _height);
+
+	_descriptorExtractor->fit(*sample);
+	cv::Mat descriptors = _descriptorExtractor->calculateNeighborhoodDescriptors(*sample);
+	TEXTURIZE_ASSERT(descriptors.type() == CV_32FC1);								// The scan kernels operate on single-precision floating point descriptors.
+	_count = descriptors.rows;
+
+	// Store the descriptors component-wise. The padding descriptors are far away from any actual descriptor, so that they do not prevent skipping the last block. Since
+	// a minimum distance could still accept them, the scan never inserts them into a selection.
+	const int padded = (_count + Lanes - 1) / Lanes * Lanes;
+	_components = cv::Mat(descriptors.cols, padded, CV_32FC1, cv::Scalar::all(1e18f));
+	descriptors.t().copyTo(_components.colRange(0, _count));
+
+	// Select the widest instruction set, supported by the CPU.
+	_instructionSet = InstructionSet::Scalar;
+
+#ifdef TEXTURIZE_SCAN_X86
+	if (cv::checkHardwareSupport(CV_CPU_AVX_512F))
+		_instructionSet = InstructionSet::AVX512;
+	else if (cv::checkHardwareSupport(CV_CPU_AVX2) && cv::checkHardwareSupport(CV_CPU_FMA3))
+		_instructionSet = InstructionSet::AVX2;
+	else if (cv::checkHardwareSupport(CV_CPU_SSE2))
+		_instructionSet = InstructionSet::SSE2;
+#endif
+}
+
+BruteForceIndex::InstructionSet BruteForceIndex::getInstructionSet() const
+{
+	return _instructionSet;
+}
+
+BruteForceIndex::PositionType BruteForceIndex::getPosition(const int index) const
+{
+	return PositionType(
+		static_cast<CoordinateType>(index % _width) / static_cast<CoordinateType>(_width),
+		static_cast<CoordinateType>(index / _width) / static_cast<CoordinateType>(_height));
+}
+
+std::uint64_t BruteForceIndex::getIdentity() const
+{
+	// The instruction sets accumulate the distances in different orders, so ties may be resolved differently.
+	const std::uint64_t identity = Serialization::combine(SearchIndex::getIdentity(), "BruteForceIndex");
+	return Serialization::combine(identity, static_cast<int>(_instructionSet));
+}
+
+bool BruteForceIndex::findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist) const
+{
+	std::vector<MatchType> matches;
+
+	if (!this->findNearestNeighbors(descriptors, uv, at, matches, 1, minDist))
+		return false;
+
+	match = matches.front();
+	return true;
+}
+
+bool BruteForceIndex::findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& matches, const unsigned int k, DistanceType minDist) const
+{
+	TEXTURIZE_ASSERT(descriptors.type() == CV_32FC1);								// The scan kernels operate on single-precision floating point descriptors.
+	TEXTURIZE_ASSERT(descriptors.cols == _components.rows);						// The runtime descriptors must match the exemplar descriptors.
+	TEXTURIZE_ASSERT(k > 0 && static_cast<int>(k) <= _count);						// There must be enough exemplar descriptors to select k matches from.
+
+	// Select the k best matches. Distances are compared squared, which preserves their order.
+	const bool squared = _normType == cv::NORM_L2SQR;
+	cv::AutoBuffer<float, 16> distances(k);
+	cv::AutoBuffer<int, 16> indices(k);
+	Selection selection{ distances.data(), indices.data(), static_cast<int>(k), 0, static_cast<float>(squared ? minDist : minDist * minDist) };
+
+	const Components components{ _components.ptr<float>(), _components.cols, _components.rows, _count };
+	getScanFunction(_instructionSet)(components, 0, _components.cols, descriptors.ptr<float>(at.y * uv.cols + at.x), 1, &selection);
+
+	if (selection.count == 0)
+		return false;
+
+	matches.resize(selection.count);
+
+	for (int m(0); m < selection.count; ++m)
+		matches[m] = std::make_pair(this->getPosition(indices[m]), static_cast<DistanceType>(squared ? distances[m] : std::sqrt(distances[m])));
+
+	return true;
+}
+
+int BruteForceIndex::findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist, const std::uint64_t key) const
+{
+	TEXTURIZE_ASSERT(descriptors.type() == CV_32FC1);								// The scan kernels operate on single-precision floating point descriptors.
+	TEXTURIZE_ASSERT(descriptors.cols == _components.rows);						// The runtime descriptors must match the exemplar descriptors.
+
+	const int count = static_cast<int>(pixels.size());
+	const int dimensions = _components.rows;
+	const bool squared = _normType == cv::NORM_L2SQR;
+	const float minimum = static_cast<float>(squared ? minDist : minDist * minDist);
+	const Components components{ _components.ptr<float>(), _components.cols, dimensions, _count };
+	const ScanFunction scanFunction = getScanFunction(_instructionSet);
+
+	matches.create(count, 1, cv::DataType<PositionType>::type);
+	distances.create(count, 1, cv::DataType<DistanceType>::type);
+
+	// Match groups of queries in parallel. Each group visits the exemplar descriptors tile by tile, so that each tile is reused for all queries of the group.
+	tbb::parallel_for(tbb::blocked_range<int>(0, count, QueryGroup), [&](const tbb::blocked_range<int>& range) {
+		const int queryCount = static_cast<int>(range.size());
+		cv::AutoBuffer<float> queries(static_cast<size_t>(queryCount) * dimensions);
+		cv::AutoBuffer<float> bestDistances(queryCount);
+		cv::AutoBuffer<int> bestIndices(queryCount);
+		cv::AutoBuffer<Selection> selections(queryCount);
+
+		// Gather the query descriptors into a continuous block.
+		for (int q(0); q < queryCount; ++q) {
+			const cv::Point2i& at = pixels[range.begin() + q];
+			const float* descriptor = descriptors.ptr<float>(at.y * uv.cols + at.x);
+			std::copy(descriptor, descriptor + dimensions, queries.data() + static_cast<size_t>(q) * dimensions);
+			selections[q] = Selection{ bestDistances.data() + q, bestIndices.data() + q, 1, 0, minimum };
+		}
+
+		for (int tile(0); tile < _components.cols; tile += Tile) {
+			const int end = std::min(tile + Tile, _components.cols);
+
+			for (int q(0); q < queryCount; q += QueryBlock)
+				scanFunction(components, tile, end, queries.data() + static_cast<size_t>(q) * dimensions, std::min(QueryBlock, queryCount - q), selections.data() + q);
+		}
+
+		// Store the results.
+		for (int q(0); q < queryCount; ++q) {
+			const int p = range.begin() + q;
+
+			if (selections[q].count == 0) {
+				distances.at<DistanceType>(p) = std::numeric_limits<DistanceType>::infinity();
+			} else {
+				matches.at<PositionType>(p) = this->getPosition(bestIndices[q]);
+				distances.at<DistanceType>(p) = static_cast<DistanceType>(squared ? bestDistances[q] : std::sqrt(bestDistances[q]));
+			}
+		}
+	});
+
+	return static_cast<int>(std::count_if(distances.begin<DistanceType>(), distances.end<DistanceType>(), [](const DistanceType& distance) { return distance != std::numeric_limits<DistanceType>::infinity(); }));
+}
@@ -5,9 +5,12 @@
 #include <algorithm>
 
 #include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 #include <tbb/blocked_range2d.h>
 
-#include "log2.h"
+#include "CounterRandom.h"
+#include "DescriptorKernel.h"
+#include "Serialization.h"
 
 using namespace Texturize;
 
@@ -15,109 +18,131 @@ using namespace Texturize;
 ///// SearchIndex implementation based on coherent pixels.                                    /////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-CoherentIndex::CoherentIndex(std::shared_ptr<ISearchSpace> searchSpace, const int k) :
-	SearchIndex(searchSpace, std::make_unique<PCADescriptorExtractor>()), _candidatesPerDescriptor(k)
+CoherentIndex::CoherentIndex(std::shared_ptr<ISearchSpace> searchSpace, const int k, const unsigned int seed, const CandidateSeeding seeding) :
+	SearchIndex(searchSpace, std::make_unique<PCADescriptorExtractor>()), _candidatesPerDescriptor(k), _seeding(seeding), _seed(seed)
 {
-	std::random_device seed;
-	_rng = std::mt19937(seed());
-
 	this->init(k);
 }
 
-CoherentIndex::CoherentIndex(std::shared_ptr<ISearchSpace> searchSpace, const Sample& guidanceMap, const int k) :
-	SearchIndex(searchSpace, std::make_unique<PCADescriptorExtractor>()), _guidanceMap(guidanceMap), _candidatesPerDescriptor(k)
+CoherentIndex::CoherentIndex(std::shared_ptr<ISearchSpace> searchSpace, const Sample& guidanceMap, const int k, const unsigned int seed, const CandidateSeeding seeding) :
+	SearchIndex(searchSpace, std::make_unique<PCADescriptorExtractor>()), _guidanceMap(guidanceMap), _candidatesPerDescriptor(k), _seeding(seeding), _seed(seed)
 {
-	std::random_device seed;
-	_rng = std::mt19937(seed());
-
 	this->init(k);
 }
 
+CoherentIndex::CoherentIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<PCADescriptorExtractor> descriptorExtractor, const cv::Mat& exemplarDescriptors, const cv::Mat& candidates,
+	std::optional<Sample> guidanceMap, const unsigned int seed, const CandidateSeeding seeding) :
+	SearchIndex(searchSpace, descriptorExtractor), _candidates(candidates), _exemplarDescriptors(exemplarDescriptors), _guidanceMap(std::move(guidanceMap)), 
+	_candidatesPerDescriptor(candidates.cols), _seeding(seeding), _seed(seed)
+{
+	std::shared_ptr<const Sample> sample;
+	_searchSpace->sample(sample);
+	_exemplarWidth = static_cast<int>(sample->width());
+	_exemplarHeight = static_cast<int>(sample->height());
+
+	TEXTURIZE_ASSERT(_exemplarDescriptors.type() == CV_32FC1);	// The distance kernels operate on single-precision floating point descriptors.
+	TEXTURIZE_ASSERT(_exemplarDescriptors.isContinuous());		// The descriptors of all pixels are read directly from memory.
+	TEXTURIZE_ASSERT(_exemplarDescriptors.rows == sample->width() * sample->height());
+	TEXTURIZE_ASSERT(_candidates.type() == CV_32SC1);			// The candidates must be stored as exemplar pixel indices.
+	TEXTURIZE_ASSERT(_candidates.rows == _exemplarDescriptors.rows && _candidates.cols > 0);
+}
+
 void CoherentIndex::init(const int& k)
 {
+	TEXTURIZE_ASSERT(k > 0);									// There must be at least one candidate per pixel.
+
 	// Precompute the neighborhood descriptors used to train data.
-	int kernel, kernelDev;
 	std::shared_ptr<const Sample> sample;
 	_searchSpace->sample(sample);
-	_searchSpace->kernel(kernel);
-	kernelDev = (kernel - 1) / 2;
-	int sampleLevel = static_cast<int>(log2(sample->width()));
+	_descriptorExtractor->fit(*sample);
+	_exemplarDescriptors = _descriptorExtractor->calculateNeighborhoodDescriptors(*sample);
+	_exemplarWidth = static_cast<int>(sample->width());
+	_exemplarHeight = static_cast<int>(sample->height());
 
-	//TEXTURIZE_ASSERT(sample->width() == sample->height());
-	TEXTURIZE_ASSERT_DBG(kernel % 2 == 1);						// The kernel must be an odd number of pixels.
+	TEXTURIZE_ASSERT(_exemplarDescriptors.type() == CV_32FC1);	// The distance kernels operate on single-precision floating point descriptors.
+	TEXTURIZE_ASSERT(_exemplarDescriptors.isContinuous());		// The descriptors of all pixels are read directly from memory.
+	TEXTURIZE_ASSERT(_exemplarDescriptors.rows == sample->width() * sample->height());
 
-	// Generate an RNG, that randomly selects pixels.
-	std::uniform_int_distribution<int> distribution(0, (sample->width() * sample->height()) - 1);
+	// Initialize the candidate set.
+	_candidates = cv::Mat(_exemplarDescriptors.rows, k, CV_32SC1);
 
-	// Get the source descriptors.
-	_exemplarDescriptors = _descriptorExtractor->calculateNeighborhoodDescriptors(*sample);
+	if (_seeding == CandidateSeeding::Approximate)
+		this->initApproximateCandidates(k);
+	else
+		this->initRandomCandidates(k);
+}
 
-	// Initialize the candidate set.
-	_candidates = cv::Mat(sample->width() * sample->height(), k, CV_32SC1);
+void CoherentIndex::initRandomCandidates(const int k)
+{
+	const int pixels = _exemplarDescriptors.rows;
+	const int dimensions = _exemplarDescriptors.cols;
+	const int norm = DescriptorKernel::rankingNorm(_normType);
 
 	// Calculate the k-coherent candidates for each pixel.
-	tbb::parallel_for(tbb::blocked_range2d<size_t>(0, sample->width(), 0, sample->height()), [this, &sample, &distribution, k](const tbb::blocked_range2d<size_t>& range) {
-		for (int x = static_cast<int>(range.cols().begin()); x < range.cols().end(); ++x)
-		for (int y = static_cast<int>(range.rows().begin()); y < range.rows().end(); ++y) {
-			// Get the neighborhood descriptor for the pixel at the current position.
-			Sample::Texel neighborhood = _exemplarDescriptors.row(y * sample->width() + x);
-
-			// TODO: Original implementation applies 3 box filters and keeps candidates from 64, 16 and 4 random samples from fine to coarse.
-			std::vector<int> candidates;
+	// TODO: Original implementation applies 3 box filters and keeps candidates from 64, 16 and 4 random samples from fine to coarse.
+	tbb::parallel_for(tbb::blocked_range<int>(0, pixels), [this, k, pixels, dimensions, norm](const tbb::blocked_range<int>& range) {
+		for (int pixel = range.begin(); pixel < range.end(); ++pixel) {
+			const float* neighborhood = _exemplarDescriptors.ptr<float>(pixel);
+			int* candidates = _candidates.ptr<int>(pixel);
 
 			for (int i(0); i < k; ++i) {
 				int candidateIndex{ -1 };
-				DistanceType candidateDistance{ std::numeric_limits<DistanceType>::max() };
-
-				for (int j(0); j < 64; ++j) {
-					// Randomly select a valid index.
-					int index = distribution(_rng);
-
-					// Get the x/y coordinates of the sample.
-					cv::Point2i candidatePos(index % sample->width(), index / sample->width());
-
-					// TODO: Discard positions that are edge pixels and pixels that are too close to the source neighborhood.
-					//const int boundarySize = 5;		// 5px from edges.
-					//const int horizontalDistance = sample->width() / 20;
-					//const int verticalDistance = sample->height() / 20;
-					//if ((x < boundarySize || sample->width() - candidatePos.x < boundarySize) ||
-					//	(y < boundarySize || sample->height() - candidatePos.y < boundarySize) ||
-					//	(std::abs(static_cast<int>(x) - candidatePos.x) < horizontalDistance) ||
-					//	(std::abs(static_cast<int>(y) - candidatePos.y) < horizontalDistance)) {
-					//	j--;
-					//	continue;
-					//}
-
-					// Get the candidate neighborhood and compute the distance.
-					Sample::Texel candidateNeighborhood = _exemplarDescriptors.row(index);
-					DistanceType distance = cv::norm(neighborhood, candidateNeighborhood, _normType);
-
-					//// If required, factor in guidance channels.
-					//if (_guidanceMap.has_value()) {
-					//	Sample::Texel sourceGuidance, targetGuidance;
-					//	_guidanceMap.value().at(cv::Point2i(x, y), sourceGuidance);
-					//	_guidanceMap.value().at(candidatePos, targetGuidance);
-
-					//	for (size_t i(0); i < sourceGuidance.size(); ++i)
-					//		distance += abs(sourceGuidance[i] - targetGuidance[i]);
-					//}
-
-					// If the current candidate is better, keep it.
+				float candidateDistance{ std::numeric_limits<float>::max() };
+
+				for (int j(0); j < RandomProbes; ++j) {
+					// Randomly select a valid index from the stream of the current pixel.
+					const int index = CounterRandom::uniform(_seed, static_cast<std::uint64_t>(pixel), static_cast<std::uint64_t>(i * RandomProbes + j), pixels);
+
+					// Compare the candidate neighborhood and keep it, if it is better.
+					const float distance = DescriptorKernel::distance(neighborhood, _exemplarDescriptors.ptr<float>(index), dimensions, norm);
+
 					if (candidateDistance > distance) {
 						candidateDistance = distance;
 						candidateIndex = index;
 					}
 				}
 
-				// Keep most similar ones.
-				candidates.push_back(candidateIndex);
+				candidates[i] = candidateIndex;
 			}
+		}
+	});
+}
 
-			// Store the candidates.
-			int neighborhoodIndex = y * sample->width() + x;
-
-			for (int i(0); i < k; ++i)
-				_candidates.at<int>(neighborhoodIndex, i) = candidates[i];
+void CoherentIndex::initApproximateCandidates(const int k)
+{
+	typedef ::cvflann::L2<float> TDistance;
+
+	// Build a single kd-tree over the exemplar descriptors. Different from the randomized trees, it does not draw from the global generator, so the candidates are
+	// reproducible without re-seeding it.
+	// NOTE: The tree always uses euclidean distances, since the candidates only need to be similar, not optimal under the index norm.
+	const int pixels = _exemplarDescriptors.rows;
+	::cvflann::Matrix<float> dataset(_exemplarDescriptors.ptr<float>(), pixels, _exemplarDescriptors.cols);
+	::cvflann::Index<TDistance> index(dataset, ::cvflann::KDTreeSingleIndexParams());
+	index.buildIndex();
+
+	// Query the k + 1 nearest neighbors in parallel blocks, since each descriptor also finds itself.
+	tbb::parallel_for(tbb::blocked_range<int>(0, pixels, 256), [this, &index, k](const tbb::blocked_range<int>& range) {
+		const int queries = static_cast<int>(range.size());
+		cv::Mat indices(queries, k + 1, CV_32SC1), distances(queries, k + 1, CV_32FC1);
+
+		::cvflann::Matrix<float> q(_exemplarDescriptors.ptr<float>(range.begin()), queries, _exemplarDescriptors.cols);
+		::cvflann::Matrix<int> i(indices.ptr<int>(), queries, k + 1);
+		::cvflann::Matrix<float> d(distances.ptr<float>(), queries, k + 1);
+		index.knnSearch(q, i, d, k + 1, ::cvflann::SearchParams(32));
+
+		for (int r(0); r < queries; ++r) {
+			const int pixel = range.begin() + r;
+			const int* neighbors = indices.ptr<int>(r);
+			int* candidates = _candidates.ptr<int>(pixel);
+			int c(0);
+
+			// Skip the pixel itself and invalid results. If there are not enough neighbors, the pixel remains its own candidate.
+			for (int n(0); n <= k && c < k; ++n)
+				if (neighbors[n] >= 0 && neighbors[n] != pixel)
+					candidates[c++] = neighbors[n];
+
+			while (c < k)
+				candidates[c++] = pixel;
 		}
 	});
 }
@@ -131,133 +156,189 @@ cv::Mat CoherentIndex::getDescriptor(int index) const
 
 void CoherentIndex::getCoherentCandidates(const cv::Point2i& exemplarCoords, const cv::Vec2i& delta, std::vector<int>& candidates) const
 {
-	// Get the search space transformed exemplar.
-	std::shared_ptr<const Sample> exemplar;
-	_searchSpace->sample(exemplar);
-	int width = exemplar->width();
-	int height = exemplar->height();
-
 	// Make sure the coords are valid.
 	cv::Point2i coherentPos(exemplarCoords.x + delta[0], exemplarCoords.y + delta[1]);
-	Sample::wrapCoords(width, height, coherentPos);
+	Sample::wrapCoords(_exemplarWidth, _exemplarHeight, coherentPos);
 
 	// Get the k-coherent candidates.
-	int coherentIndex = coherentPos.y * width + coherentPos.x;
-	candidates = _candidates.row(coherentIndex);
+	int coherentIndex = coherentPos.y * _exemplarWidth + coherentPos.x;
+	const int* row = _candidates.ptr<int>(coherentIndex);
+	candidates.assign(row, row + _candidates.cols);
 	
 	// Also append the coherent candidate.
 	candidates.push_back(coherentIndex);
 }
 
-bool CoherentIndex::findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist) const
+int CoherentIndex::collectCoherentCandidates(const cv::Mat& uv, const cv::Point2i& at, int* candidates) const
 {
-	// Call findNearestNeighbors with k = 1.
-	std::vector<MatchType> matches;
-
-	if (!this->findNearestNeighbors(descriptors, uv, at, matches, 1, minDist))
-		return false;
-
-	match = matches.front();
-	return true;
-}
-
-bool CoherentIndex::findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& mtch, const unsigned int k, DistanceType minDist) const
-{
-	TEXTURIZE_ASSERT(uv.channels() == 2);                                      // The UV map should contain two channels, one for u and one for v coordinates.
-	TEXTURIZE_ASSERT(uv.depth() == cv::DataType<CoordinateType>::type);        // The type of the uv map should match the position type.
-	TEXTURIZE_ASSERT(k > 0 && k <= _candidatesPerDescriptor);                  // The number of candidates should be a non-zero, positive number, but also lower than k.
-
-	// TODO: k > _candidatesPerDescriptor -> collect multiple candidates from one coherent pixel.
-
-	// Get the search space transformed exemplar.
-	std::shared_ptr<const Sample> exemplar;
-	_searchSpace->sample(exemplar);
-	CoordinateType width = static_cast<CoordinateType>(exemplar->width());
-	CoordinateType height = static_cast<CoordinateType>(exemplar->height());
-	int level = static_cast<int>(log2(uv.cols));
-
-	// For each neighboring pixel, request the coherent candidate coordinates.
-	std::vector<int> candidates;
+	const CoordinateType width = static_cast<CoordinateType>(_exemplarWidth);
+	const CoordinateType height = static_cast<CoordinateType>(_exemplarHeight);
+	const int k = _candidates.cols;
+	int count(0);
 
+	// For each neighboring pixel, collect the coherent candidate and its k-coherent candidates.
 	for (int x(-1); x <= 1; ++x)
 	for (int y(-1); y <= 1; ++y) {
 		// Do not include self.
 		if (x == 0 && y == 0)
 			continue;
 
-		// Get the uv coords at the position.
+		// Get the uv coords at the position and make them absolute.
 		cv::Point2i coords(at.x + x, at.y + y);
 		Sample::wrapCoords(uv.cols, uv.rows, coords);
-		PositionType uvCoords = uv.at<PositionType>(coords);
+		const PositionType& uvCoords = uv.at<PositionType>(coords);
+		coords = cv::Point2i(static_cast<int>(uvCoords[0] * width) - x, static_cast<int>(uvCoords[1] * height) - y);
+		Sample::wrapCoords(_exemplarWidth, _exemplarHeight, coords);
 
-		// Make them absolute.
-		coords = cv::Point2i(static_cast<int>(uvCoords[0] * width), static_cast<int>(uvCoords[1] * height));
+		const int coherentIndex = coords.y * _exemplarWidth + coords.x;
+		const int* row = _candidates.ptr<int>(coherentIndex);
 
-		// Get a candidate for the neighbor and remember it.
-		std::vector<int> c;
-		this->getCoherentCandidates(coords, cv::Vec2i(-x, -y), c);
-		candidates.insert(candidates.end(), c.begin(), c.end());
-	}
+		for (int i(0); i < k; ++i)
+			candidates[count++] = row[i];
 
-	// Get the descriptor for the current sample at the requested position.
-	Sample::Texel targetGuidance, targetDescriptor = descriptors.row(at.y * uv.cols + at.x);
+		candidates[count++] = coherentIndex;
+	}
 
-	// If there is a guidance map, ensure that all guidance channels are provided in the descriptor.
-	if (_guidanceMap.has_value()) {
-		TEXTURIZE_ASSERT(targetDescriptor.size() == exemplar->channels() + _guidanceMap.value().channels());
+	// Neighboring pixels are often coherent to the same exemplar region, so remove duplicates before evaluating them.
+	std::sort(candidates, candidates + count);
+	return static_cast<int>(std::unique(candidates, candidates + count) - candidates);
+}
 
-		// Furthermore, divide the target descriptor in two parts: The actual descriptor values and the appended guidance values.
-		// NOTE: Order matters here!
-		targetGuidance = std::vector<float>(targetDescriptor.begin() + exemplar->channels(), targetDescriptor.end());
-		targetDescriptor = std::vector<float>(targetDescriptor.begin(), targetDescriptor.begin() + exemplar->channels());
-	}
+int CoherentIndex::selectNearestCandidates(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, int* indices, DistanceType* distances, const int k, DistanceType minDist) const
+{
+	TEXTURIZE_ASSERT(descriptors.type() == CV_32FC1);                          // The distance kernels operate on single-precision floating point descriptors.
 
-	// Compare each candidate descriptor with target descriptor.
-	std::vector<MatchType> matches;
+	const int dimensions = _exemplarDescriptors.cols;
+	const float* targetDescriptor = descriptors.ptr<float>(at.y * uv.cols + at.x);
+	const float* targetGuidance = nullptr;
+	int guidanceChannels(0);
 
-	for each (const auto& candidate in candidates) {
-		// Compute the position of the candidate.
-		PositionType candidatePos(static_cast<CoordinateType>(candidate % exemplar->width()) / width, static_cast<CoordinateType>(candidate / exemplar->width()) / height);
+	// If there is a guidance map, ensure that all guidance channels are provided in the descriptor. They are appended to the actual descriptor values.
+	if (_guidanceMap.has_value()) {
+		guidanceChannels = static_cast<int>(_guidanceMap.value().channels());
+		TEXTURIZE_ASSERT(descriptors.cols == dimensions + guidanceChannels);
+		targetGuidance = targetDescriptor + dimensions;
+	}
+	else {
+		TEXTURIZE_ASSERT(descriptors.cols == dimensions);
+	}
 
-		// Get the pixel descriptor of the pixel in the exemplar.
-		Sample::Texel sourceGuidance, sourceDescriptor = _exemplarDescriptors.row(candidate);
+	cv::AutoBuffer<int, CandidateBufferSize> candidates(8 * (_candidates.cols + 1));
+	cv::AutoBuffer<float, 16> sourceGuidance(std::max(guidanceChannels, 1));
+	const int count = this->collectCoherentCandidates(uv, at, candidates.data());
+	int matches(0);
 
-		// Compute the distance between the descriptors.
-		DistanceType distance = static_cast<DistanceType>(cv::norm(sourceDescriptor, targetDescriptor, _normType));
+	// Compare each candidate descriptor with target descriptor and keep the k best ones, sorted by their distance.
+	for (int c(0); c < count; ++c) {
+		const int candidate = candidates[c];
+		DistanceType distance = static_cast<DistanceType>(DescriptorKernel::distance(_exemplarDescriptors.ptr<float>(candidate), targetDescriptor, dimensions, _normType));
 
 		// If a guidance map is provided, get the guidance channel values of the candidate and factor the distance 
 		// between the guidance channels into the actual distance.
 		if (_guidanceMap.has_value()) {
-			// Get the source guidance channels.
-			_guidanceMap.value().at(candidatePos, sourceGuidance);
+			_guidanceMap.value().at(this->getPosition(candidate), sourceGuidance.data());
 
-			TEXTURIZE_ASSERT(sourceGuidance.size() == targetGuidance.size());
-
-			// Get the distance between each channel.
-			for (size_t i(0); i < sourceGuidance.size(); ++i)
+			for (int i(0); i < guidanceChannels; ++i)
 				distance += abs(sourceGuidance[i] - targetGuidance[i]);
 		}
 
-		// Discard candidates that are too similar.
-		if (minDist > distance)
+		// Discard candidates that are too similar, or worse than all current matches.
+		if (minDist > distance || (matches == k && distance >= distances[k - 1]))
 			continue;
 
-		// Add the match.
-		matches.push_back(std::make_pair<PositionType, DistanceType>(std::move(candidatePos), std::move(distance)));
+		// Insert the match into the sorted set.
+		int slot = matches < k ? matches++ : k - 1;
+
+		for (; slot > 0 && distances[slot - 1] > distance; --slot) {
+			distances[slot] = distances[slot - 1];
+			indices[slot] = indices[slot - 1];
+		}
+
+		distances[slot] = distance;
+		indices[slot] = candidate;
 	}
 
-	// Sort the matches by their distance.
-	std::sort(matches.begin(), matches.end(), [](MatchType& lhs, MatchType& rhs) {
-		return lhs.second < rhs.second;
-	});
+	return matches;
+}
+
+std::uint64_t CoherentIndex::getIdentity() const
+{
+	std::uint64_t identity = Serialization::combine(SearchIndex::getIdentity(), "CoherentIndex");
+	identity = Serialization::combine(identity, _candidatesPerDescriptor);
+	identity = Serialization::combine(identity, _seed);
+	identity = Serialization::combine(identity, static_cast<int>(_seeding));
+
+	if (_guidanceMap.has_value())
+		identity = Serialization::combine(identity, Serialization::hash(_guidanceMap.value()));
+
+	return identity;
+}
+
+bool CoherentIndex::findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist) const
+{
+	TEXTURIZE_ASSERT(uv.channels() == 2);                                      // The UV map should contain two channels, one for u and one for v coordinates.
+	TEXTURIZE_ASSERT(uv.depth() == cv::DataType<CoordinateType>::type);        // The type of the uv map should match the position type.
+
+	int index;
+	DistanceType distance;
+
+	if (this->selectNearestCandidates(descriptors, uv, at, &index, &distance, 1, minDist) == 0)
+		return false;
+
+	match = std::make_pair(this->getPosition(index), distance);
+	return true;
+}
+
+bool CoherentIndex::findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& mtch, const unsigned int k, DistanceType minDist) const
+{
+	TEXTURIZE_ASSERT(uv.channels() == 2);                                      // The UV map should contain two channels, one for u and one for v coordinates.
+	TEXTURIZE_ASSERT(uv.depth() == cv::DataType<CoordinateType>::type);        // The type of the uv map should match the position type.
+	TEXTURIZE_ASSERT(k > 0 && k <= _candidatesPerDescriptor);                  // The number of candidates should be a non-zero, positive number, but also lower than k.
+
+	// TODO: k > _candidatesPerDescriptor -> collect multiple candidates from one coherent pixel.
+
+	cv::AutoBuffer<int, 16> indices(k);
+	cv::AutoBuffer<DistanceType, 16> distances(k);
+	const int matches = this->selectNearestCandidates(descriptors, uv, at, indices.data(), distances.data(), static_cast<int>(k), minDist);
 
 	// Return the matches.
-	if (matches.size() == 0)
+	if (matches == 0)
 		return false;
-	else if (k <= matches.size())
-		mtch = std::vector<MatchType>(matches.begin(), matches.begin() + k);
-	else
-		mtch = matches;
+
+	mtch.resize(matches);
+
+	for (int m(0); m < matches; ++m)
+		mtch[m] = std::make_pair(this->getPosition(indices[m]), distances[m]);
 
 	return true;
-}
\ No newline at end of file
+}
+
+int CoherentIndex::findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist, const std::uint64_t key) const
+{
+	TEXTURIZE_ASSERT(uv.channels() == 2);                                      // The UV map should contain two channels, one for u and one for v coordinates.
+	TEXTURIZE_ASSERT(uv.depth() == cv::DataType<CoordinateType>::type);        // The type of the uv map should match the position type.
+
+	const int count = static_cast<int>(pixels.size());
+	matches.create(count, 1, cv::DataType<PositionType>::type);
+	distances.create(count, 1, cv::DataType<DistanceType>::type);
+
+	// Each pixel only reads the uv map, so all pixels of the batch can be matched in parallel.
+	tbb::parallel_for(tbb::blocked_range<int>(0, count), [&](const tbb::blocked_range<int>& range) {
+		for (int p = range.begin(); p < range.end(); ++p) {
+			int index;
+			DistanceType& distance = distances.at<DistanceType>(p);
+
+			if (this->selectNearestCandidates(descriptors, uv, pixels[p], &index, &distance, 1, minDist) == 0)
+				distance = std::numeric_limits<DistanceType>::infinity();
+			else
+				matches.at<PositionType>(p) = this->getPosition(index);
+		}
+	});
+
+	return static_cast<int>(std::count_if(distances.begin<DistanceType>(), distances.end<DistanceType>(), [](const DistanceType& distance) { return distance != std::numeric_limits<DistanceType>::infinity(); }));
+}
+
+CoherentIndex::PositionType CoherentIndex::getPosition(const int index) const
+{
+	return PositionType(static_cast<CoordinateType>(index % _exemplarWidth) / _exemplarWidth, static_cast<CoordinateType>(index / _exemplarWidth) / _exemplarHeight);
+}
@@ -2,6 +2,26 @@
 
 #include <sampling.hpp>
 
+#include <tbb/parallel_for.h>
+
+#include "DescriptorKernel.h"
+#include "Serialization.h"
+
+namespace {
+	/// \brief Returns `true`, if two planar samples share the storage of all their channels.
+	static bool shareChannels(const Sample& a, const Sample& b)
+	{
+		if (a.getLayout() != Sample::Layout::Planar || b.getLayout() != Sample::Layout::Planar || a.channels() != b.channels() || a.size() != b.size())
+			return false;
+
+		for (int c(0); c < static_cast<int>(a.channels()); ++c)
+			if (a.getChannel(c).data != b.getChannel(c).data)
+				return false;
+
+		return true;
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///// Descriptor extractor implementation                                                     /////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -11,55 +31,26 @@ std::vector<float> DescriptorExtractor::getProxyPixel(const Sample& exemplar, co
 	TEXTURIZE_ASSERT(delta[0] >= -1 && delta[0] <= 1);
 	TEXTURIZE_ASSERT(delta[1] >= -1 && delta[1] <= 1);
 
-	std::vector<std::vector<float>> neighborhood(3);
+	const int channels = static_cast<int>(exemplar.channels());
+	cv::AutoBuffer<float> neighborhood(channels * 3);
 
-	exemplar.at(cv::Point2i(at.x + delta[0], at.y + delta[1]), neighborhood[0]);
-	exemplar.at(cv::Point2i(at.x + (delta[0] * 2), at.y + delta[1]), neighborhood[1]);
-	exemplar.at(cv::Point2i(at.x + delta[0], at.y + (delta[1] * 2)), neighborhood[2]);
+	exemplar.at(cv::Point2i(at.x + delta[0], at.y + delta[1]), neighborhood.data());
+	exemplar.at(cv::Point2i(at.x + (delta[0] * 2), at.y + delta[1]), neighborhood.data() + channels);
+	exemplar.at(cv::Point2i(at.x + delta[0], at.y + (delta[1] * 2)), neighborhood.data() + channels * 2);
 
-	std::vector<float> result(exemplar.channels());
+	std::vector<float> result(channels);
 
-	for (int i(0); i < exemplar.channels(); ++i)
-		result[i] = (neighborhood[0][i] + neighborhood[1][i] + neighborhood[2][i]) / 3.f;
+	for (int i(0); i < channels; ++i)
+		result[i] = (neighborhood[i] + neighborhood[channels + i] + neighborhood[channels * 2 + i]) / 3.f;
 
 	return result;
 }
 
 std::vector<float> DescriptorExtractor::getProxyPixel(const Sample& exemplar, const cv::Mat& uv, const cv::Point2i& at, const cv::Vec2i& delta)
 {
-	TEXTURIZE_ASSERT(uv.type() == CV_32FC2);						// The UV-Map must be a two-channel single-precision floating point matrix.
-	//TEXTURIZE_ASSERT(uv.size() == sample.size());					// The UV-Map must be equally sized as the sample.
-	TEXTURIZE_ASSERT(delta[0] >= -1 && delta[0] <= 1);
-	TEXTURIZE_ASSERT(delta[1] >= -1 && delta[1] <= 1);
-
-	// Resolve the pixel coordinates from the UV-Map.
-	cv::Vec2f coords[3];
-	cv::Point2i point;
-
-	point = cv::Point2i(at.x + delta[0], at.y + delta[1]);
-	Sample::wrapCoords(uv.cols, uv.rows, point);
-	coords[0] = uv.at<cv::Vec2f>(point);
-
-	point = cv::Point2i(at.x + (delta[0] * 2), at.y + delta[1]);
-	Sample::wrapCoords(uv.cols, uv.rows, point);
-	coords[1] = uv.at<cv::Vec2f>(point);
-
-	point = cv::Point2i(at.x + delta[0], at.y + (delta[1] * 2));
-	Sample::wrapCoords(uv.cols, uv.rows, point);
-	coords[2] = uv.at<cv::Vec2f>(point);
-
-	// Get the actual pixel values.
-	std::vector<std::vector<float>> neighborhood(3);
-
-	exemplar.at(coords[0], neighborhood[0]);
-	exemplar.at(coords[1], neighborhood[1]);
-	exemplar.at(coords[2], neighborhood[2]);
-
 	// Calculate the average values and store it within the result vector.
 	std::vector<float> result(exemplar.channels());
-
-	for (int i(0); i < exemplar.channels(); ++i)
-		result[i] = (neighborhood[0][i] + neighborhood[1][i] + neighborhood[2][i]) / 3.f;
+	DescriptorExtractor::getProxyPixel(exemplar, uv, at, delta, result.data());
 
 	return result;
 }
@@ -87,16 +78,17 @@ void DescriptorExtractor::getProxyPixel(const Sample& exemplar, const cv::Mat& u
 	Sample::wrapCoords(uv.cols, uv.rows, point);
 	coords[2] = uv.at<cv::Vec2f>(point);
 
-	// Get the actual pixel values.
-	std::vector<std::vector<float>> neighborhood(3);
+	// Get the actual pixel values. The buffer is allocated on the stack for common channel counts.
+	const int channels = static_cast<int>(exemplar.channels());
+	cv::AutoBuffer<float> neighborhood(channels * 3);
 
-	exemplar.at(coords[0], neighborhood[0]);
-	exemplar.at(coords[1], neighborhood[1]);
-	exemplar.at(coords[2], neighborhood[2]);
+	exemplar.at(coords[0], neighborhood.data());
+	exemplar.at(coords[1], neighborhood.data() + channels);
+	exemplar.at(coords[2], neighborhood.data() + channels * 2);
 
 	// Calculate the average values and store it within the result vector.
-	for (int i(0); i < exemplar.channels(); ++i)
-		rowPtr[i] = (neighborhood[0][i] + neighborhood[1][i] + neighborhood[2][i]) / 3.f;
+	for (int i(0); i < channels; ++i)
+		rowPtr[i] = (neighborhood[i] + neighborhood[channels + i] + neighborhood[channels * 2 + i]) / 3.f;
 }
 
 cv::Mat DescriptorExtractor::createContinuousUvMap(const Sample& exemplar) const
@@ -112,6 +104,10 @@ cv::Mat DescriptorExtractor::createContinuousUvMap(const Sample& exemplar) const
 	return uv;
 }
 
+void DescriptorExtractor::fit(const Sample& exemplar)
+{
+}
+
 cv::Mat DescriptorExtractor::calculateNeighborhoodDescriptors(const Sample& exemplar) const
 {
 	// Create a UV-Map for the sample.
@@ -127,6 +123,30 @@ cv::Mat DescriptorExtractor::calculateNeighborhoodDescriptors(const Sample& exem
 	return this->getPixelNeighborhoods(exemplar, uv);
 }
 
+void DescriptorExtractor::updateNeighborhoodDescriptors(const Sample& exemplar, const cv::Mat& uv, const cv::Mat& changed, cv::Mat& descriptors) const
+{
+	TEXTURIZE_ASSERT(changed.type() == CV_8UC1);					// The change mask must be a single-channel 8 bit matrix.
+	TEXTURIZE_ASSERT(changed.size() == uv.size());					// The change mask must be equally sized as the UV-Map.
+
+	// Only recalculate the descriptors, if there are any changes.
+	if (cv::countNonZero(changed) == 0)
+		return;
+
+	// Copy the descriptors in place, so that column ranges of a larger matrix are updated, too.
+	cv::Mat result = this->calculateNeighborhoodDescriptors(exemplar, uv);
+	TEXTURIZE_ASSERT(result.size() == descriptors.size());			// The descriptors must have been calculated for the same UV-Map.
+
+	result.copyTo(descriptors);
+}
+
+void DescriptorExtractor::save(std::ostream& stream) const
+{
+}
+
+void DescriptorExtractor::restore(std::istream& stream)
+{
+}
+
 cv::Mat DescriptorExtractor::getPixelNeighborhoods(const Sample& exemplar, const cv::Mat& uv) const
 {
 	TEXTURIZE_ASSERT(uv.type() == CV_32FC2);						// The UV-Map must be a two-channel single-precision floating point matrix.
@@ -143,39 +163,85 @@ cv::Mat DescriptorExtractor::getPixelNeighborhoods(const Sample& exemplar, const
 	//		Get color values from exemplar for each neighborhood pixel
 	//      Calculate proxy pixel color values
 	//      Return 4xN vector of proxy pixel color values.
-	uv.forEach<cv::Vec2f>([&neighborhoods, &exemplar, &size, &uv](const cv::Vec2f& at, const int* idx) -> void {
-		std::vector<float> pixels[4], rowDesc;
-		rowDesc.reserve(exemplar.channels() * 4);
+	const int channels = static_cast<int>(exemplar.channels());
+
+	uv.forEach<cv::Vec2f>([&neighborhoods, &exemplar, &size, &uv, channels](const cv::Vec2f& at, const int* idx) -> void {
+		// Write the proxy pixels directly into the matrix row.
+		float* row = neighborhoods.ptr<float>(idx[0] * size.width + idx[1]);
+		const cv::Point2i pixel(idx[1], idx[0]);
 
 		// Top Left
-		pixels[0] = DescriptorExtractor::getProxyPixel(exemplar, uv, cv::Point2i(idx[1], idx[0]), cv::Vec2i(-1, -1));
-		rowDesc.insert(rowDesc.end(), pixels[0].begin(), pixels[0].end());
+		DescriptorExtractor::getProxyPixel(exemplar, uv, pixel, cv::Vec2i(-1, -1), row);
 
 		// Bottom Left
-		pixels[1] = DescriptorExtractor::getProxyPixel(exemplar, uv, cv::Point2i(idx[1], idx[0]), cv::Vec2i(-1, 1));
-		rowDesc.insert(rowDesc.end(), pixels[1].begin(), pixels[1].end());
+		DescriptorExtractor::getProxyPixel(exemplar, uv, pixel, cv::Vec2i(-1, 1), row + channels);
 
 		// Top Right
-		pixels[2] = DescriptorExtractor::getProxyPixel(exemplar, uv, cv::Point2i(idx[1], idx[0]), cv::Vec2i(1, -1));
-		rowDesc.insert(rowDesc.end(), pixels[2].begin(), pixels[2].end());
+		DescriptorExtractor::getProxyPixel(exemplar, uv, pixel, cv::Vec2i(1, -1), row + channels * 2);
 
 		// Bottom Right
-		pixels[3] = DescriptorExtractor::getProxyPixel(exemplar, uv, cv::Point2i(idx[1], idx[0]), cv::Vec2i(1, 1));
-		rowDesc.insert(rowDesc.end(), pixels[3].begin(), pixels[3].end());
-
-		// Copy the neighborhood descriptor to the matrix row.
-		auto* row = neighborhoods.ptr<float>(idx[0] * size.width + idx[1]);
-		std::copy(rowDesc.begin(), rowDesc.end(), row);
+		DescriptorExtractor::getProxyPixel(exemplar, uv, pixel, cv::Vec2i(1, 1), row + channels * 3);
 	});
 
 	// Finally, transpose the neighborhood descriptor matrix, so that each row stores one descriptor.
 	return neighborhoods.t();
 }
 
+cv::Mat DescriptorExtractor::getPixelNeighborhoods(const Sample& exemplar, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels) const
+{
+	TEXTURIZE_ASSERT(uv.type() == CV_32FC2);						// The UV-Map must be a two-channel single-precision floating point matrix.
+
+	// Create a matrix that stores 4 proxy pixels of each requested pixel in a row.
+	const int channels = static_cast<int>(exemplar.channels());
+	cv::Mat neighborhoods(static_cast<int>(pixels.size()), channels * 4, CV_32FC1);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, pixels.size()), [&neighborhoods, &exemplar, &uv, &pixels, channels](const tbb::blocked_range<size_t>& range) {
+		for (size_t i = range.begin(); i < range.end(); ++i) {
+			float* row = neighborhoods.ptr<float>(static_cast<int>(i));
+
+			// Store the proxy pixels in the same order as the full extraction: top left, bottom left, top right and bottom right.
+			DescriptorExtractor::getProxyPixel(exemplar, uv, pixels[i], cv::Vec2i(-1, -1), row);
+			DescriptorExtractor::getProxyPixel(exemplar, uv, pixels[i], cv::Vec2i(-1, 1), row + channels);
+			DescriptorExtractor::getProxyPixel(exemplar, uv, pixels[i], cv::Vec2i(1, -1), row + channels * 2);
+			DescriptorExtractor::getProxyPixel(exemplar, uv, pixels[i], cv::Vec2i(1, 1), row + channels * 3);
+		}
+	});
+
+	return neighborhoods;
+}
+
+std::vector<cv::Point2i> DescriptorExtractor::getAffectedPixels(const cv::Mat& changed) const
+{
+	TEXTURIZE_ASSERT(changed.type() == CV_8UC1);					// The change mask must be a single-channel 8 bit matrix.
+
+	// Proxy pixels are sampled at offsets of up to two pixels along each axis, so a changed texel affects all descriptors within a 5x5 window around it. Pad the
+	// mask toroidally before dilating it, so that changes close to the border also affect the pixels on the opposite side.
+	const int extent = 2;
+	cv::Mat padded, dilated;
+	cv::copyMakeBorder(changed, padded, extent, extent, extent, extent, cv::BORDER_WRAP);
+	cv::dilate(padded, dilated, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2 * extent + 1, 2 * extent + 1)));
+
+	std::vector<cv::Point2i> pixels;
+	cv::findNonZero(dilated(cv::Rect(extent, extent, changed.cols, changed.rows)), pixels);
+
+	return pixels;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///// PCA-based descriptor extractor implementation                                           /////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+PCADescriptorExtractor::PCADescriptorExtractor(const NeighborhoodSampling& sampling) :
+	_sampling(sampling)
+{
+	TEXTURIZE_ASSERT(sampling.fraction > 0.f && sampling.fraction <= 1.f);	// The sampling fraction must be within (0, 1].
+}
+
+const ProjectionReport& PCADescriptorExtractor::getProjectionReport() const
+{
+	return _report;
+}
+
 cv::Mat PCADescriptorExtractor::calculateNeighborhoodDescriptors(const Sample& exemplar) const
 {
 	// Create a UV-Map for the sample.
@@ -187,44 +253,186 @@ cv::Mat PCADescriptorExtractor::calculateNeighborhoodDescriptors(const Sample& e
 
 cv::Mat PCADescriptorExtractor::calculateNeighborhoodDescriptors(const Sample& exemplar, const cv::Mat& uv) const
 {
-	// Calculate the descriptors.
-	return this->calculateNeighborhoodDescriptors(exemplar, uv, this->_projector);
+	TEXTURIZE_ASSERT(uv.type() == CV_32FC2);						// The UV-Map must be a two-channel single-precision floating point matrix.
+	TEXTURIZE_ASSERT(_projector.get() != nullptr);					// The projector must have been fit to the exemplar.
+
+	// Gather, average and project the proxy pixels of each pixel directly into the descriptor matrix. The kernel reads the texels from an interleaved exemplar, so
+	// that all channels of a texel can be loaded at once.
+	Sample converted;
+	const DescriptorKernel::Texels texels = DescriptorKernel::view(this->getInterleaved(exemplar, converted));
+	cv::Mat descriptors(uv.rows * uv.cols, _basis.rows, CV_32FC1);
+
+	tbb::parallel_for(tbb::blocked_range<int>(0, uv.rows), [this, &texels, &uv, &descriptors](const tbb::blocked_range<int>& range) {
+		// The proxy buffer is padded with zeros, that are never overwritten.
+		std::vector<float> proxies(_basis.cols, 0.f);
+
+		for (int y = range.begin(); y < range.end(); ++y)
+		for (int x = 0; x < uv.cols; ++x) {
+			DescriptorKernel::gather(texels, uv, x, y, proxies.data());
+			DescriptorKernel::project(proxies.data(), _basis, _bias, descriptors.ptr<float>(y * uv.cols + x));
+		}
+	});
+
+	return descriptors;
+}
+
+void PCADescriptorExtractor::updateNeighborhoodDescriptors(const Sample& exemplar, const cv::Mat& uv, const cv::Mat& changed, cv::Mat& descriptors) const
+{
+	TEXTURIZE_ASSERT(changed.type() == CV_8UC1);					// The change mask must be a single-channel 8 bit matrix.
+	TEXTURIZE_ASSERT(changed.size() == uv.size());					// The change mask must be equally sized as the UV-Map.
+	TEXTURIZE_ASSERT(descriptors.rows == uv.rows * uv.cols);		// The descriptors must have been calculated for the same UV-Map.
+	TEXTURIZE_ASSERT(descriptors.cols == exemplar.channels());		// The descriptors must have been calculated for the same exemplar.
+	TEXTURIZE_ASSERT(_projector.get() != nullptr);					// The projector must have been fit to the exemplar.
+
+	// Get all pixels, whose descriptors need to be refreshed.
+	std::vector<cv::Point2i> pixels = this->getAffectedPixels(changed);
+
+	if (pixels.empty())
+		return;
+
+	// Re-project the affected pixels directly into the descriptor matrix.
+	Sample converted;
+	const DescriptorKernel::Texels texels = DescriptorKernel::view(this->getInterleaved(exemplar, converted));
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, pixels.size()), [this, &texels, &uv, &pixels, &descriptors](const tbb::blocked_range<size_t>& range) {
+		std::vector<float> proxies(_basis.cols, 0.f);
+
+		for (size_t i = range.begin(); i < range.end(); ++i) {
+			const cv::Point2i& pixel = pixels[i];
+			DescriptorKernel::gather(texels, uv, pixel.x, pixel.y, proxies.data());
+			DescriptorKernel::project(proxies.data(), _basis, _bias, descriptors.ptr<float>(pixel.y * uv.cols + pixel.x));
+		}
+	});
+}
+
+void PCADescriptorExtractor::save(std::ostream& stream) const
+{
+	const int fit = _projector.get() == nullptr ? 0 : 1;
+	Serialization::write(stream, &fit, 1);
+
+	if (fit == 0)
+		return;
+
+	Serialization::write(stream, _projector->eigenvectors);
+	Serialization::write(stream, _projector->eigenvalues);
+	Serialization::write(stream, _projector->mean);
+	Serialization::write(stream, _basis);
+	Serialization::write(stream, _bias);
+
+	const std::uint64_t samples = static_cast<std::uint64_t>(_report.samples);
+	const double variances[] = { _report.explainedVariance, _report.validatedVariance, _report.exactVariance };
+	Serialization::write(stream, &samples, 1);
+	Serialization::write(stream, &_report.components, 1);
+	Serialization::write(stream, variances, sizeof(variances) / sizeof(double));
 }
 
-cv::Mat PCADescriptorExtractor::calculateNeighborhoodDescriptors(const Sample& exemplar, const cv::Mat& uv, std::unique_ptr<cv::PCA>& projector) const
+void PCADescriptorExtractor::restore(std::istream& stream)
 {
-	// Get the pixel neighborhoods;
-	cv::Mat projected, neighborhoods = this->getPixelNeighborhoods(exemplar, uv);
+	int fit(0);
+	Serialization::read(stream, &fit, 1);
 
-	// If the projector is provided, use it - otherwise create a new one and return it.
-	if (projector.get() == nullptr)
-		projector = std::make_unique<cv::PCA>(neighborhoods, cv::Mat(), cv::PCA::DATA_AS_COL, static_cast<int>(exemplar.channels()));
+	if (!stream.good())
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The stream does not contain an extractor state.");
 
-	// Project the pixel neighborhoods for efficient search.
-	projected = projector->project(neighborhoods);
+	// If the projector has not been fit when the state has been written, the extractor must be fit again before it can be used.
+	if (fit == 0)
+	{
+		_projector.reset();
+		_basis.release();
+		_bias.release();
+		_report = ProjectionReport();
+		_exemplar = _texels = Sample();
+		return;
+	}
 
-	// Return the projected neighborhoods.
-	TEXTURIZE_ASSERT(projected.rows == exemplar.channels());
+	auto projector = std::make_unique<cv::PCA>();
+	Serialization::read(stream, projector->eigenvectors);
+	Serialization::read(stream, projector->eigenvalues);
+	Serialization::read(stream, projector->mean);
+	Serialization::read(stream, _basis);
+	Serialization::read(stream, _bias);
+
+	std::uint64_t samples(0);
+	double variances[3];
+	Serialization::read(stream, &samples, 1);
+	Serialization::read(stream, &_report.components, 1);
+	Serialization::read(stream, variances, sizeof(variances) / sizeof(double));
+
+	if (!stream.good() || _basis.type() != CV_32FC1 || _bias.type() != CV_32FC1 || _bias.cols != _basis.rows)
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The stream does not contain a valid projector.");
+
+	_report.samples = static_cast<size_t>(samples);
+	_report.explainedVariance = variances[0];
+	_report.validatedVariance = variances[1];
+	_report.exactVariance = variances[2];
+	_projector = std::move(projector);
+	_exemplar = _texels = Sample();
+}
 
-	return projected.t();
+const Sample& PCADescriptorExtractor::getInterleaved(const Sample& exemplar, Sample& converted) const
+{
+	// Appearance space exemplars are already interleaved, so they can be read directly.
+	if (exemplar.getLayout() == Sample::Layout::Interleaved)
+		return exemplar;
+
+	// The fitted exemplar has been converted once, when the projector has been fit.
+	if (shareChannels(exemplar, _exemplar))
+		return _texels;
+
+	// Other samples, e.g. the search space of a style transfer target, are converted for this call only.
+	converted = exemplar;
+	converted.setLayout(Sample::Layout::Interleaved);
+	return converted;
 }
 
-cv::Mat PCADescriptorExtractor::calculateNeighborhoodDescriptors(const Sample& exemplar, const cv::Mat& uv, const std::unique_ptr<cv::PCA>& projector) const
+void PCADescriptorExtractor::fit(const Sample& exemplar)
 {
-	// Get the pixel neighborhoods;
-	cv::Mat projected, neighborhoods = this->getPixelNeighborhoods(exemplar, uv);
+	const cv::Mat uv = this->createContinuousUvMap(exemplar);
+
+	// Keep the exemplar and convert it into the layout read by the descriptor kernels once, so that it does not get converted whenever it gets described.
+	_exemplar = exemplar;
+	_texels = exemplar;
+	_texels.setLayout(Sample::Layout::Interleaved);
+
+	// Gather the neighborhoods of the selected pixels, or of all pixels, if no sub-sampling is requested.
+	const bool sampled = _sampling.fraction < 1.f;
+	const int components = static_cast<int>(exemplar.channels());
+	cv::Mat neighborhoods = sampled ? cv::Mat(this->getPixelNeighborhoods(exemplar, uv, _sampling.select(uv.size())).t()) : this->getPixelNeighborhoods(exemplar, uv);
+
+	_projector = std::make_unique<cv::PCA>(neighborhoods, cv::Mat(), cv::PCA::DATA_AS_COL, components);
+
+	// The total variance of the neighborhoods equals the sum of the variances along each dimension.
+	double totalVariance(0.);
 
-	// If the projector is provided, use it - otherwise create a new one.
-	if (projector.get() != nullptr)
-		projected = projector->project(neighborhoods);
-	else
+	for (int d(0); d < neighborhoods.rows; ++d)
 	{
-		std::unique_ptr<cv::PCA> prj = std::make_unique<cv::PCA>(neighborhoods, cv::Mat(), cv::PCA::DATA_AS_COL, static_cast<int>(exemplar.channels()));
-		projected = prj->project(neighborhoods);
+		cv::Scalar mean, deviation;
+		cv::meanStdDev(neighborhoods.row(d), mean, deviation);
+		totalVariance += deviation[0] * deviation[0];
 	}
 
-	// Return the projected neighborhoods.
-	TEXTURIZE_ASSERT(projected.rows == exemplar.channels());
+	_report.samples = static_cast<size_t>(neighborhoods.cols);
+	_report.components = _projector->eigenvectors.rows;
+	_report.explainedVariance = totalVariance > 0. ? cv::sum(_projector->eigenvalues)[0] / totalVariance : 1.;
+	_report.validatedVariance = _report.exactVariance = -1.;
 
-	return projected.t();
-}
\ No newline at end of file
+	// Compare the projector against an exact fit to all neighborhoods, if requested.
+	if (_sampling.validate)
+	{
+		cv::Mat covariance, mean;
+		cv::calcCovarMatrix(sampled ? this->getPixelNeighborhoods(exemplar, uv) : neighborhoods, covariance, mean, cv::COVAR_NORMAL | cv::COVAR_COLS | cv::COVAR_SCALE, CV_64F);
+
+		_report.validatedVariance = ProjectionReport::getExplainedVariance(_projector->eigenvectors, covariance);
+		_report.exactVariance = ProjectionReport::getExactVariance(covariance, _report.components);
+	}
+
+	// Copy the eigenvectors into a zero-padded basis and pre-compute the projected mean, so that projecting a neighborhood x equals evaluating E * x - E * mean.
+	const cv::Mat& eigenvectors = _projector->eigenvectors;
+	cv::Mat eigenvectors32, mean32;
+	eigenvectors.convertTo(eigenvectors32, CV_32F);
+	_projector->mean.reshape(1, eigenvectors.cols).convertTo(mean32, CV_32F);
+
+	_basis = cv::Mat::zeros(eigenvectors.rows, DescriptorKernel::padded(eigenvectors.cols), CV_32FC1);
+	eigenvectors32.copyTo(_basis.colRange(0, eigenvectors.cols));
+	_bias = -(eigenvectors32 * mean32).t();
+}
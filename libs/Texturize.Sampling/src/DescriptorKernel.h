@@ -0,0 +1,320 @@
+#pragma once
+
+#include <sampling.hpp>
+
+#include <cmath>
+#include <limits>
+
+// Select the widest instruction set, the compiler has been configured for. MSVC does not define `__SSE2__`, but SSE2 is always available on x64 targets.
+#if defined(__AVX2__)
+#define TEXTURIZE_KERNEL_AVX2
+#include <immintrin.h>
+
+// MSVC enables FMA together with AVX2, but does not define `__FMA__`. Other compilers require FMA to be enabled on its own.
+#if defined(__FMA__) || defined(_MSC_VER)
+#define TEXTURIZE_KERNEL_FMA
+#endif
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURIZE_KERNEL_SSE2
+#include <emmintrin.h>
+#endif
+
+/// \brief Contains the fused kernel, that calculates projected runtime neighborhood descriptors directly from an exemplar, as well as the distance kernels used to
+/// compare descriptors.
+///
+/// The kernels do not allocate any memory. It gathers the three texels of each L-shaped proxy pixel footprint from an interleaved exemplar, averages them and projects
+/// the resulting proxy pixels onto a basis, that must be padded to a multiple of `DescriptorKernel::Alignment` columns with zeros.
+///
+/// \see Texturize::DescriptorExtractor::getProxyPixel
+namespace DescriptorKernel {
+
+	/// \brief The number of floats, the rows of a projection basis need to be padded to.
+	static const int Alignment = 8;
+
+	/// \brief Returns the number of floats required to store `n` values, padded to a multiple of `Alignment`.
+	static inline int padded(const int n)
+	{
+		return (n + Alignment - 1) & ~(Alignment - 1);
+	}
+
+#if defined(TEXTURIZE_KERNEL_AVX2)
+	/// \brief Returns `a * b + c`. The operation is fused, if the compiler has been configured for FMA.
+	static inline __m256 multiplyAdd(const __m256 a, const __m256 b, const __m256 c)
+	{
+#if defined(TEXTURIZE_KERNEL_FMA)
+		return _mm256_fmadd_ps(a, b, c);
+#else
+		return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+	}
+#endif
+
+	/// \brief Calculates the dot product of two vectors, whose length is a multiple of `Alignment`.
+	static inline float dot(const float* a, const float* b, const int n)
+	{
+#if defined(TEXTURIZE_KERNEL_AVX2)
+		__m256 acc = _mm256_setzero_ps();
+
+		for (int i(0); i < n; i += 8)
+			acc = multiplyAdd(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc);
+
+		__m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+		return _mm_cvtss_f32(sum);
+#elif defined(TEXTURIZE_KERNEL_SSE2)
+		__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+
+		for (int i(0); i < n; i += 8) {
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+		}
+
+		__m128 sum = _mm_add_ps(acc0, acc1);
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+		return _mm_cvtss_f32(sum);
+#else
+		float sum(0.f);
+
+		for (int i(0); i < n; ++i)
+			sum += a[i] * b[i];
+
+		return sum;
+#endif
+	}
+
+	/// \brief Calculates the squared euclidean distance between two vectors of arbitrary length.
+	static inline float distanceL2Sqr(const float* a, const float* b, const int n)
+	{
+		int i(0);
+		float sum(0.f);
+
+#if defined(TEXTURIZE_KERNEL_AVX2)
+		__m256 acc = _mm256_setzero_ps();
+
+		for (; i + 8 <= n; i += 8) {
+			const __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+			acc = multiplyAdd(d, d, acc);
+		}
+
+		__m128 acc4 = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+#elif defined(TEXTURIZE_KERNEL_SSE2)
+		__m128 acc4 = _mm_setzero_ps();
+#endif
+#if defined(TEXTURIZE_KERNEL_AVX2) || defined(TEXTURIZE_KERNEL_SSE2)
+		for (; i + 4 <= n; i += 4) {
+			const __m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+			acc4 = _mm_add_ps(acc4, _mm_mul_ps(d, d));
+		}
+
+		acc4 = _mm_add_ps(acc4, _mm_movehl_ps(acc4, acc4));
+		acc4 = _mm_add_ss(acc4, _mm_shuffle_ps(acc4, acc4, 1));
+		sum = _mm_cvtss_f32(acc4);
+#endif
+
+		for (; i < n; ++i)
+			sum += (a[i] - b[i]) * (a[i] - b[i]);
+
+		return sum;
+	}
+
+	/// \brief Calculates the manhattan distance between two vectors of arbitrary length.
+	static inline float distanceL1(const float* a, const float* b, const int n)
+	{
+		int i(0);
+		float sum(0.f);
+
+#if defined(TEXTURIZE_KERNEL_AVX2) || defined(TEXTURIZE_KERNEL_SSE2)
+		// Clearing the sign bit yields the absolute value.
+		const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+		__m128 acc = _mm_setzero_ps();
+
+		for (; i + 4 <= n; i += 4)
+			acc = _mm_add_ps(acc, _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)), mask));
+
+		acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+		acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+		sum = _mm_cvtss_f32(acc);
+#endif
+
+		for (; i < n; ++i)
+			sum += std::abs(a[i] - b[i]);
+
+		return sum;
+	}
+
+	/// \brief Calculates the distance between two vectors, the same way `cv::norm` does for the provided norm type.
+	/// \param a The first vector.
+	/// \param b The second vector.
+	/// \param n The number of elements of both vectors.
+	/// \param normType The norm used to measure the distance. `cv::NORM_L1`, `cv::NORM_L2` and `cv::NORM_L2SQR` are vectorized, other norms fall back to `cv::norm`.
+	static inline float distance(const float* a, const float* b, const int n, const int normType)
+	{
+		switch (normType)
+		{
+		case cv::NORM_L1:
+			return distanceL1(a, b, n);
+		case cv::NORM_L2:
+			return std::sqrt(distanceL2Sqr(a, b, n));
+		case cv::NORM_L2SQR:
+			return distanceL2Sqr(a, b, n);
+		default:
+			return static_cast<float>(cv::norm(cv::Mat(1, n, CV_32FC1, const_cast<float*>(a)), cv::Mat(1, n, CV_32FC1, const_cast<float*>(b)), normType));
+		}
+	}
+
+	/// \brief Returns a norm, that orders distances the same way as the provided one, but is cheaper to evaluate.
+	///
+	/// Since the square root is monotonic, squared euclidean distances can be used, whenever distances are only compared against each other.
+	static inline int rankingNorm(const int normType)
+	{
+		return normType == cv::NORM_L2 ? cv::NORM_L2SQR : normType;
+	}
+
+	/// \brief Stores the k best matches of a query, sorted by increasing distance.
+	///
+	/// The selection does not own any memory. The distances and indices are stored in buffers, that must be able to hold `k` elements each.
+	struct Selection {
+		/// \brief A buffer, that receives the distances of the matches.
+		float* distances;
+		/// \brief A buffer, that receives the indices of the matches.
+		int* indices;
+		/// \brief The maximum number of matches.
+		int k;
+		/// \brief The current number of matches.
+		int count;
+		/// \brief The minimum distance of a match.
+		float minimum;
+
+		/// \brief Returns the distance, a candidate must fall below in order to be selected.
+		float worst() const
+		{
+			return count < k ? std::numeric_limits<float>::infinity() : distances[k - 1];
+		}
+
+		/// \brief Returns true, if an index has already been selected.
+		bool contains(const int index) const
+		{
+			for (int i(0); i < count; ++i)
+				if (indices[i] == index)
+					return true;
+
+			return false;
+		}
+
+		/// \brief Selects a candidate, if it is better than the current matches.
+		void insert(const float distance, const int index)
+		{
+			// Discard candidates that are too similar, or worse than all current matches.
+			if (distance < minimum || !(distance < this->worst()))
+				return;
+
+			int slot = count < k ? count++ : k - 1;
+
+			for (; slot > 0 && distances[slot - 1] > distance; --slot) {
+				distances[slot] = distances[slot - 1];
+				indices[slot] = indices[slot - 1];
+			}
+
+			distances[slot] = distance;
+			indices[slot] = index;
+		}
+	};
+
+	/// \brief Stores the average of three texels with `n` channels.
+	static inline void average(const float* a, const float* b, const float* c, float* result, const int n)
+	{
+		int i(0);
+
+#if defined(TEXTURIZE_KERNEL_AVX2)
+		const __m256 three = _mm256_set1_ps(3.f);
+
+		for (; i + 8 <= n; i += 8)
+			_mm256_storeu_ps(result + i, _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)), _mm256_loadu_ps(c + i)), three));
+#endif
+#if defined(TEXTURIZE_KERNEL_AVX2) || defined(TEXTURIZE_KERNEL_SSE2)
+		const __m128 three4 = _mm_set1_ps(3.f);
+
+		for (; i + 4 <= n; i += 4)
+			_mm_storeu_ps(result + i, _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)), _mm_loadu_ps(c + i)), three4));
+#endif
+
+		for (; i < n; ++i)
+			result[i] = (a[i] + b[i] + c[i]) / 3.f;
+	}
+
+	/// \brief Describes the storage of an interleaved exemplar.
+	struct Texels {
+		/// \brief The texel storage, as returned by `Sample::getTexels`.
+		const cv::Mat& data;
+		/// \brief The width of the exemplar in texels.
+		int width;
+		/// \brief The height of the exemplar in texels.
+		int height;
+		/// \brief The number of values between two texels.
+		int stride;
+		/// \brief The number of channels of each texel.
+		int channels;
+	};
+
+	/// \brief Returns a view of the texels of an interleaved sample.
+	static inline Texels view(const Texturize::Sample& sample)
+	{
+		return { sample.getTexels(), sample.width(), sample.height(), sample.getTexelStride(), static_cast<int>(sample.channels()) };
+	}
+
+	/// \brief Returns a pointer to the exemplar texel, that is referenced by the uv map at a (possibly out of range) pixel coordinate.
+	///
+	/// The lookup follows the same rules as `Sample::at`, so that the kernel resolves the same texels as the reference implementation.
+	static inline const float* texel(const Texels& texels, const cv::Mat& uv, int x, int y)
+	{
+		Texturize::Sample::wrapCoords(uv.cols, uv.rows, x, y);
+		const cv::Vec2f& coords = uv.at<cv::Vec2f>(y, x);
+
+		int tx = static_cast<int>(texels.width * coords[0]);
+		int ty = static_cast<int>(texels.height * coords[1]);
+		Texturize::Sample::wrapCoords(texels.width, texels.height, tx, ty);
+
+		return texels.data.ptr<float>(ty) + tx * texels.stride;
+	}
+
+	/// \brief Gathers the four proxy pixels of a pixel in the uv map.
+	/// \param texels The texels of an interleaved exemplar.
+	/// \param uv The uv map used to resolve the pixel coordinates inside the exemplar.
+	/// \param x The x coordinate of the pixel within the uv map.
+	/// \param y The y coordinate of the pixel within the uv map.
+	/// \param proxies A buffer that receives the proxy pixels. It must be able to store four times the number of exemplar channels.
+	///
+	/// The proxy pixels are stored in the same order as `DescriptorExtractor::getPixelNeighborhoods` does: top left, bottom left, top right and bottom right.
+	static inline void gather(const Texels& texels, const cv::Mat& uv, const int x, const int y, float* proxies)
+	{
+		static const int directions[4][2] = { { -1, -1 }, { -1, 1 }, { 1, -1 }, { 1, 1 } };
+		const int channels = texels.channels;
+
+		for (int p(0); p < 4; ++p) {
+			const int dx = directions[p][0], dy = directions[p][1];
+
+			average(
+				texel(texels, uv, x + dx, y + dy),
+				texel(texels, uv, x + dx * 2, y + dy),
+				texel(texels, uv, x + dx, y + dy * 2),
+				proxies + p * channels, channels);
+		}
+	}
+
+	/// \brief Projects a set of proxy pixels onto a basis.
+	/// \param proxies The proxy pixels, padded with zeros to the number of columns of the basis.
+	/// \param basis A matrix, that stores one basis vector per row, padded to a multiple of `Alignment` columns.
+	/// \param bias A row vector, that stores the projected mean for each basis vector.
+	/// \param result A buffer that receives one value per basis vector.
+	static inline void project(const float* proxies, const cv::Mat& basis, const cv::Mat& bias, float* result)
+	{
+		const float* offset = bias.ptr<float>();
+
+		for (int d(0); d < basis.rows; ++d)
+			result[d] = dot(proxies, basis.ptr<float>(d), basis.cols) + offset[d];
+	}
+}
@@ -3,8 +3,15 @@
 #include <sampling.hpp>
 
 #include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 
 #include "log2.h"
+#include "Serialization.h"
 
 using namespace Texturize;
 
@@ -12,6 +19,43 @@ using namespace Texturize;
 ///// FLANN-based ANN search index implementation                                             /////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+	static const char ANNMagic[8] = { 'T', 'X', 'A', 'N', 'N', '0', '0', '1' };
+
+	typedef std::unique_ptr<FILE, decltype(&std::fclose)> FileHandle;
+
+	/// \brief Opens a C file, since FLANN only reads and writes indices from and to those.
+	static FileHandle openFile(const std::string& fileName, const char* mode)
+	{
+		FILE* file(nullptr);
+
+#ifdef _MSC_VER
+		if (fopen_s(&file, fileName.c_str(), mode) != 0)
+			file = nullptr;
+#else
+		file = std::fopen(fileName.c_str(), mode);
+#endif
+
+		return FileHandle(file, &std::fclose);
+	}
+
+	/// \brief Moves the position of a C file to an absolute offset. Different from `std::fseek`, the offset is not limited to the range of `long`, which only has
+	///		   32 bits on Windows.
+	static bool seekFile(FILE* file, const std::int64_t offset)
+	{
+#ifdef _MSC_VER
+		return ::_fseeki64(file, offset, SEEK_SET) == 0;
+#else
+		return ::fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+	}
+}
+
+ANNIndex::ANNIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, cv::NormTypes normType) :
+	SearchIndex(searchSpace, descriptorExtractor, normType)
+{
+}
+
 ANNIndex::ANNIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const cv::Ptr<const cv::flann::IndexParams> indexParams, cv::NormTypes normType) :
 	SearchIndex(searchSpace, descriptorExtractor, normType)
 {
@@ -45,10 +89,10 @@ void ANNIndex::init(const cv::flann::IndexParams& indexParams, std::optional<std
 	std::shared_ptr<const Sample> sample;
 	_searchSpace->sample(sample);
 
-	int height, weightChannels(-1);
-	sample->getSize(_sampleWidth, height);
+	sample->getSize(_sampleWidth, _sampleHeight);
 
 	// Form a descriptor vector from the sample.
+	_descriptorExtractor->fit(*sample);
 	_descriptors = _descriptorExtractor->calculateNeighborhoodDescriptors(*sample);
 	TEXTURIZE_ASSERT(_descriptors.isContinuous());
 
@@ -57,13 +101,13 @@ void ANNIndex::init(const cv::flann::IndexParams& indexParams, std::optional<std
 		// Validate the weight map pixel count against the number of descriptors.
 		auto map = weightMap.value().get();
 		TEXTURIZE_ASSERT(_descriptors.rows == (map.height() * map.width()));
-		weightChannels = static_cast<int>(map.channels());
+		_weightChannels = static_cast<int>(map.channels());
 
 		// Transpose descriptors, so that each column represents one descriptor.
 		_descriptors = _descriptors.t();
 
 		// From each channel, append the values to the descriptors.
-		for (int cn(0); cn < weightChannels; ++cn)
+		for (int cn(0); cn < _weightChannels; ++cn)
 			_descriptors.push_back(map.getChannel(cn).reshape(1, 1));
 
 		// Again, transpose the descriptors, so that each row holds on descriptor.
@@ -72,10 +116,124 @@ void ANNIndex::init(const cv::flann::IndexParams& indexParams, std::optional<std
 
 	// Create the index instance and initialize it.
 	TMatrix dataset((TElement*)_descriptors.data, _descriptors.rows, _descriptors.cols);
-	_index = std::make_unique<TIndex>(dataset, *(cvflann::IndexParams*)(indexParams.params), weightChannels);
+	_index = std::make_unique<TIndex>(dataset, *(cvflann::IndexParams*)(indexParams.params), _weightChannels);
 	_index->buildIndex();
 }
 
+std::unique_ptr<ANNIndex> ANNIndex::load(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const std::string& fileName, cv::NormTypes normType)
+{
+	std::unique_ptr<ANNIndex> index(new ANNIndex(searchSpace, descriptorExtractor, normType));
+	index->restore(fileName);
+
+	return index;
+}
+
+std::unique_ptr<ANNIndex> ANNIndex::load(std::shared_ptr<ISearchSpace> searchSpace, const std::string& fileName, cv::NormTypes normType)
+{
+	return ANNIndex::load(searchSpace, std::make_unique<PCADescriptorExtractor>(), fileName, normType);
+}
+
+void ANNIndex::save(const std::string& fileName) const
+{
+	std::shared_ptr<const Sample> sample;
+	_searchSpace->sample(sample);
+
+	const int header[] = { _sampleWidth, _sampleHeight, _weightChannels, static_cast<int>(_index->getType()) };
+	const std::uint64_t hash = Serialization::hash(*sample);
+
+	// Store the extractor state with its size, so that it can be validated independently from the extractor implementation.
+	std::ostringstream extractor(std::ios::out | std::ios::binary);
+	_descriptorExtractor->save(extractor);
+	const std::string state = extractor.str();
+	const std::uint64_t stateSize = static_cast<std::uint64_t>(state.size());
+
+	{
+		std::ofstream stream(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+
+		Serialization::write(stream, ANNMagic, sizeof(ANNMagic));
+		Serialization::write(stream, header, sizeof(header) / sizeof(int));
+		Serialization::write(stream, &hash, 1);
+		Serialization::write(stream, _descriptors);
+		Serialization::write(stream, &stateSize, 1);
+		Serialization::write(stream, state.data(), state.size());
+
+		if (!stream.good())
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The search index could not be written to the file.");
+	}
+
+	// FLANN only writes to C files, so the index is appended after the descriptors.
+	FileHandle file = openFile(fileName, "ab");
+
+	if (!file)
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The file could not be opened to store the search index.");
+
+	_index->saveIndex(file.get());
+
+	if (std::ferror(file.get()) != 0)
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The search index could not be written to the file.");
+}
+
+void ANNIndex::restore(const std::string& fileName)
+{
+	std::shared_ptr<const Sample> sample;
+	_searchSpace->sample(sample);
+	sample->getSize(_sampleWidth, _sampleHeight);
+
+	int header[4];
+	std::streamoff offset;
+
+	{
+		std::ifstream stream(fileName, std::ios::in | std::ios::binary);
+		char magic[sizeof(ANNMagic)];
+		std::uint64_t hash(0), stateSize(0);
+
+		Serialization::read(stream, magic, sizeof(magic));
+		Serialization::read(stream, header, sizeof(header) / sizeof(int));
+		Serialization::read(stream, &hash, 1);
+
+		if (!stream.good() || !std::equal(magic, magic + sizeof(magic), ANNMagic))
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The file does not contain a search index.");
+
+		if (header[0] != _sampleWidth || header[1] != _sampleHeight || hash != Serialization::hash(*sample))
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The search index has been built for a different search space.");
+
+		Serialization::read(stream, _descriptors);
+		Serialization::read(stream, &stateSize, 1);
+
+		if (!stream.good() || _descriptors.rows != _sampleWidth * _sampleHeight || _descriptors.type() != cv::DataType<TElement>::type)
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The file does not contain valid descriptors.");
+
+		// Restore the extractor from its own buffer, so that it cannot read beyond its state.
+		std::string state(static_cast<size_t>(stateSize), '\0');
+		Serialization::read(stream, &state[0], state.size());
+
+		if (!stream.good())
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The file does not contain a valid extractor state.");
+
+		std::istringstream extractor(state, std::ios::in | std::ios::binary);
+		_descriptorExtractor->restore(extractor);
+		offset = stream.tellg();
+	}
+
+	_weightChannels = header[2];
+
+	// Create an index of the stored algorithm and restore it, instead of building it.
+	FileHandle file = openFile(fileName, "rb");
+
+	if (!file || !seekFile(file.get(), static_cast<std::int64_t>(offset)))
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The file could not be opened to restore the search index.");
+
+	::cvflann::IndexParams indexParams;
+	indexParams["algorithm"] = static_cast<::cvflann::flann_algorithm_t>(header[3]);
+
+	TMatrix dataset((TElement*)_descriptors.data, _descriptors.rows, _descriptors.cols);
+	_index = std::make_unique<TIndex>(dataset, indexParams, _weightChannels);
+	_index->loadIndex(file.get());
+
+	if (std::ferror(file.get()) != 0)
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The search index could not be read from the file.");
+}
+
 bool ANNIndex::findNearestNeighbor(const std::vector<float>& descriptor, MatchType& match, DistanceType minDist) const
 {
 	std::vector<MatchType> matches;
@@ -116,22 +274,47 @@ bool ANNIndex::findNearestNeighbors(const std::vector<float>& descriptor, std::v
 	_index->knnSearch(q, i, d, k, ::cvflann::SearchParams());
 
 	// Retain and store the pixel coordinates and distances for each match.
-	std::vector<MatchType> matches;
+	mtchs.clear();
 
 	for (int _k(0); _k < k; ++_k)
 	{
 		int index = indices.at<int>(0, _k);
-		PositionType position(
-			static_cast<CoordinateType>(index % _sampleWidth) / static_cast<CoordinateType>(_sampleWidth), 
-			static_cast<CoordinateType>(index / _sampleWidth) / static_cast<CoordinateType>(_sampleWidth));
+		PositionType position = this->getPosition(index);
 		DistanceType distance{ distances.at<TResult>(0, _k) };
 
-		matches.push_back(std::make_pair<PositionType, DistanceType>(std::move(position), std::move(distance)));
+		mtchs.push_back(std::make_pair<PositionType, DistanceType>(std::move(position), std::move(distance)));
 	}
 
 	return true;
 }
 
+ANNIndex::PositionType ANNIndex::getPosition(const int index) const
+{
+	return PositionType(
+		static_cast<CoordinateType>(index % _sampleWidth) / static_cast<CoordinateType>(_sampleWidth),
+		static_cast<CoordinateType>(index / _sampleWidth) / static_cast<CoordinateType>(_sampleHeight));
+}
+
+std::uint64_t ANNIndex::getIdentity() const
+{
+	// The index parameters are stored as an ordered map of printable values, so their textual representation is stable.
+	std::ostringstream parameters;
+
+	for (const auto& parameter : _index->getParameters())
+		parameters << parameter.first << '=' << parameter.second << ';';
+
+	const std::string description = parameters.str();
+	std::uint64_t identity = Serialization::combine(SearchIndex::getIdentity(), "ANNIndex");
+	identity = Serialization::combine(identity, description.data(), description.size());
+	identity = Serialization::combine(identity, _weightChannels);
+
+	// The weight map is only stored within the descriptors.
+	if (_weightChannels > 0)
+		identity = Serialization::combine(identity, _descriptors.data, _descriptors.total() * _descriptors.elemSize());
+
+	return identity;
+}
+
 bool ANNIndex::findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist) const
 {
 	std::vector<float> targetDescriptor = descriptors.row(at.y * uv.cols + at.x);
@@ -146,6 +329,45 @@ bool ANNIndex::findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& u
 	return this->findNearestNeighbors(targetDescriptor, matches, k, minDist);
 }
 
+int ANNIndex::findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist, const std::uint64_t key) const
+{
+	typedef typename TDistance::ResultType TResult;
+
+	const int count = static_cast<int>(pixels.size());
+	matches.create(count, 1, cv::DataType<PositionType>::type);
+	distances.create(count, 1, cv::DataType<DistanceType>::type);
+
+	if (count == 0)
+		return 0;
+
+	TEXTURIZE_ASSERT(descriptors.type() == cv::DataType<TElement>::type);
+	TEXTURIZE_ASSERT(descriptors.cols == _descriptors.cols);
+
+	// Gather the descriptors of all pixels into one continuous matrix and query them in blocks. Each block only allocates the result set of the index once, instead
+	// of once for each pixel. The blocks are independent from each other, since searching the index does not modify it.
+	cv::Mat queries(count, descriptors.cols, descriptors.type());
+	cv::Mat indices(count, 1, CV_32SC1), results(count, 1, cv::DataType<TResult>::type);
+
+	tbb::parallel_for(tbb::blocked_range<int>(0, count, QueryGrain), [&](const tbb::blocked_range<int>& range) {
+		const int rows = static_cast<int>(range.size());
+
+		for (int p = range.begin(); p < range.end(); ++p)
+			descriptors.row(pixels[p].y * uv.cols + pixels[p].x).copyTo(queries.row(p));
+
+		::cvflann::Matrix<TElement> q(queries.ptr<TElement>(range.begin()), rows, queries.cols);
+		::cvflann::Matrix<int> i(indices.ptr<int>(range.begin()), rows, 1);
+		::cvflann::Matrix<TResult> d(results.ptr<TResult>(range.begin()), rows, 1);
+		_index->knnSearch(q, i, d, 1, ::cvflann::SearchParams());
+
+		for (int p = range.begin(); p < range.end(); ++p) {
+			matches.at<PositionType>(p) = this->getPosition(indices.at<int>(p));
+			distances.at<DistanceType>(p) = static_cast<DistanceType>(results.at<TResult>(p));
+		}
+	});
+
+	return count;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ///// KD-Tree-based search index implementation                                               /////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
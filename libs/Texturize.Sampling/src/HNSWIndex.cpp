@@ -0,0 +1,570 @@
+#include "stdafx.h"
+
+#include <sampling.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/spin_mutex.h>
+#include <tbb/enumerable_thread_specific.h>
+
+#include "CounterRandom.h"
+#include "DescriptorKernel.h"
+#include "Serialization.h"
+
+using namespace Texturize;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// HNSW search index implementation                                                        /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// \brief Stores the synchronization and scratch state of the graph.
+struct HNSWIndex::State {
+	/// \brief Marks visited nodes. Instead of clearing the tags for each search, the generation is incremented.
+	struct VisitedList {
+		std::vector<unsigned int> tags;
+		unsigned int generation{ 0 };
+	};
+
+	tbb::enumerable_thread_specific<VisitedList> visited;
+	std::unique_ptr<tbb::spin_mutex[]> locks;
+	std::mutex global;
+
+	VisitedList& acquire(const size_t nodes)
+	{
+		VisitedList& list = visited.local();
+
+		if (list.tags.size() != nodes || ++list.generation == 0) {
+			list.tags.assign(nodes, 0);
+			list.generation = 1;
+		}
+
+		return list;
+	}
+};
+
+namespace {
+	static const char HNSWMagic[8] = { 'T', 'X', 'H', 'N', 'S', 'W', '0', '2' };
+
+	/// \brief The size of the buffers, that receive a copy of the connections of a node while searching.
+	static const int MaxConnections = 1024;
+
+	/// \brief The number of layers, a restored node may belong to. Random levels are distributed exponentially, so built graphs never come close to it.
+	static const int MaxLevels = 64;
+
+	/// \brief Checks, if a list of connections stores at most `maxLinks` links to existing nodes.
+	static inline bool validLinks(const int* links, const int maxLinks, const int nodes)
+	{
+		if (links[0] < 0 || links[0] > maxLinks)
+			return false;
+
+		return std::all_of(links + 1, links + 1 + links[0], [nodes](const int link) { return link >= 0 && link < nodes; });
+	}
+}
+
+HNSWIndex::HNSWIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const Parameters& parameters, cv::NormTypes normType) :
+	SearchIndex(searchSpace, descriptorExtractor, normType), _parameters(parameters), _state(std::make_unique<State>())
+{
+	this->init({ });
+	this->build();
+}
+
+HNSWIndex::HNSWIndex(std::shared_ptr<ISearchSpace> searchSpace, const Parameters& parameters) :
+	HNSWIndex(searchSpace, std::make_unique<PCADescriptorExtractor>(), parameters)
+{
+}
+
+HNSWIndex::HNSWIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const Sample& guidanceMap, const Parameters& parameters, cv::NormTypes normType) :
+	SearchIndex(searchSpace, descriptorExtractor, normType), _parameters(parameters), _state(std::make_unique<State>())
+{
+	this->init(guidanceMap);
+	this->build();
+}
+
+HNSWIndex::HNSWIndex(std::shared_ptr<ISearchSpace> searchSpace, const Sample& guidanceMap, const Parameters& parameters) :
+	HNSWIndex(searchSpace, std::make_unique<PCADescriptorExtractor>(), guidanceMap, parameters)
+{
+}
+
+HNSWIndex::HNSWIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, std::istream& stream, cv::NormTypes normType) :
+	SearchIndex(searchSpace, descriptorExtractor, normType), _state(std::make_unique<State>())
+{
+	this->init({ });
+	this->restore(stream);
+}
+
+HNSWIndex::HNSWIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const Sample& guidanceMap, std::istream& stream, cv::NormTypes normType) :
+	SearchIndex(searchSpace, descriptorExtractor, normType), _state(std::make_unique<State>())
+{
+	this->init(guidanceMap);
+	this->restore(stream);
+}
+
+HNSWIndex::~HNSWIndex() = default;
+
+void HNSWIndex::init(std::optional<std::reference_wrapper<const Sample>> guidanceMap)
+{
+	// Precompute the neighborhood descriptors of the exemplar.
+	std::shared_ptr<const Sample> sample;
+	_searchSpace->sample(sample);
+	sample->getSize(_width, _height);
+
+	_descriptorExtractor->fit(*sample);
+	cv::Mat descriptors = _descriptorExtractor->calculateNeighborhoodDescriptors(*sample);
+	TEXTURIZE_ASSERT(descriptors.type() == CV_32FC1);							// The distance kernels operate on single-precision floating point descriptors.
+
+	// Append the guidance channels to the descriptors.
+	if (guidanceMap.has_value()) {
+		const Sample& map = guidanceMap.value().get();
+		TEXTURIZE_ASSERT(descriptors.rows == map.width() * map.height());		// There must be one guidance pixel for each descriptor.
+
+		std::vector<cv::Mat> columns = { descriptors };
+
+		for (size_t cn(0); cn < map.channels(); ++cn)
+			columns.push_back(map.getChannel(static_cast<int>(cn)).reshape(1, descriptors.rows));
+
+		cv::hconcat(columns, descriptors);
+	}
+
+	_descriptors = descriptors.isContinuous() ? descriptors : descriptors.clone();
+}
+
+void HNSWIndex::build()
+{
+	TEXTURIZE_ASSERT(_parameters.M > 1);										// Each node must be able to connect to at least two neighbors.
+	TEXTURIZE_ASSERT(2 * _parameters.M < MaxConnections);						// The connections of a node must fit into the search buffers.
+	TEXTURIZE_ASSERT(_parameters.efConstruction >= _parameters.M);				// The construction candidate list must be able to hold all neighbors.
+	TEXTURIZE_ASSERT(_parameters.efSearch > 0);
+
+	const int nodes = _descriptors.rows;
+	const double levelFactor = 1.0 / std::log(static_cast<double>(_parameters.M));
+
+	// Assign the layers of each node from its own random stream and allocate the connections.
+	_levels.resize(nodes);
+	_upperLinks.resize(nodes);
+	_links.assign(static_cast<size_t>(nodes) * (2 * _parameters.M + 1), 0);
+
+	tbb::parallel_for(0, nodes, [this, levelFactor](int node) {
+		const double u = 1.0 - static_cast<double>(CounterRandom::uniform(_parameters.seed, static_cast<std::uint64_t>(node), 0));
+		_levels[node] = static_cast<int>(-std::log(u) * levelFactor);
+		_upperLinks[node].assign(static_cast<size_t>(_levels[node]) * (_parameters.M + 1), 0);
+	});
+
+	// Insert the first node, so that there is an entry point, and the remaining ones in parallel. Each node has its own lock, that guards its connections.
+	_state->locks = std::make_unique<tbb::spin_mutex[]>(nodes);
+
+	if (nodes > 0) {
+		_entryPoint = 0;
+		_maxLevel = _levels[0];
+	}
+
+	tbb::parallel_for(1, nodes, [this](int node) {
+		this->insert(node);
+	});
+
+	_state->locks.reset();
+}
+
+void HNSWIndex::insert(const int node)
+{
+	const float* query = _descriptors.ptr<float>(node);
+	const int level = _levels[node];
+
+	// If the node creates a new top layer, hold the global lock until it has become the entry point.
+	std::unique_lock<std::mutex> global(_state->global);
+	int entryPoint = _entryPoint;
+	const int maxLevel = _maxLevel;
+
+	if (level <= maxLevel)
+		global.unlock();
+
+	// Greedily descend the layers above the node.
+	for (int l(maxLevel); l > level; --l)
+		entryPoint = this->descend(query, entryPoint, l, true);
+
+	// Connect the node on each layer it belongs to.
+	std::vector<std::pair<float, int>> candidates;
+	std::vector<int> neighbors, links;
+
+	for (int l(std::min(level, maxLevel)); l >= 0; --l) {
+		const int maxLinks = l == 0 ? 2 * _parameters.M : _parameters.M;
+
+		this->searchLayer(query, entryPoint, _parameters.efConstruction, l, true, candidates);
+		this->selectNeighbors(candidates, _parameters.M, neighbors);
+		entryPoint = candidates.front().second;
+
+		{
+			tbb::spin_mutex::scoped_lock lock(_state->locks[node]);
+			int* nodeLinks = this->getLinks(node, l);
+			nodeLinks[0] = static_cast<int>(neighbors.size());
+			std::copy(neighbors.begin(), neighbors.end(), nodeLinks + 1);
+		}
+
+		// Add a back-link to each neighbor. If a neighbor has too many connections, keep a diverse subset.
+		for (const int neighbor : neighbors) {
+			tbb::spin_mutex::scoped_lock lock(_state->locks[neighbor]);
+			int* neighborLinks = this->getLinks(neighbor, l);
+
+			if (neighborLinks[0] < maxLinks) {
+				neighborLinks[++neighborLinks[0]] = node;
+				continue;
+			}
+
+			const float* neighborDescriptor = _descriptors.ptr<float>(neighbor);
+			std::vector<std::pair<float, int>> pruned;
+			pruned.reserve(maxLinks + 1);
+			pruned.push_back(std::make_pair(this->distance(neighborDescriptor, node), node));
+
+			for (int i(1); i <= neighborLinks[0]; ++i)
+				pruned.push_back(std::make_pair(this->distance(neighborDescriptor, neighborLinks[i]), neighborLinks[i]));
+
+			std::sort(pruned.begin(), pruned.end());
+			this->selectNeighbors(pruned, maxLinks, links);
+			neighborLinks[0] = static_cast<int>(links.size());
+			std::copy(links.begin(), links.end(), neighborLinks + 1);
+		}
+	}
+
+	if (level > maxLevel) {
+		_entryPoint = node;
+		_maxLevel = level;
+	}
+}
+
+int* HNSWIndex::getLinks(const int node, const int level)
+{
+	return level == 0 ?
+		_links.data() + static_cast<size_t>(node) * (2 * _parameters.M + 1) :
+		_upperLinks[node].data() + static_cast<size_t>(level - 1) * (_parameters.M + 1);
+}
+
+const int* HNSWIndex::getLinks(const int node, const int level) const
+{
+	return level == 0 ?
+		_links.data() + static_cast<size_t>(node) * (2 * _parameters.M + 1) :
+		_upperLinks[node].data() + static_cast<size_t>(level - 1) * (_parameters.M + 1);
+}
+
+float HNSWIndex::distance(const float* query, const int node) const
+{
+	return DescriptorKernel::distance(query, _descriptors.ptr<float>(node), _descriptors.cols, DescriptorKernel::rankingNorm(_normType));
+}
+
+HNSWIndex::PositionType HNSWIndex::getPosition(const int index) const
+{
+	return PositionType(
+		static_cast<CoordinateType>(index % _width) / static_cast<CoordinateType>(_width),
+		static_cast<CoordinateType>(index / _width) / static_cast<CoordinateType>(_height));
+}
+
+int HNSWIndex::descend(const float* query, int entryPoint, const int level, const bool building) const
+{
+	float best = this->distance(query, entryPoint);
+	bool changed = true;
+	int links[MaxConnections];
+
+	while (changed) {
+		changed = false;
+
+		// Copy the connections, since they might be modified concurrently while the graph is built.
+		if (building) {
+			tbb::spin_mutex::scoped_lock lock(_state->locks[entryPoint]);
+			const int* nodeLinks = this->getLinks(entryPoint, level);
+			std::copy(nodeLinks, nodeLinks + nodeLinks[0] + 1, links);
+		} else {
+			const int* nodeLinks = this->getLinks(entryPoint, level);
+			std::copy(nodeLinks, nodeLinks + nodeLinks[0] + 1, links);
+		}
+
+		for (int i(1); i <= links[0]; ++i) {
+			const float distance = this->distance(query, links[i]);
+
+			if (distance < best) {
+				best = distance;
+				entryPoint = links[i];
+				changed = true;
+			}
+		}
+	}
+
+	return entryPoint;
+}
+
+void HNSWIndex::searchLayer(const float* query, const int entryPoint, const int ef, const int level, const bool building, std::vector<std::pair<float, int>>& result) const
+{
+	typedef std::pair<float, int> TCandidate;
+
+	State::VisitedList& visited = _state->acquire(static_cast<size_t>(_descriptors.rows));
+	std::priority_queue<TCandidate, std::vector<TCandidate>, std::greater<TCandidate>> candidates;
+	std::priority_queue<TCandidate> nearest;
+	int links[MaxConnections];
+
+	const TCandidate entry = std::make_pair(this->distance(query, entryPoint), entryPoint);
+	visited.tags[entryPoint] = visited.generation;
+	candidates.push(entry);
+	nearest.push(entry);
+
+	while (!candidates.empty()) {
+		const TCandidate current = candidates.top();
+
+		// Stop, if the closest candidate is farther away than all of the current results.
+		if (current.first > nearest.top().first && static_cast<int>(nearest.size()) >= ef)
+			break;
+
+		candidates.pop();
+
+		if (building) {
+			tbb::spin_mutex::scoped_lock lock(_state->locks[current.second]);
+			const int* nodeLinks = this->getLinks(current.second, level);
+			std::copy(nodeLinks, nodeLinks + nodeLinks[0] + 1, links);
+		} else {
+			const int* nodeLinks = this->getLinks(current.second, level);
+			std::copy(nodeLinks, nodeLinks + nodeLinks[0] + 1, links);
+		}
+
+		for (int i(1); i <= links[0]; ++i) {
+			const int neighbor = links[i];
+
+			if (visited.tags[neighbor] == visited.generation)
+				continue;
+
+			visited.tags[neighbor] = visited.generation;
+			const float distance = this->distance(query, neighbor);
+
+			if (static_cast<int>(nearest.size()) < ef || distance < nearest.top().first) {
+				candidates.push(std::make_pair(distance, neighbor));
+				nearest.push(std::make_pair(distance, neighbor));
+
+				if (static_cast<int>(nearest.size()) > ef)
+					nearest.pop();
+			}
+		}
+	}
+
+	// Return the results, sorted by increasing distance.
+	result.resize(nearest.size());
+
+	for (size_t i(nearest.size()); i > 0; --i) {
+		result[i - 1] = nearest.top();
+		nearest.pop();
+	}
+}
+
+void HNSWIndex::selectNeighbors(const std::vector<std::pair<float, int>>& candidates, const int count, std::vector<int>& neighbors) const
+{
+	neighbors.clear();
+
+	// Only keep candidates, that are closer to the node than to any neighbor that has already been selected. This keeps connections into different directions.
+	for (const auto& candidate : candidates) {
+		if (static_cast<int>(neighbors.size()) >= count)
+			break;
+
+		const float* descriptor = _descriptors.ptr<float>(candidate.second);
+		bool diverse = true;
+
+		for (const int neighbor : neighbors) {
+			if (this->distance(descriptor, neighbor) < candidate.first) {
+				diverse = false;
+				break;
+			}
+		}
+
+		if (diverse)
+			neighbors.push_back(candidate.second);
+	}
+}
+
+int HNSWIndex::search(const float* query, const int k, const float minimum, float* distances, int* indices) const
+{
+	if (_entryPoint < 0)
+		return 0;
+
+	int entryPoint = _entryPoint;
+
+	for (int l(_maxLevel); l > 0; --l)
+		entryPoint = this->descend(query, entryPoint, l, false);
+
+	std::vector<std::pair<float, int>> candidates;
+	this->searchLayer(query, entryPoint, std::max(_parameters.efSearch, k), 0, false, candidates);
+
+	// Return the k closest candidates, that are not too similar.
+	int count(0);
+
+	for (size_t c(0); c < candidates.size() && count < k; ++c) {
+		if (candidates[c].first < minimum)
+			continue;
+
+		distances[count] = candidates[c].first;
+		indices[count++] = candidates[c].second;
+	}
+
+	return count;
+}
+
+void HNSWIndex::save(std::ostream& stream) const
+{
+	const int header[] = { _descriptors.rows, _descriptors.cols, _parameters.M, _parameters.efConstruction, _parameters.efSearch, static_cast<int>(_parameters.seed), _entryPoint, _maxLevel };
+
+	// Store a hash of the exemplar, so that the graph is not restored for a different search space, that has the same number of descriptors.
+	std::shared_ptr<const Sample> sample;
+	_searchSpace->sample(sample);
+	const std::uint64_t hash = Serialization::hash(*sample);
+
+	Serialization::write(stream, HNSWMagic, sizeof(HNSWMagic));
+	Serialization::write(stream, header, sizeof(header) / sizeof(int));
+	Serialization::write(stream, &hash, 1);
+	Serialization::write(stream, _levels.data(), _levels.size());
+	Serialization::write(stream, _links.data(), _links.size());
+
+	for (const auto& links : _upperLinks)
+		Serialization::write(stream, links.data(), links.size());
+
+	if (!stream.good())
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The graph could not be written to the stream.");
+}
+
+void HNSWIndex::restore(std::istream& stream)
+{
+	char magic[sizeof(HNSWMagic)];
+	int header[8];
+	std::uint64_t hash(0);
+
+	Serialization::read(stream, magic, sizeof(magic));
+	Serialization::read(stream, header, sizeof(header) / sizeof(int));
+	Serialization::read(stream, &hash, 1);
+
+	if (!stream.good() || !std::equal(magic, magic + sizeof(magic), HNSWMagic))
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The stream does not contain a graph.");
+
+	std::shared_ptr<const Sample> sample;
+	_searchSpace->sample(sample);
+
+	if (header[0] != _descriptors.rows || header[1] != _descriptors.cols || hash != Serialization::hash(*sample))
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The graph does not match the descriptors of the search space.");
+
+	if (header[2] < 2 || 2 * header[2] >= MaxConnections || header[3] < header[2] || header[4] <= 0 || header[6] < 0 || header[6] >= _descriptors.rows || 
+		header[7] < 0 || header[7] >= MaxLevels)
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The graph parameters are invalid.");
+
+	_parameters.M = header[2];
+	_parameters.efConstruction = header[3];
+	_parameters.efSearch = header[4];
+	_parameters.seed = static_cast<unsigned int>(header[5]);
+	_entryPoint = header[6];
+	_maxLevel = header[7];
+
+	const int nodes = _descriptors.rows;
+	_levels.resize(nodes);
+	_links.resize(static_cast<size_t>(nodes) * (2 * _parameters.M + 1));
+	_upperLinks.resize(nodes);
+
+	Serialization::read(stream, _levels.data(), _levels.size());
+	Serialization::read(stream, _links.data(), _links.size());
+
+	// Validate the levels before allocating the upper layers, so that corrupted levels neither allocate excessive memory nor exceed the top layer.
+	if (!stream.good() || _levels[_entryPoint] != _maxLevel || 
+		!std::all_of(_levels.begin(), _levels.end(), [this](const int level) { return level >= 0 && level <= _maxLevel; }))
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The graph contains invalid levels.");
+
+	for (int node(0); node < nodes && stream.good(); ++node) {
+		_upperLinks[node].resize(static_cast<size_t>(_levels[node]) * (_parameters.M + 1));
+		Serialization::read(stream, _upperLinks[node].data(), _upperLinks[node].size());
+	}
+
+	if (!stream.good())
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The graph could not be read from the stream.");
+
+	// Each link must refer to an existing node, since searches follow them without further checks.
+	for (int node(0); node < nodes; ++node)
+		for (int l(0); l <= _levels[node]; ++l)
+			if (!validLinks(this->getLinks(node, l), l == 0 ? 2 * _parameters.M : _parameters.M, nodes))
+				TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The graph contains invalid links.");
+}
+
+const HNSWIndex::Parameters& HNSWIndex::getParameters() const
+{
+	return _parameters;
+}
+
+void HNSWIndex::setSearchBreadth(const int efSearch)
+{
+	TEXTURIZE_ASSERT(efSearch > 0);
+
+	_parameters.efSearch = efSearch;
+}
+
+std::uint64_t HNSWIndex::getIdentity() const
+{
+	std::uint64_t identity = Serialization::combine(SearchIndex::getIdentity(), "HNSWIndex");
+	identity = Serialization::combine(identity, _parameters.M);
+	identity = Serialization::combine(identity, _parameters.efConstruction);
+	identity = Serialization::combine(identity, _parameters.efSearch);
+	return Serialization::combine(identity, _parameters.seed);
+}
+
+bool HNSWIndex::findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist) const
+{
+	std::vector<MatchType> matches;
+
+	if (!this->findNearestNeighbors(descriptors, uv, at, matches, 1, minDist))
+		return false;
+
+	match = matches.front();
+	return true;
+}
+
+bool HNSWIndex::findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& matches, const unsigned int k, DistanceType minDist) const
+{
+	TEXTURIZE_ASSERT(descriptors.type() == CV_32FC1);							// The distance kernels operate on single-precision floating point descriptors.
+	TEXTURIZE_ASSERT(descriptors.cols == _descriptors.cols);					// The runtime descriptors must match the exemplar descriptors, including guidance channels.
+	TEXTURIZE_ASSERT(k > 0);
+
+	const bool squared = DescriptorKernel::rankingNorm(_normType) != _normType;
+	cv::AutoBuffer<float, 16> distances(k);
+	cv::AutoBuffer<int, 16> indices(k);
+	const int count = this->search(descriptors.ptr<float>(at.y * uv.cols + at.x), static_cast<int>(k), static_cast<float>(squared ? minDist * minDist : minDist), distances.data(), indices.data());
+
+	if (count == 0)
+		return false;
+
+	matches.resize(count);
+
+	for (int m(0); m < count; ++m)
+		matches[m] = std::make_pair(this->getPosition(indices[m]), static_cast<DistanceType>(squared ? std::sqrt(distances[m]) : distances[m]));
+
+	return true;
+}
+
+int HNSWIndex::findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist, const std::uint64_t key) const
+{
+	TEXTURIZE_ASSERT(descriptors.type() == CV_32FC1);							// The distance kernels operate on single-precision floating point descriptors.
+	TEXTURIZE_ASSERT(descriptors.cols == _descriptors.cols);					// The runtime descriptors must match the exemplar descriptors, including guidance channels.
+
+	const int count = static_cast<int>(pixels.size());
+	const bool squared = DescriptorKernel::rankingNorm(_normType) != _normType;
+	const float minimum = static_cast<float>(squared ? minDist * minDist : minDist);
+
+	matches.create(count, 1, cv::DataType<PositionType>::type);
+	distances.create(count, 1, cv::DataType<DistanceType>::type);
+
+	// Queries only read the graph, so they can be processed in parallel.
+	tbb::parallel_for(tbb::blocked_range<int>(0, count), [&](const tbb::blocked_range<int>& range) {
+		for (int p = range.begin(); p < range.end(); ++p) {
+			const cv::Point2i& at = pixels[p];
+			float distance;
+			int index;
+
+			if (this->search(descriptors.ptr<float>(at.y * uv.cols + at.x), 1, minimum, &distance, &index) == 0) {
+				distances.at<DistanceType>(p) = std::numeric_limits<DistanceType>::infinity();
+			} else {
+				matches.at<PositionType>(p) = this->getPosition(index);
+				distances.at<DistanceType>(p) = static_cast<DistanceType>(squared ? std::sqrt(distance) : distance);
+			}
+		}
+	});
+
+	return static_cast<int>(std::count_if(distances.begin<DistanceType>(), distances.end<DistanceType>(), [](const DistanceType& distance) { return distance != std::numeric_limits<DistanceType>::infinity(); }));
+}
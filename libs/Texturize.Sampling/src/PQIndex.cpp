@@ -0,0 +1,337 @@
+#include "stdafx.h"
+
+#include <sampling.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include "DescriptorKernel.h"
+#include "Serialization.h"
+
+using namespace Texturize;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Product quantization search index implementation                                       /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+	/// \brief Returns the index of the closest row of a set of centroids.
+	static inline int closest(const float* vector, const cv::Mat& centroids, const int first, const int count)
+	{
+		int best(0);
+		float bestDistance = std::numeric_limits<float>::infinity();
+
+		for (int c(0); c < count; ++c) {
+			const float distance = DescriptorKernel::distanceL2Sqr(vector, centroids.ptr<float>(first + c), centroids.cols);
+
+			if (distance < bestDistance) {
+				bestDistance = distance;
+				best = c;
+			}
+		}
+
+		return best;
+	}
+
+	/// \brief Clusters the rows of a matrix and returns the cluster centers.
+	static cv::Mat cluster(const cv::Mat& data, const int clusters, const unsigned int seed)
+	{
+		cv::Mat labels, centers;
+
+		// NOTE: k-means draws its initial centers from the random number generator of the current thread, so seed it in order to train reproducible quantizers.
+		//       The state is restored afterwards, so that the random sequence of the caller is not changed.
+		cv::RNG& rng = cv::theRNG();
+		const std::uint64_t state = rng.state;
+
+		rng.state = seed == 0 ? 0xFFFFFFFFull : static_cast<std::uint64_t>(seed);
+		cv::kmeans(data, clusters, labels, cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 25, 1e-4), 1, cv::KMEANS_PP_CENTERS, centers);
+		rng.state = state;
+
+		return centers;
+	}
+}
+
+PQIndex::PQIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const Parameters& parameters, cv::NormTypes normType) :
+	SearchIndex(searchSpace, descriptorExtractor, normType), _parameters(parameters)
+{
+	this->init({ });
+}
+
+PQIndex::PQIndex(std::shared_ptr<ISearchSpace> searchSpace, const Parameters& parameters) :
+	PQIndex(searchSpace, std::make_unique<PCADescriptorExtractor>(), parameters)
+{
+}
+
+PQIndex::PQIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const Sample& guidanceMap, const Parameters& parameters, cv::NormTypes normType) :
+	SearchIndex(searchSpace, descriptorExtractor, normType), _parameters(parameters)
+{
+	this->init(guidanceMap);
+}
+
+PQIndex::PQIndex(std::shared_ptr<ISearchSpace> searchSpace, const Sample& guidanceMap, const Parameters& parameters) :
+	PQIndex(searchSpace, std::make_unique<PCADescriptorExtractor>(), guidanceMap, parameters)
+{
+}
+
+void PQIndex::init(std::optional<std::reference_wrapper<const Sample>> guidanceMap)
+{
+	TEXTURIZE_ASSERT(_normType == cv::NORM_L2 || _normType == cv::NORM_L2SQR);		// Only euclidean distances are supported.
+	TEXTURIZE_ASSERT(_parameters.subspaces >= 0 && _parameters.lists >= 0);
+	TEXTURIZE_ASSERT(_parameters.probes > 0 && _parameters.trainingSamples > 0);
+
+	// Calculate the neighborhood descriptors of the exemplar. They are only kept until they have been encoded.
+	std::shared_ptr<const Sample> sample;
+	_searchSpace->sample(sample);
+	sample->getSize(_width, _height);
+
+	_descriptorExtractor->fit(*sample);
+	cv::Mat descriptors = _descriptorExtractor->calculateNeighborhoodDescriptors(*sample);
+	TEXTURIZE_ASSERT(descriptors.type() == CV_32FC1);								// The quantizers operate on single-precision floating point descriptors.
+
+	// Append the guidance channels to the descriptors.
+	if (guidanceMap.has_value()) {
+		const Sample& map = guidanceMap.value().get();
+		TEXTURIZE_ASSERT(descriptors.rows == map.width() * map.height());			// There must be one guidance pixel for each descriptor.
+
+		std::vector<cv::Mat> columns = { descriptors };
+
+		for (size_t cn(0); cn < map.channels(); ++cn)
+			columns.push_back(map.getChannel(static_cast<int>(cn)).reshape(1, descriptors.rows));
+
+		cv::hconcat(columns, descriptors);
+	}
+
+	// Resolve the automatic parameters and pad the descriptors with zeros, so that they can be split into sub-vectors of equal size.
+	const int count = descriptors.rows;
+	_dimensions = descriptors.cols;
+
+	if (_parameters.subspaces == 0)
+		_parameters.subspaces = (_dimensions + 1) / 2;
+
+	if (_parameters.lists == 0)
+		_parameters.lists = std::max(1, static_cast<int>(std::sqrt(static_cast<double>(count))));
+
+	_subDimensions = (_dimensions + _parameters.subspaces - 1) / _parameters.subspaces;
+	const int padded = _subDimensions * _parameters.subspaces;
+
+	if (padded != _dimensions)
+		cv::copyMakeBorder(descriptors, descriptors, 0, 0, 0, padded - _dimensions, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+
+	// Select a regular subset of the descriptors for training.
+	const int samples = std::min(count, _parameters.trainingSamples);
+	cv::Mat training(samples, padded, CV_32FC1);
+
+	for (int s(0); s < samples; ++s)
+		descriptors.row(static_cast<int>(static_cast<long long>(s) * count / samples)).copyTo(training.row(s));
+
+	// Train the coarse quantizer and compute the training residuals.
+	_parameters.lists = std::min(_parameters.lists, samples);
+	_coarseCentroids = cluster(training, _parameters.lists, _parameters.seed);
+
+	tbb::parallel_for(0, samples, [this, &training](int s) {
+		float* residual = training.ptr<float>(s);
+		const float* centroid = _coarseCentroids.ptr<float>(closest(residual, _coarseCentroids, 0, _coarseCentroids.rows));
+
+		for (int d(0); d < training.cols; ++d)
+			residual[d] -= centroid[d];
+	});
+
+	// Train one codebook for each sub-space of the residuals. The codebooks are stored subsequently, one entry per row.
+	_centroids = std::min(Centroids, samples);
+	_codebooks = cv::Mat(_parameters.subspaces * _centroids, _subDimensions, CV_32FC1);
+
+	for (int s(0); s < _parameters.subspaces; ++s) {
+		cv::Mat subspace = training.colRange(s * _subDimensions, (s + 1) * _subDimensions).clone();
+		cluster(subspace, _centroids, _parameters.seed + s + 1).copyTo(_codebooks.rowRange(s * _centroids, (s + 1) * _centroids));
+	}
+
+	// Encode all descriptors.
+	std::vector<int> assignments(count);
+	std::vector<uchar> codes(static_cast<size_t>(count) * _parameters.subspaces);
+
+	tbb::parallel_for(tbb::blocked_range<int>(0, count), [&](const tbb::blocked_range<int>& range) {
+		cv::AutoBuffer<float> residual(padded);
+
+		for (int i = range.begin(); i < range.end(); ++i) {
+			const float* descriptor = descriptors.ptr<float>(i);
+			const int list = closest(descriptor, _coarseCentroids, 0, _coarseCentroids.rows);
+			const float* centroid = _coarseCentroids.ptr<float>(list);
+
+			for (int d(0); d < padded; ++d)
+				residual[d] = descriptor[d] - centroid[d];
+
+			for (int s(0); s < _parameters.subspaces; ++s)
+				codes[static_cast<size_t>(i) * _parameters.subspaces + s] = static_cast<uchar>(closest(residual.data() + s * _subDimensions, _codebooks, s * _centroids, _centroids));
+
+			assignments[i] = list;
+		}
+	});
+
+	// Distribute the codes into the inverted lists.
+	_listIndices.assign(_parameters.lists, std::vector<int>());
+	_listCodes.assign(_parameters.lists, std::vector<uchar>());
+
+	for (int i(0); i < count; ++i) {
+		const uchar* code = codes.data() + static_cast<size_t>(i) * _parameters.subspaces;
+		_listIndices[assignments[i]].push_back(i);
+		_listCodes[assignments[i]].insert(_listCodes[assignments[i]].end(), code, code + _parameters.subspaces);
+	}
+}
+
+PQIndex::PositionType PQIndex::getPosition(const int index) const
+{
+	return PositionType(
+		static_cast<CoordinateType>(index % _width) / static_cast<CoordinateType>(_width),
+		static_cast<CoordinateType>(index / _width) / static_cast<CoordinateType>(_height));
+}
+
+int PQIndex::search(const float* query, const int k, const float minimum, float* distances, int* indices) const
+{
+	const int subspaces = _parameters.subspaces;
+	const int padded = _subDimensions * subspaces;
+	const int probes = std::min(_parameters.probes, _coarseCentroids.rows);
+
+	// Pad the query with zeros, the same way the descriptors have been padded.
+	cv::AutoBuffer<float, 64> descriptor(padded), residual(padded);
+	std::fill(std::copy(query, query + _dimensions, descriptor.data()), descriptor.data() + padded, 0.f);
+
+	// Find the closest coarse centroids.
+	cv::AutoBuffer<float, 64> listDistances(probes);
+	cv::AutoBuffer<int, 64> lists(probes);
+	DescriptorKernel::Selection coarse{ listDistances.data(), lists.data(), probes, 0, 0.f };
+
+	for (int l(0); l < _coarseCentroids.rows; ++l)
+		coarse.insert(DescriptorKernel::distanceL2Sqr(descriptor.data(), _coarseCentroids.ptr<float>(l), padded), l);
+
+	// Scan the inverted lists of the closest centroids.
+	DescriptorKernel::Selection selection{ distances, indices, k, 0, minimum };
+	cv::AutoBuffer<float, 4096> table(static_cast<size_t>(subspaces) * _centroids);
+
+	for (int p(0); p < coarse.count; ++p) {
+		const int list = lists[p];
+		const float* centroid = _coarseCentroids.ptr<float>(list);
+
+		for (int d(0); d < padded; ++d)
+			residual[d] = descriptor[d] - centroid[d];
+
+		// Pre-compute the distances between the query residual and all codebook entries.
+		for (int s(0); s < subspaces; ++s)
+		for (int c(0); c < _centroids; ++c)
+			table[s * _centroids + c] = DescriptorKernel::distanceL2Sqr(residual.data() + s * _subDimensions, _codebooks.ptr<float>(s * _centroids + c), _subDimensions);
+
+		// Sum up the table entries, each code refers to.
+		const std::vector<int>& listIndices = _listIndices[list];
+		const uchar* codes = _listCodes[list].data();
+
+		for (size_t i(0); i < listIndices.size(); ++i, codes += subspaces) {
+			float distance(0.f);
+
+			for (int s(0); s < subspaces; ++s)
+				distance += table[s * _centroids + codes[s]];
+
+			if (distance < selection.worst())
+				selection.insert(distance, listIndices[i]);
+		}
+	}
+
+	return selection.count;
+}
+
+const PQIndex::Parameters& PQIndex::getParameters() const
+{
+	return _parameters;
+}
+
+void PQIndex::setProbes(const int probes)
+{
+	TEXTURIZE_ASSERT(probes > 0);
+
+	_parameters.probes = probes;
+}
+
+size_t PQIndex::getMemoryUsage() const
+{
+	size_t size = _coarseCentroids.total() * _coarseCentroids.elemSize() + _codebooks.total() * _codebooks.elemSize();
+
+	for (size_t l(0); l < _listIndices.size(); ++l)
+		size += _listIndices[l].size() * sizeof(int) + _listCodes[l].size() * sizeof(uchar);
+
+	return size;
+}
+
+std::uint64_t PQIndex::getIdentity() const
+{
+	std::uint64_t identity = Serialization::combine(SearchIndex::getIdentity(), "PQIndex");
+	identity = Serialization::combine(identity, _parameters.subspaces);
+	identity = Serialization::combine(identity, _parameters.lists);
+	identity = Serialization::combine(identity, _parameters.probes);
+	identity = Serialization::combine(identity, _parameters.trainingSamples);
+	return Serialization::combine(identity, _parameters.seed);
+}
+
+bool PQIndex::findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist) const
+{
+	std::vector<MatchType> matches;
+
+	if (!this->findNearestNeighbors(descriptors, uv, at, matches, 1, minDist))
+		return false;
+
+	match = matches.front();
+	return true;
+}
+
+bool PQIndex::findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& matches, const unsigned int k, DistanceType minDist) const
+{
+	TEXTURIZE_ASSERT(descriptors.type() == CV_32FC1);								// The quantizers operate on single-precision floating point descriptors.
+	TEXTURIZE_ASSERT(descriptors.cols == _dimensions);								// The runtime descriptors must match the exemplar descriptors, including guidance channels.
+	TEXTURIZE_ASSERT(k > 0);
+
+	const bool squared = _normType == cv::NORM_L2SQR;
+	cv::AutoBuffer<float, 16> distances(k);
+	cv::AutoBuffer<int, 16> indices(k);
+	const int count = this->search(descriptors.ptr<float>(at.y * uv.cols + at.x), static_cast<int>(k), static_cast<float>(squared ? minDist : minDist * minDist), distances.data(), indices.data());
+
+	if (count == 0)
+		return false;
+
+	matches.resize(count);
+
+	for (int m(0); m < count; ++m)
+		matches[m] = std::make_pair(this->getPosition(indices[m]), static_cast<DistanceType>(squared ? distances[m] : std::sqrt(distances[m])));
+
+	return true;
+}
+
+int PQIndex::findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist, const std::uint64_t key) const
+{
+	TEXTURIZE_ASSERT(descriptors.type() == CV_32FC1);								// The quantizers operate on single-precision floating point descriptors.
+	TEXTURIZE_ASSERT(descriptors.cols == _dimensions);								// The runtime descriptors must match the exemplar descriptors, including guidance channels.
+
+	const int count = static_cast<int>(pixels.size());
+	const bool squared = _normType == cv::NORM_L2SQR;
+	const float minimum = static_cast<float>(squared ? minDist : minDist * minDist);
+
+	matches.create(count, 1, cv::DataType<PositionType>::type);
+	distances.create(count, 1, cv::DataType<DistanceType>::type);
+
+	// Queries only read the quantizers and lists, so they can be processed in parallel.
+	tbb::parallel_for(tbb::blocked_range<int>(0, count), [&](const tbb::blocked_range<int>& range) {
+		for (int p = range.begin(); p < range.end(); ++p) {
+			const cv::Point2i& at = pixels[p];
+			float distance;
+			int index;
+
+			if (this->search(descriptors.ptr<float>(at.y * uv.cols + at.x), 1, minimum, &distance, &index) == 0) {
+				distances.at<DistanceType>(p) = std::numeric_limits<DistanceType>::infinity();
+			} else {
+				matches.at<PositionType>(p) = this->getPosition(index);
+				distances.at<DistanceType>(p) = static_cast<DistanceType>(squared ? distance : std::sqrt(distance));
+			}
+		}
+	});
+
+	return static_cast<int>(std::count_if(distances.begin<DistanceType>(), distances.end<DistanceType>(), [](const DistanceType& distance) { return distance != std::numeric_limits<DistanceType>::infinity(); }));
+}
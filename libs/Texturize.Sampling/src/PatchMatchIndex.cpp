@@ -0,0 +1,293 @@
+#include "stdafx.h"
+
+#include <sampling.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include "CounterRandom.h"
+#include "DescriptorKernel.h"
+#include "Serialization.h"
+
+using namespace Texturize;
+
+namespace {
+	/// \brief The number of colors, that are required to color the pixels of a toroidal field, so that no two neighbors share the same color.
+	static const int FieldColors = 5;
+
+	/// \brief Returns the color of a pixel within a toroidal field, so that no pixel shares its color with one of its four neighbors.
+	///
+	/// Inside the field, the pixels are colored like a checkerboard. If the field has an odd width or height, the last column or row wraps around to a neighbor of 
+	/// the same checkerboard color, so it gets colored with a second checkerboard. The last pixel belongs to both seams and gets a color of its own.
+	static inline int getColor(const cv::Point2i& at, const cv::Size& size)
+	{
+		const bool column = (size.width & 1) && at.x == size.width - 1;
+		const bool row = (size.height & 1) && at.y == size.height - 1;
+
+		if (column && row)
+			return 4;
+
+		return ((at.x + at.y) & 1) + (column || row ? 2 : 0);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// PatchMatch search index implementation                                                  /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct PatchMatchIndex::Selection : public DescriptorKernel::Selection {
+};
+
+PatchMatchIndex::PatchMatchIndex(std::shared_ptr<ISearchSpace> searchSpace, std::shared_ptr<IDescriptorExtractor> descriptorExtractor, const int iterations, const unsigned int seed, cv::NormTypes normType) :
+	SearchIndex(searchSpace, descriptorExtractor, normType), _iterations(iterations), _seed(seed)
+{
+	this->init();
+}
+
+PatchMatchIndex::PatchMatchIndex(std::shared_ptr<ISearchSpace> searchSpace, const int iterations, const unsigned int seed) :
+	PatchMatchIndex(searchSpace, std::make_unique<PCADescriptorExtractor>(), iterations, seed)
+{
+}
+
+void PatchMatchIndex::init()
+{
+	TEXTURIZE_ASSERT(_iterations > 0);											// There must be at least one iteration.
+
+	// Precompute the neighborhood descriptors of the exemplar.
+	std::shared_ptr<const Sample> sample;
+	_searchSpace->sample(sample);
+	sample->getSize(_width, _height);
+
+	_descriptorExtractor->fit(*sample);
+	_exemplarDescriptors = _descriptorExtractor->calculateNeighborhoodDescriptors(*sample);
+	TEXTURIZE_ASSERT(_exemplarDescriptors.type() == CV_32FC1);					// The distance kernels operate on single-precision floating point descriptors.
+	TEXTURIZE_ASSERT(_exemplarDescriptors.isContinuous());
+}
+
+void PatchMatchIndex::reset()
+{
+	std::lock_guard<std::mutex> lock(_fieldMutex);
+	_field.release();
+	_fieldSize = 0;
+}
+
+std::uint64_t PatchMatchIndex::getIdentity() const
+{
+	std::uint64_t identity = Serialization::combine(SearchIndex::getIdentity(), "PatchMatchIndex");
+	identity = Serialization::combine(identity, _iterations);
+	return Serialization::combine(identity, _seed);
+}
+
+bool PatchMatchIndex::isStateful() const
+{
+	return true;
+}
+
+bool PatchMatchIndex::isPositionDependent() const
+{
+	return true;
+}
+
+PatchMatchIndex::PositionType PatchMatchIndex::getPosition(const int index) const
+{
+	return PositionType(
+		static_cast<CoordinateType>(index % _width) / static_cast<CoordinateType>(_width),
+		static_cast<CoordinateType>(index / _width) / static_cast<CoordinateType>(_height));
+}
+
+int PatchMatchIndex::getIndex(const PositionType& position) const
+{
+	int x = static_cast<int>(position[0] * static_cast<CoordinateType>(_width));
+	int y = static_cast<int>(position[1] * static_cast<CoordinateType>(_height));
+	Sample::wrapCoords(_width, _height, x, y);
+
+	return y * _width + x;
+}
+
+void PatchMatchIndex::prepare(const cv::Size& size) const
+{
+	// Most queries do not change the size of the field, so they do not need to lock.
+	const long long key = (static_cast<long long>(size.height) << 32) | static_cast<long long>(size.width);
+
+	if (_fieldSize == key)
+		return;
+
+	std::lock_guard<std::mutex> lock(_fieldMutex);
+
+	if (_fieldSize == key)
+		return;
+
+	cv::Mat field(size, CV_32SC1, cv::Scalar::all(-1));
+
+	// If the field size doubles, the synthesizer moved on to the next level, so each entry is inherited by the four child pixels, shifted by their offset. Odd 
+	// levels drop the last row or column after upsampling, so they are one pixel smaller than twice their parent.
+	if (!_field.empty() && (size.width + 1) / 2 == _field.cols && (size.height + 1) / 2 == _field.rows && size != _field.size()) {
+		const cv::Mat parents = _field;
+
+		tbb::parallel_for(0, size.height, [this, &field, &parents](int y) {
+			for (int x(0); x < field.cols; ++x) {
+				const int parent = parents.at<int>(y / 2, x / 2);
+
+				if (parent < 0)
+					continue;
+
+				int ex = parent % _width + (x & 1), ey = parent / _width + (y & 1);
+				Sample::wrapCoords(_width, _height, ex, ey);
+				field.at<int>(y, x) = ey * _width + ex;
+			}
+		});
+	}
+
+	_field = field;
+	_fieldSize = key;
+}
+
+void PatchMatchIndex::improve(const float* target, const cv::Mat& uv, const cv::Point2i& at, const int iteration, Selection& selection, const std::uint64_t key) const
+{
+	static const int neighbors[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+
+	const int dimensions = _exemplarDescriptors.cols;
+	const int norm = DescriptorKernel::rankingNorm(_normType);
+	int& entry = _field.at<int>(at);
+
+	auto evaluate = [&](const int candidate) -> void {
+		if (!selection.contains(candidate))
+			selection.insert(DescriptorKernel::distance(target, _exemplarDescriptors.ptr<float>(candidate), dimensions, norm), candidate);
+	};
+
+	// Compare the current field entry and the current uv coordinates.
+	const int start = entry >= 0 ? entry : this->getIndex(uv.at<PositionType>(at));
+
+	if (entry >= 0)
+		evaluate(entry);
+
+	evaluate(this->getIndex(uv.at<PositionType>(at)));
+
+	// Propagate the entries of the neighbors. A neighbor at offset d matched exemplar pixel e, so the pixel itself is expected to match e - d.
+	for (int n(0); n < 4; ++n) {
+		int x = at.x + neighbors[n][0], y = at.y + neighbors[n][1];
+		Sample::wrapCoords(_field.cols, _field.rows, x, y);
+		const int neighbor = _field.at<int>(y, x);
+
+		if (neighbor < 0)
+			continue;
+
+		int ex = neighbor % _width - neighbors[n][0], ey = neighbor / _width - neighbors[n][1];
+		Sample::wrapCoords(_width, _height, ex, ey);
+		evaluate(ey * _width + ex);
+	}
+
+	// Randomly search around the best match with an exponentially shrinking radius. The stream depends on the key, so that each pass searches different candidates.
+	const int center = selection.count > 0 ? selection.indices[0] : start;
+	const std::uint64_t pixel = CounterRandom::next(key, static_cast<std::uint64_t>(at.y) * _field.cols + at.x, 0);
+	const std::uint64_t stream = CounterRandom::next(_seed, pixel, static_cast<std::uint64_t>(start));
+	std::uint64_t counter = static_cast<std::uint64_t>(iteration) << 8;
+
+	for (int radius(std::max(_width, _height) / 2); radius >= 1; radius /= 2) {
+		int x = center % _width + static_cast<int>((CounterRandom::uniform(_seed, stream, counter++) * 2.f - 1.f) * radius);
+		int y = center / _width + static_cast<int>((CounterRandom::uniform(_seed, stream, counter++) * 2.f - 1.f) * radius);
+		Sample::wrapCoords(_width, _height, x, y);
+		evaluate(y * _width + x);
+	}
+
+	// Store the best match in the field.
+	if (selection.count > 0)
+		entry = selection.indices[0];
+}
+
+bool PatchMatchIndex::findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist) const
+{
+	std::vector<MatchType> matches;
+
+	if (!this->findNearestNeighbors(descriptors, uv, at, matches, 1, minDist))
+		return false;
+
+	match = matches.front();
+	return true;
+}
+
+bool PatchMatchIndex::findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& matches, const unsigned int k, DistanceType minDist) const
+{
+	TEXTURIZE_ASSERT(uv.channels() == 2);                                      // The UV map should contain two channels, one for u and one for v coordinates.
+	TEXTURIZE_ASSERT(uv.depth() == cv::DataType<CoordinateType>::type);        // The type of the uv map should match the position type.
+	TEXTURIZE_ASSERT(descriptors.type() == CV_32FC1);                          // The distance kernels operate on single-precision floating point descriptors.
+	TEXTURIZE_ASSERT(descriptors.cols == _exemplarDescriptors.cols);           // The runtime descriptors must match the exemplar descriptors.
+	TEXTURIZE_ASSERT(k > 0);
+
+	this->prepare(uv.size());
+
+	// Improve the field entry for the requested number of iterations and keep the best matches.
+	const bool squared = DescriptorKernel::rankingNorm(_normType) != _normType;
+	cv::AutoBuffer<float, 16> distances(k);
+	cv::AutoBuffer<int, 16> indices(k);
+	Selection selection{ { distances.data(), indices.data(), static_cast<int>(k), 0, static_cast<float>(squared ? minDist * minDist : minDist) } };
+	const float* target = descriptors.ptr<float>(at.y * uv.cols + at.x);
+
+	for (int iteration(0); iteration < _iterations; ++iteration)
+		this->improve(target, uv, at, iteration, selection, 0);
+
+	if (selection.count == 0)
+		return false;
+
+	matches.resize(selection.count);
+
+	for (int m(0); m < selection.count; ++m)
+		matches[m] = std::make_pair(this->getPosition(indices[m]), static_cast<DistanceType>(squared ? std::sqrt(distances[m]) : distances[m]));
+
+	return true;
+}
+
+int PatchMatchIndex::findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist, const std::uint64_t key) const
+{
+	TEXTURIZE_ASSERT(uv.channels() == 2);                                      // The UV map should contain two channels, one for u and one for v coordinates.
+	TEXTURIZE_ASSERT(uv.depth() == cv::DataType<CoordinateType>::type);        // The type of the uv map should match the position type.
+	TEXTURIZE_ASSERT(descriptors.type() == CV_32FC1);                          // The distance kernels operate on single-precision floating point descriptors.
+	TEXTURIZE_ASSERT(descriptors.cols == _exemplarDescriptors.cols);           // The runtime descriptors must match the exemplar descriptors.
+
+	const int count = static_cast<int>(pixels.size());
+	const bool squared = DescriptorKernel::rankingNorm(_normType) != _normType;
+	const float minimum = static_cast<float>(squared ? minDist * minDist : minDist);
+
+	matches.create(count, 1, cv::DataType<PositionType>::type);
+	distances.create(count, 1, cv::DataType<DistanceType>::type);
+	this->prepare(uv.size());
+
+	// Each pixel keeps its best match over all iterations.
+	cv::AutoBuffer<float> bestDistances(count);
+	cv::AutoBuffer<int> bestIndices(count);
+	cv::AutoBuffer<Selection> selections(count);
+
+	for (int p(0); p < count; ++p)
+		selections[p] = Selection{ { bestDistances.data() + p, bestIndices.data() + p, 1, 0, minimum } };
+
+	// Alternate between the pixel colors, so that no pixel reads a field entry, that is written concurrently.
+	for (int iteration(0); iteration < _iterations; ++iteration)
+	for (int color(0); color < FieldColors; ++color) {
+		tbb::parallel_for(tbb::blocked_range<int>(0, count), [&](const tbb::blocked_range<int>& range) {
+			for (int p = range.begin(); p < range.end(); ++p) {
+				const cv::Point2i& at = pixels[p];
+
+				if (getColor(at, uv.size()) == color)
+					this->improve(descriptors.ptr<float>(at.y * uv.cols + at.x), uv, at, iteration, selections[p], key);
+			}
+		});
+	}
+
+	// Store the results.
+	int found(0);
+
+	for (int p(0); p < count; ++p) {
+		if (selections[p].count == 0) {
+			distances.at<DistanceType>(p) = std::numeric_limits<DistanceType>::infinity();
+		} else {
+			matches.at<PositionType>(p) = this->getPosition(bestIndices[p]);
+			distances.at<DistanceType>(p) = static_cast<DistanceType>(squared ? std::sqrt(bestDistances[p]) : bestDistances[p]);
+			++found;
+		}
+	}
+
+	return found;
+}
@@ -3,7 +3,13 @@
 #include <sampling.hpp>
 #include <tbb/tbb.h>
 
-#include "log2.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "Serialization.h"
 
 using namespace Texturize;
 
@@ -11,57 +17,402 @@ using namespace Texturize;
 ///// Pyramid Synthesizer implementation	                                                  /////
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+	/// \brief The resolution of the fixed-point sum of match distances. Integer sums do not depend on the order, in which spans are accumulated.
+	static const double DistanceResolution = 1048576.;
+
+	/// \brief Returns the sizes of all pyramid levels, that are required to synthesize a sample of a certain size.
+	///
+	/// Each level is half as large as the next one along each axis, rounded up, so that upsampling a level covers the next one. The coarsest level is upsampled from
+	/// a single texel. This equals the levels of a power-of-two pyramid, if both dimensions are powers of two.
+	static std::vector<cv::Size> getLevelSizes(const cv::Size& size)
+	{
+		std::vector<cv::Size> levels;
+
+		for (cv::Size level(size); level.width > 1 || level.height > 1; level = cv::Size((level.width + 1) / 2, (level.height + 1) / 2))
+			levels.insert(levels.begin(), level);
+
+		return levels;
+	}
+
+	/// \brief Wraps a coordinate into the range [0, extent).
+	static inline int wrap(const int value, const int extent)
+	{
+		const int result = value % extent;
+		return result < 0 ? result + extent : result;
+	}
+
+	/// \brief Expands a window along one axis, so that it is aligned to the sub-pass lattice and can be upsampled from the previous level.
+	///
+	/// If the window covers the whole level or if it crosses the level border, whilst the lattice does not repeat at the border, the window covers the whole level.
+	/// Otherwise the origin is wrapped into the level.
+	static inline void alignWindow(int& origin, int& length, const int extent, const int alignment)
+	{
+		int begin = origin - wrap(origin, alignment);
+		int end = origin + length;
+
+		if (end - begin >= extent || (extent % alignment != 0 && (begin < 0 || end > extent)))
+			begin = 0, end = extent;
+
+		origin = wrap(begin, extent);
+		length = end - begin;
+	}
+
+	/// \brief Copies a window of a pyramid level from a buffer, that contains another window of the same level.
+	/// \param buffer The buffer to copy the texels from.
+	/// \param bufferOrigin The origin of the buffer within the pyramid level.
+	/// \param extent The size of the pyramid level. The level wraps around at its borders.
+	/// \param origin The origin of the window within the pyramid level.
+	/// \param size The size of the window. The window must be covered by the buffer.
+	/// \returns A matrix, containing the texels of the window.
+	static cv::Mat copyWindow(const cv::Mat& buffer, const cv::Point2i& bufferOrigin, const cv::Size& extent, const cv::Point2i& origin, const cv::Size& size)
+	{
+		cv::Mat window(size, buffer.type());
+		const size_t elementSize = buffer.elemSize();
+
+		for (int r(0); r < size.height; ++r) {
+			const int y = wrap(origin.y + r - bufferOrigin.y, extent.height);
+			TEXTURIZE_ASSERT_DBG(y < buffer.rows);
+
+			for (int c(0); c < size.width; ++c) {
+				const int x = wrap(origin.x + c - bufferOrigin.x, extent.width);
+				TEXTURIZE_ASSERT_DBG(x < buffer.cols);
+
+				std::memcpy(window.ptr(r, c), buffer.ptr(y, x), elementSize);
+			}
+		}
+
+		return window;
+	}
+
+	/// \brief Visits the pixels of a sub-pass and passes them to a function, that matches them as one batch.
+	///
+	/// The spans of the scheduler are matched concurrently, if the scheduler distributes them. A stateful search index may read the state of neighboring pixels, 
+	/// whilst it is written by another batch, so for such an index all pixels of the sub-pass are collected and matched within a single batch, which the index 
+	/// synchronizes itself.
+	static void scheduleBatches(const ISearchIndex& index, const ISubpassScheduler& scheduler, const cv::Size& size, const unsigned int subPasses, const unsigned int subPass, 
+		const std::function<void(const std::vector<cv::Point2i>&)>& match)
+	{
+		if (!index.isStateful()) {
+			scheduler.schedule(size, subPasses, subPass, [&match](int r, int begin, int end, int stride) -> void {
+				std::vector<cv::Point2i> pixels;
+
+				for (int c(begin); c < end; c += stride)
+					pixels.push_back(cv::Point2i(c, r));
+
+				match(pixels);
+			});
+
+			return;
+		}
+
+		std::vector<cv::Point2i> pixels;
+
+		SequentialSubpassScheduler().schedule(size, subPasses, subPass, [&pixels](int r, int begin, int end, int stride) -> void {
+			for (int c(begin); c < end; c += stride)
+				pixels.push_back(cv::Point2i(c, r));
+		});
+
+		match(pixels);
+	}
+
+	/// \brief Calculates the key of a synthesis within a `SynthesisCache`.
+	///
+	/// The key identifies the search index by its identity, which covers the exemplar and the parameters of the index. It also contains all settings, that 
+	/// influence the uv map of a level. The randomness selector can not be hashed, so its value is added for each level by `getLevelKey`.
+	static std::uint64_t getCacheKey(const ISearchIndex& index, const PyramidSynthesisSettings& settings)
+	{
+		std::uint64_t key = Serialization::combine(Serialization::HashBasis, index.getIdentity());
+		key = Serialization::combine(key, settings._seedCoords.x);
+		key = Serialization::combine(key, settings._seedCoords.y);
+		key = Serialization::combine(key, settings._rngState);
+		key = Serialization::combine(key, settings._scale);
+		key = Serialization::combine(key, settings._correctionLevelThreshold);
+		key = Serialization::combine(key, settings._correctionPasses);
+		key = Serialization::combine(key, settings._correctionSubPasses);
+		key = Serialization::combine(key, static_cast<int>(settings._correctionMode));
+		key = Serialization::combine(key, settings._deterministic);
+		key = Serialization::combine(key, settings._convergenceThreshold);
+		key = Serialization::combine(key, settings._maxCorrectionPasses);
+
+		if (settings._guidanceMap.has_value())
+			key = Serialization::combine(key, Serialization::hash(settings._guidanceMap.value()));
+
+		return key;
+	}
+
+	/// \brief Calculates the cache key of a pyramid level from the key of the previous level.
+	///
+	/// Chaining the keys makes each level depend on the sizes and randomness values of all coarser levels, so levels of different output sizes are only shared, 
+	/// if their pyramids match up to this level.
+	static inline std::uint64_t getLevelKey(std::uint64_t key, const PyramidSynthesizerState& state)
+	{
+		key = Serialization::combine(key, state.level());
+		key = Serialization::combine(key, state.getExtent().width);
+		key = Serialization::combine(key, state.getExtent().height);
+		return Serialization::combine(key, state.getRandomness());
+	}
+
+	/// \brief Calculates the key, that selects the random streams of the search index for a correction pass.
+	///
+	/// The key depends on the seed of the synthesis, the pyramid level and the pass, so that randomized indices search different candidates in each pass, while the
+	/// result stays reproducible for a given seed. Transfers are not part of a correction pass, so they use the pass `-1`.
+	static inline std::uint64_t getMatchKey(const PyramidSynthesizerState& state, const int pass)
+	{
+		std::uint64_t key = Serialization::combine(Serialization::HashBasis, state.config()._rngState);
+		key = Serialization::combine(key, state.level());
+		return Serialization::combine(key, pass);
+	}
+}
+
 PyramidSynthesizer::PyramidSynthesizer(std::shared_ptr<ISearchIndex> catalog) :
 	SynthesizerBase(std::move(catalog))
 {
 }
 
 void PyramidSynthesizer::synthesize(int width, int height, Sample& result, const SynthesisSettings& config) const
+{
+	SynthesisCheckpoint checkpoint;
+	checkpoint.size = cv::Size(width, height);
+	this->continueFrom(checkpoint, config, -1, false);
+
+	TEXTURIZE_ASSERT_DBG(checkpoint.uv.cols == width);
+	TEXTURIZE_ASSERT_DBG(checkpoint.uv.rows == height);
+
+	result = Sample(checkpoint.uv);
+}
+
+void PyramidSynthesizer::resume(SynthesisCheckpoint& checkpoint, const SynthesisSettings& config, const int lastLevel) const
+{
+	this->continueFrom(checkpoint, config, lastLevel, true);
+}
+
+void PyramidSynthesizer::continueFrom(SynthesisCheckpoint& checkpoint, const SynthesisSettings& config, const int lastLevel, const bool identify) const
 {
 	// The configuration must contain arguments for pyramidal synthesis.
 	const PyramidSynthesisSettings* settings = dynamic_cast<const PyramidSynthesisSettings*>(&config);
 
 	TEXTURIZE_ASSERT(settings != nullptr);							// The synthesis settings must be compatible.
 	TEXTURIZE_ASSERT(settings->validate());							// The synthesis configuration must be valid.
+	TEXTURIZE_ASSERT(checkpoint.size.width > 0 && checkpoint.size.height > 0);	// The result must not be empty.
+
+	// Each pyramid level is upsampled from a level, that is half as large along each axis. Odd sizes are rounded up and the texels, that exceed the level, are 
+	// dropped after upsampling. Each level wraps around at its borders, so samples with power-of-two sizes can be tiled. Other sizes are not guaranteed to tile, 
+	// since the dropped texels break the correspondence between the borders of subsequent levels.
+	const std::vector<cv::Size> levels = getLevelSizes(checkpoint.size);
+	const int depth = lastLevel < 0 ? static_cast<int>(levels.size()) : std::min(lastLevel + 1, static_cast<int>(levels.size()));
+	const bool resumed = checkpoint.level >= 0;
+	const bool identified = identify || resumed || settings->_cache || !settings->_checkpointHandler.empty();
+	const std::uint64_t key = identified ? getCacheKey(*_catalog, *settings) : 0;
+	cv::Mat sample;
+
+	if (!resumed)
+	{
+		// The synthesis is performed within uv-space, so the result is initialized as two-channel sample (including 
+		// channels u and v). It will be initialized with the seed coords of the exemplar, which represents the coordinates 
+		// inside the first pyramid level. This can also be seen as "initial translation", meaning that it results in a 
+		// linear shift within the actual synthesis result, if not set to zero.
+		sample = cv::Mat(1, 1, CV_32FC2);
+		sample.at<cv::Vec2f>(0, 0) = config._seedCoords;
+
+		checkpoint.rngState = config._rngState;
+		checkpoint.settings = key;
+		checkpoint.uv = sample;
+	}
+	else
+	{
+		TEXTURIZE_ASSERT(!_catalog->isStateful());						// The state of the search index is not stored within the checkpoint.
+		TEXTURIZE_ASSERT(checkpoint.settings == key);					// The checkpoint must have been created with the same search index and settings.
+		TEXTURIZE_ASSERT(checkpoint.rngState == config._rngState);		// The checkpoint must have been created with the same seed.
+		TEXTURIZE_ASSERT(checkpoint.level < static_cast<int>(levels.size()));	// The checkpoint must have been created for the same result size.
+		TEXTURIZE_ASSERT(checkpoint.uv.size() == levels[checkpoint.level]);	// The checkpoint must have been created for the same result size.
 
-	// Since synthesis works on pyramids, the pyramid resolutions are limited to integral PoT numbers.
-	// If other sizes are provided, we perform synthsis to a larger sample and crop it afterwards.
-	// Note that this most certainly removes the ability to tile the texture.
-	int w(nextPoT(width)), h(nextPoT(height));
+		sample = checkpoint.uv;
+	}
 
-	// The sample size represents a square with a length euqal to the largest dimension.
-	cv::Size sampleSize = w >= h ? cv::Size(w, w) : cv::Size(h, h);
-	
-	// Calculate the pyramid depth.
-	int depth = log2(static_cast<uint32_t>(sampleSize.width));
+	// A stateful index must not carry over state from a previous synthesis.
+	if (_catalog->isStateful())
+		_catalog->reset();
 
-	// The synthesis is performed within uv-space, so the result is initialized as two-channel sample (including 
-	// channels u and v). It will be initialized with the seed coords of the exemplar, which represents the coordinates 
-	// inside the first pyramid level. This can also be seen as "initial translation", meaning that it results in a 
-	// linear shift within the actual synthesis result, if not set to zero.
+	// Get a state object to handle common synthesizer configuration. Stateful indices bypass the cache, since their state is not cached along with the uv maps.
+	PyramidSynthesizerState state(*settings);
+	const bool cached = settings->_cache && !resumed && !_catalog->isStateful();
+	std::uint64_t levelKey = key;
+
+	// Perform synthesis on each pyramid level, starting with the first level, that has not been finished yet.
+	for (int l(resumed && !checkpoint.finished ? checkpoint.level : checkpoint.level + 1); l < depth; ++l)
+	{
+		// An unfinished level has already been upsampled and jittered, so its sample is passed instead of the previous level. The randomness, that is selected 
+		// from it, is only used for jitter.
+		state.update(l, sample, cv::Rect(cv::Point2i(0, 0), levels[l]), levels[l]);
+
+		if (!cached)
+		{
+			this->synthesizeLevel(sample, state, &checkpoint);
+			continue;
+		}
+
+		// If the level has already been synthesized with the same settings, resume from the cached uv map.
+		levelKey = getLevelKey(levelKey, state);
+
+		if (settings->_cache->find(levelKey, sample))
+		{
+			TEXTURIZE_ASSERT_DBG(sample.size() == levels[l]);
+			settings->_progressHandler.execute(l, -1, sample, CorrectionStatistics());
+
+			checkpoint.level = l;
+			checkpoint.pass = -1;
+			checkpoint.finished = true;
+			checkpoint.distance = 0.;
+			checkpoint.uv = sample;
+			settings->_checkpointHandler.execute(checkpoint);
+			continue;
+		}
+
+		this->synthesizeLevel(sample, state, &checkpoint);
+		settings->_cache->store(levelKey, sample);
+	}
+}
+
+void PyramidSynthesizer::synthesize(const cv::Size& size, Sample& result, const SynthesisSettings& config) const
+{
+	this->synthesize(size.width, size.height, result, config);
+}
+
+void PyramidSynthesizer::synthesizeRegion(const cv::Rect& window, const cv::Size& size, Sample& result, const SynthesisSettings& config) const
+{
+	// The configuration must contain arguments for pyramidal synthesis.
+	const PyramidSynthesisSettings* settings = dynamic_cast<const PyramidSynthesisSettings*>(&config);
+
+	TEXTURIZE_ASSERT(settings != nullptr);							// The synthesis settings must be compatible.
+	TEXTURIZE_ASSERT(settings->validate());							// The synthesis configuration must be valid.
+	TEXTURIZE_ASSERT(!window.empty());								// The window must not be empty.
+	TEXTURIZE_ASSERT((window & cv::Rect(cv::Point2i(0, 0), size)) == window);	// The window must be located within the texture.
+	TEXTURIZE_ASSERT(!_catalog->isStateful());						// The state of the search index would depend on the window.
+	TEXTURIZE_ASSERT(!_catalog->isPositionDependent());				// The matches must not depend on the position of a pixel within the window.
+
+	// Calculate the pyramid levels, just like a full synthesis of the texture would do.
+	const std::vector<cv::Size> levels = getLevelSizes(size);
+	const int depth = static_cast<int>(levels.size());
+
+	// Each correction sub-pass reads the neighborhood descriptors within a radius of two pixels, so it spreads changes by two pixels along each axis. The windows are
+	// aligned to the sub-pass lattice, so that each pixel gets corrected within the same sub-pass, as it would during full synthesis. If the number of passes is
+	// adaptive, the margin must cover the maximum number of passes, that may be performed.
+	const int subPasses = settings->_correctionMode == PyramidSynthesisSettings::CorrectionMode::Jacobi ? 1 : static_cast<int>(settings->_correctionSubPasses);
+	const unsigned int passes = settings->_convergenceThreshold > 0.f ? std::max(settings->_correctionPasses, settings->_maxCorrectionPasses) : settings->_correctionPasses;
+	const int margin = 2 * static_cast<int>(passes) * subPasses * subPasses;
+
+	// Compute the dependency cone, starting with the requested window at the finest level. The window of each level must cover the padded window of the next one.
+	std::vector<cv::Rect> windows(depth);
+	cv::Rect required = window;
+
+	for (int l(depth - 1); l >= 0; --l)
+	{
+		const cv::Size& extent = levels[l];
+		cv::Rect padded = required;
+
+		if (l >= static_cast<int>(settings->_correctionLevelThreshold))
+			padded = cv::Rect(padded.x - margin, padded.y - margin, padded.width + 2 * margin, padded.height + 2 * margin);
+
+		alignWindow(padded.x, padded.width, extent.width, 2 * subPasses);
+		alignWindow(padded.y, padded.height, extent.height, 2 * subPasses);
+
+		windows[l] = padded;
+		required = cv::Rect(cv::Point2i(padded.x / 2, padded.y / 2), cv::Point2i((padded.x + padded.width + 1) / 2, (padded.y + padded.height + 1) / 2));
+	}
+
+	// Start from the same origin as the full synthesis.
 	cv::Mat sample(1, 1, CV_32FC2);
 	sample.at<cv::Vec2f>(0, 0) = config._seedCoords;
+	cv::Point2i origin(0, 0);
+	cv::Size parentExtent(1, 1);
 
 	// Get a state object to handle common synthesizer configuration.
 	PyramidSynthesizerState state(*settings);
 
-	// Perform synthesis on each pyramid level.
+	// Perform synthesis on the window of each pyramid level. The texels of the previous level, that are upsampled into the window, are copied from its window.
 	for (int l(0); l < depth; ++l)
 	{
-		state.update(l, sample);
+		const cv::Rect& target = windows[l];
+		const cv::Rect parent(cv::Point2i(target.x / 2, target.y / 2), cv::Point2i((target.x + target.width + 1) / 2, (target.y + target.height + 1) / 2));
+
+		sample = copyWindow(sample, origin, parentExtent, parent.tl(), parent.size());
+		state.update(l, sample, target, levels[l]);
 		this->synthesizeLevel(sample, state);
-	}
 
-	// Crop the result and return it.
-	TEXTURIZE_ASSERT_DBG(sample.size().width >= width);
-	TEXTURIZE_ASSERT_DBG(sample.size().height >= height);
+		origin = target.tl();
+		parentExtent = levels[l];
+	}
 
-	result = Sample(sample(cv::Rect(0, 0, width, height)));
+	// Copy the requested window and return it.
+	result = Sample(copyWindow(sample, origin, size, window.tl(), window.size()));
 }
 
-void PyramidSynthesizer::synthesize(const cv::Size& size, Sample& result, const SynthesisSettings& config) const
+void PyramidSynthesizer::synthesizeBatch(const std::vector<Job>& jobs, const BatchResultCallback& callback) const
 {
-	this->synthesize(size.width, size.height, result, config);
+	// Each job keeps track of its own levels, sample and state.
+	struct Progress {
+		std::vector<cv::Size> levels;
+		cv::Mat sample;
+		std::unique_ptr<PyramidSynthesizerState> state;
+	};
+
+	TEXTURIZE_ASSERT(jobs.size() <= 1 || !_catalog->isStateful());	// Concurrent jobs share the search index, so it must not keep state between queries.
+
+	// A single job may use a stateful index, which must not carry over state from a previous synthesis.
+	if (_catalog->isStateful())
+		_catalog->reset();
+
+	std::vector<Progress> progress(jobs.size());
+	size_t depth(0);
+
+	for (size_t j(0); j < jobs.size(); ++j)
+	{
+		TEXTURIZE_ASSERT(jobs[j].size.width > 0 && jobs[j].size.height > 0);	// The result of each job must not be empty.
+		TEXTURIZE_ASSERT(jobs[j].settings.validate());							// The synthesis configuration must be valid.
+
+		// Start from the seed coords of the job, just like a single synthesis.
+		progress[j].levels = getLevelSizes(jobs[j].size);
+		progress[j].sample = cv::Mat(1, 1, CV_32FC2);
+		progress[j].sample.at<cv::Vec2f>(0, 0) = jobs[j].settings._seedCoords;
+		progress[j].state = std::make_unique<PyramidSynthesizerState>(jobs[j].settings);
+
+		depth = std::max(depth, progress[j].levels.size());
+	}
+
+	// Hand a finished job to the callback and release its sample.
+	auto finish = [&progress, &callback](const size_t j) -> void {
+		callback(j, Sample(progress[j].sample));
+		progress[j].sample.release();
+		progress[j].state.reset();
+	};
+
+	for (size_t j(0); j < jobs.size(); ++j)
+		if (progress[j].levels.empty())
+			finish(j);
+
+	// Synthesize each level for all jobs, that have not finished yet. The queries of different jobs are not gathered into common batches, since each batch is 
+	// matched against the uv map of one job and the jobs may converge after a different number of passes.
+	for (size_t l(0); l < depth; ++l)
+	{
+		std::vector<size_t> active;
+
+		for (size_t j(0); j < jobs.size(); ++j)
+			if (l < progress[j].levels.size())
+				active.push_back(j);
+
+		tbb::parallel_for(size_t(0), active.size(), [this, &progress, &active, l](const size_t a) -> void {
+			Progress& job = progress[active[a]];
+			const cv::Size& level = job.levels[l];
+
+			job.state->update(static_cast<int>(l), job.sample, cv::Rect(cv::Point2i(0, 0), level), level);
+			this->synthesizeLevel(job.sample, *job.state);
+		});
+
+		for (const size_t j : active)
+			if (progress[j].levels.size() == l + 1)
+				finish(j);
+	}
 }
 
 void PyramidSynthesizer::transferStyle(const Sample& target, Sample& result, const SynthesisSettings& config) const
@@ -72,6 +423,10 @@ void PyramidSynthesizer::transferStyle(const Sample& target, Sample& result, con
 	TEXTURIZE_ASSERT(settings != nullptr);							// The synthesis settings must be compatible.
 	TEXTURIZE_ASSERT(settings->validate());							// The synthesis configuration must be valid.
 
+	// A stateful index must not carry over state from a previous synthesis.
+	if (_catalog->isStateful())
+		_catalog->reset();
+
 	// Get a state object to handle common synthesizer configuration.
 	PyramidSynthesizerState state(*settings);
 
@@ -79,28 +434,88 @@ void PyramidSynthesizer::transferStyle(const Sample& target, Sample& result, con
 	this->transferTo(target, result, state);
 }
 
-void PyramidSynthesizer::synthesizeLevel(cv::Mat& sample, const PyramidSynthesizerState& state) const
+void PyramidSynthesizer::synthesizeLevel(cv::Mat& sample, const PyramidSynthesizerState& state, SynthesisCheckpoint* checkpoint) const
 {
-	// Start by upsampling the current result. This increases the current resolution by a factor of two into each dimension.
-	this->upsample(sample, state);
+	const PyramidSynthesisSettings& config = state.config();
+
+	// Update the checkpoint and pass it to the handler.
+	auto report = [&sample, &state, &config, checkpoint](const int pass, const bool finished, const double distance) -> void {
+		if (checkpoint == nullptr)
+			return;
 
-	// Simply upsampling would lead to a simple tiled texture wall, so to introduce spatial randomness, shift each tile a 
-	// little bit. This process is called jitter.
-	this->jitter(sample, state);
+		checkpoint->level = static_cast<int>(state.level());
+		checkpoint->pass = pass;
+		checkpoint->finished = finished;
+		checkpoint->distance = distance;
+		checkpoint->uv = sample;
+		config._checkpointHandler.execute(*checkpoint);
+	};
 
-	// Perform multiple correction passes, if synthesis has reached a certain threshold.
-	// If the threshold has not been reached, report the progress - otherwise this is done for each sub-pass.
-	if (state.level() < state.config()._correctionLevelThreshold)
+	// If the checkpoint contains an unfinished level, continue correcting it after the last pass.
+	const bool resumed = checkpoint != nullptr && checkpoint->level == static_cast<int>(state.level()) && !checkpoint->finished;
+
+	if (resumed)
+	{
+		TEXTURIZE_ASSERT_DBG(sample.size() == state.getWindow().size());
+		TEXTURIZE_ASSERT_DBG(state.level() >= config._correctionLevelThreshold);
+	}
+	else
 	{
-		state.config()._progressHandler.execute(state.level(), -1, sample);
-		return;
+		// Start by upsampling the current result. This increases the current resolution by a factor of two into each dimension.
+		this->upsample(sample, state);
+
+		// If the level has an odd size, upsampling produces one row or column too much. Drop the texels, that exceed the window.
+		const cv::Size size = state.getWindow().size();
+
+		if (sample.size() != size)
+		{
+			TEXTURIZE_ASSERT_DBG(sample.cols >= size.width && sample.rows >= size.height);
+			sample = sample(cv::Rect(cv::Point2i(0, 0), size)).clone();
+		}
+
+		// Simply upsampling would lead to a simple tiled texture wall, so to introduce spatial randomness, shift each tile a 
+		// little bit. This process is called jitter.
+		this->jitter(sample, state);
+
+		// Perform multiple correction passes, if synthesis has reached a certain threshold.
+		// If the threshold has not been reached, report the progress - otherwise this is done for each sub-pass.
+		if (state.level() < config._correctionLevelThreshold)
+		{
+			config._progressHandler.execute(state.level(), -1, sample, CorrectionStatistics());
+			report(-1, true, 0.);
+			return;
+		}
 	}
 
-	for (unsigned int p(0); p < state.config()._correctionPasses; ++p)
+	// If a convergence threshold is set, the number of passes adapts to the convergence of the level. Otherwise a fixed number of passes is executed.
+	const bool adaptive = config._convergenceThreshold > 0.f;
+	const unsigned int passes = adaptive ? std::max(config._correctionPasses, config._maxCorrectionPasses) : config._correctionPasses;
+	const unsigned int first = resumed ? static_cast<unsigned int>(checkpoint->pass + 1) : 0;
+	double previousDistance = resumed ? checkpoint->distance : 0.;
+
+	for (unsigned int p(first); p < passes; ++p)
 	{
-		this->correct(sample, state);
-		state.config()._progressHandler.execute(state.level(), p, sample);
+		CorrectionStatistics statistics;
+		this->correct(sample, state, p, statistics);
+		config._progressHandler.execute(state.level(), p, sample, statistics);
+
+		// Stop, if only few pixels have changed or the mean match distance did not improve significantly over the previous pass.
+		const double distance = statistics.meanDistance();
+		const bool stable = statistics.changeRate() < config._convergenceThreshold;
+		const bool saturated = p > 0 && (previousDistance <= 0. || (previousDistance - distance) / previousDistance < config._convergenceThreshold);
+		const bool converged = adaptive && (stable || saturated);
+
+		report(static_cast<int>(p), converged || p + 1 == passes, distance);
+
+		if (converged)
+			break;
+
+		previousDistance = distance;
 	}
+
+	// A level without correction passes is finished after jitter.
+	if (first >= passes)
+		report(static_cast<int>(passes) - 1, true, previousDistance);
 }
 
 void PyramidSynthesizer::upsample(cv::Mat& sample, const PyramidSynthesizerState& state) const
@@ -147,7 +562,7 @@ void PyramidSynthesizer::jitter(cv::Mat& sample, const PyramidSynthesizerState&
 	{
 		cv::Point2i point(c, r);
 		cv::Vec2f& coords = sample.at<cv::Vec2f>(point);
-		coords += this->translateTexel(point, state);
+		coords += this->translateTexel(state.getPosition(point), state);
 
 		// Wrap the coords, so that they are in a range (0.f, 1.f].
 		Sample::wrapCoords(coords);
@@ -157,13 +572,19 @@ void PyramidSynthesizer::jitter(cv::Mat& sample, const PyramidSynthesizerState&
 	state.config()._feedbackHandler.execute("Jittered", sample);
 }
 
-void PyramidSynthesizer::correct(cv::Mat& sample, const PyramidSynthesizerState& state) const
+void PyramidSynthesizer::correct(cv::Mat& sample, const PyramidSynthesizerState& state, const unsigned int pass, CorrectionStatistics& statistics) const
 {
-	// Get the total number of sub-passes. The number of passes must be executed along each axis.
-	const unsigned int subPasses = state.config()._correctionSubPasses;
+	// Get the total number of sub-passes. The number of passes must be executed along each axis. A Jacobi pass visits all pixels at once.
+	const bool jacobi = state.config()._correctionMode == PyramidSynthesisSettings::CorrectionMode::Jacobi;
+	const unsigned int subPasses = jacobi ? 1 : state.config()._correctionSubPasses;
 	const unsigned int totalSubPasses = subPasses * subPasses;
-	const unsigned int width = sample.cols, height = sample.rows;
+	const cv::Rect window = state.getWindow();
+	const std::uint64_t key = getMatchKey(state, static_cast<int>(pass));
 	std::shared_ptr<IDescriptorExtractor> descriptorExtractor = _catalog->getDescriptorExtractor();
+
+	TEXTURIZE_ASSERT_DBG(window.size() == sample.size());			// The sample must cover the window of the current level.
+	TEXTURIZE_ASSERT_DBG(window.x % subPasses == 0);				// The window must be aligned to the sub-pass lattice.
+	TEXTURIZE_ASSERT_DBG(window.y % subPasses == 0);				// The window must be aligned to the sub-pass lattice.
 	
 	// Request a reference of the exemplar.
 	std::shared_ptr<const Sample> exemplar;
@@ -174,45 +595,105 @@ void PyramidSynthesizer::correct(cv::Mat& sample, const PyramidSynthesizerState&
 
 	if (state.config()._guidanceMap.has_value()) {
 		cv::Mat guidanceMap = (cv::Mat)state.config()._guidanceMap.value();
-		cv::resize(guidanceMap, guidanceMap, cv::Size(width, height));
+		cv::resize(guidanceMap, guidanceMap, state.getExtent());
+
+		// If only a window of the level is synthesized, only use the guidance channels of this window.
+		if (window.size() != state.getExtent())
+			guidanceMap = copyWindow(guidanceMap, cv::Point2i(0, 0), state.getExtent(), window.tl(), window.size());
+
 		guidanceDescriptors = Sample(guidanceMap.reshape(guidanceMap.channels(), 1));
 	}
 
+	// Get the scheduler, that visits the pixels of each sub-pass.
+	std::shared_ptr<const ISubpassScheduler> scheduler = this->getSubpassScheduler(state);
+
+	// The descriptors are calculated once for each correction pass. Afterwards, only the descriptors that depend on texels that have been changed by the previous 
+	// sub-pass are refreshed. The runtime descriptors are stored in the first columns of the descriptor matrix, followed by the guidance channels.
+	cv::Mat descriptors, runtimeDescriptors;
+	cv::Mat changed = cv::Mat::zeros(sample.size(), CV_8UC1);
+
+	// Spans may be corrected concurrently, so their statistics are accumulated atomically. The distances are summed up in fixed-point, so that the statistics and
+	// all decisions based on them do not depend on the number of threads.
+	std::atomic<size_t> matchedPixels(0), changedPixels(0);
+	std::atomic<std::int64_t> distanceSum(0);
+
+	// In Jacobi mode, matches are written into a second buffer, so that all pixels are matched against the uv map of the previous pass. In deterministic mode, 
+	// each sub-pass reads from the sample and writes into the second buffer, which is merged back after the sub-pass. Otherwise the matches are written directly
+	// into the sample.
+	const bool deterministic = !jacobi && state.config()._deterministic;
+	cv::Mat target = jacobi || deterministic ? sample.clone() : sample;
+
 	// Apply each sub-pass subsequently.
 	for (unsigned int sp(0); sp < totalSubPasses; ++sp) {
-		// Get the neighborhood descriptors for the current sub-pass. The descriptors are rebuild for each sub-pass, so that the sample converges against the expected result.
-		cv::Mat descriptors = descriptorExtractor->calculateNeighborhoodDescriptors(*exemplar, sample).t();
-
-		// Append guidance channels.
-		if (guidanceDescriptors.has_value())
-			for (int cn(0); cn < guidanceDescriptors.value().channels(); ++cn)
-				descriptors.push_back(guidanceDescriptors.value().getChannel(cn));
-
-		descriptors = descriptors.t();
-
-		for (int r = 0; r < sample.rows; ++r)
-		for (int c = 0; c < sample.cols; ++c) {
-			// Check if the pixel should be corrected within the current sub-pass.
-			int col = c % subPasses;
-			int row = r % subPasses;
-			int subPass = row * subPasses + col;
-
-			// Only correct the pixel, if it should be done within this sub-pass.
-			if (subPass != sp)
-				continue;
-
-			// Match the descriptor with the search space.
-			cv::Point2i point(c, r);
-			SearchIndex::MatchType match;
-			cv::Vec2f& coords = sample.at<cv::Vec2f>(point);
-
-			if (_catalog->findNearestNeighbor(descriptors, sample, point, match))
-				coords = std::move(match.first);
+		if (sp == 0) {
+			// Get the neighborhood descriptors for the current pass.
+			descriptors = descriptorExtractor->calculateNeighborhoodDescriptors(*exemplar, sample).t();
+			const int runtimeChannels = descriptors.rows;
+
+			// Append guidance channels.
+			if (guidanceDescriptors.has_value())
+				for (int cn(0); cn < guidanceDescriptors.value().channels(); ++cn)
+					descriptors.push_back(guidanceDescriptors.value().getChannel(cn));
+
+			descriptors = descriptors.t();
+			runtimeDescriptors = descriptors.colRange(0, runtimeChannels);
+		} else {
+			// Refresh the descriptors that have been invalidated by the previous sub-pass, so that the sample converges against the expected result.
+			descriptorExtractor->updateNeighborhoodDescriptors(*exemplar, sample, changed, runtimeDescriptors);
+			changed.setTo(cv::Scalar::all(0));
 		}
 
+		// Only visit the pixels, that should be corrected within the current sub-pass.
+		scheduleBatches(*_catalog, *scheduler, sample.size(), subPasses, sp, [this, &sample, &target, &descriptors, &changed, &matchedPixels, &changedPixels, &distanceSum, key](const std::vector<cv::Point2i>& pixels) -> void {
+			// Match all descriptors of the batch with the search space at once.
+			cv::Mat matches, distances;
+
+			if (_catalog->findNearestNeighborBatch(descriptors, sample, pixels, matches, distances, 0, key) == 0)
+				return;
+
+			size_t matchedSpan(0), changedSpan(0);
+			std::int64_t distanceSpan(0);
+
+			for (int p(0); p < static_cast<int>(pixels.size()); ++p) {
+				const SearchIndex::DistanceType distance = distances.at<SearchIndex::DistanceType>(p);
+
+				if (distance == std::numeric_limits<SearchIndex::DistanceType>::infinity())
+					continue;
+
+				matchedSpan++;
+				distanceSpan += static_cast<std::int64_t>(std::llround(static_cast<double>(distance) * DistanceResolution));
+
+				// Remember the texel, if it has been changed.
+				const cv::Vec2f& match = matches.at<SearchIndex::PositionType>(p);
+				cv::Vec2f& coords = target.at<cv::Vec2f>(pixels[p]);
+
+				if (coords != match) {
+					coords = match;
+					changed.at<uchar>(pixels[p]) = 1;
+					changedSpan++;
+				}
+			}
+
+			matchedPixels += matchedSpan;
+			changedPixels += changedSpan;
+			distanceSum += distanceSpan;
+		});
+
+		// Make the matches of the sub-pass visible to the next one.
+		if (deterministic)
+			target.copyTo(sample, changed);
+
 		// Send the temporary result to handlers.
-		state.config()._feedbackHandler.execute("Corrected", sample);
+		state.config()._feedbackHandler.execute("Corrected", target);
 	}
+
+	// In Jacobi mode, the second buffer becomes the sample of the next pass.
+	sample = target;
+
+	// Return the statistics of the pass.
+	statistics.pixels = matchedPixels;
+	statistics.changed = changedPixels;
+	statistics.distance = static_cast<double>(distanceSum) / DistanceResolution;
 }
 
 cv::Vec2f PyramidSynthesizer::scaleTexel(const cv::Vec2f& uv, const cv::Vec2f& delta, float spacing) const
@@ -282,6 +763,7 @@ void PyramidSynthesizer::transferTo(const Sample& target, Sample& result, const
 {
 	const unsigned int subPasses = state.config()._correctionSubPasses;
 	const unsigned int totalSubPasses = subPasses * subPasses;
+	const std::uint64_t key = getMatchKey(state, -1);
 	std::shared_ptr<IDescriptorExtractor> descriptorExtractor = _catalog->getDescriptorExtractor();
 
 	// Initialize a matrix that will contain the result.
@@ -297,33 +779,27 @@ void PyramidSynthesizer::transferTo(const Sample& target, Sample& result, const
 	Sample targetSpace;
 	_catalog->getSearchSpace()->transform(target, targetSpace);
 
+	// Get the scheduler, that visits the pixels of each sub-pass.
+	std::shared_ptr<const ISubpassScheduler> scheduler = this->getSubpassScheduler(state);
+
+	// Get the neighborhood descriptors of the target space. They only depend on the target, so they do not change between sub-passes.
+	const cv::Mat descriptors = descriptorExtractor->calculateNeighborhoodDescriptors(targetSpace);
+
 	// For each pixel in the sample, lookup the best match.
 	// NOTE: This is similar to an initial correction pass.
 	for (unsigned int sp(0); sp < totalSubPasses; ++sp)
 	{
-		// Get the neighborhood descriptors of the target space.
-		const cv::Mat descriptors = descriptorExtractor->calculateNeighborhoodDescriptors(targetSpace);
+		scheduleBatches(*_catalog, *scheduler, sample.size(), subPasses, sp, [this, &sample, &descriptors, key](const std::vector<cv::Point2i>& pixels) -> void {
+			// Match all descriptors of the batch with the search space at once.
+			cv::Mat matches, distances;
 
-		for (int r = 0; r < sample.rows; ++r)
-		for (int c = 0; c < sample.cols; ++c)
-		{
-			// Check if the pixel should be corrected within the current sub-pass.
-			int col = c % subPasses;
-			int row = r % subPasses;
-			int subPass = row * subPasses + col;
-
-			// Only correct the pixel, if it should be done within this sub-pass.
-			if (subPass != sp)
-				continue;
-
-			// Match the descriptor with the search space.
-			cv::Point2i point(c, r);
-			SearchIndex::MatchType match;
-			cv::Vec2f& coords = sample.at<cv::Vec2f>(point);
-
-			if (_catalog->findNearestNeighbor(descriptors, sample, point, match))
-				coords = std::move(match.first);
-		}
+			if (_catalog->findNearestNeighborBatch(descriptors, sample, pixels, matches, distances, 0, key) == 0)
+				return;
+
+			for (int p(0); p < static_cast<int>(pixels.size()); ++p)
+				if (distances.at<SearchIndex::DistanceType>(p) != std::numeric_limits<SearchIndex::DistanceType>::infinity())
+					sample.at<cv::Vec2f>(pixels[p]) = matches.at<SearchIndex::PositionType>(p);
+		});
 
 		// TODO: Run correction passes.
 		state.config()._feedbackHandler.execute("Status", sample);
@@ -334,6 +810,12 @@ void PyramidSynthesizer::transferTo(const Sample& target, Sample& result, const
 	result = Sample(sample);
 }
 
+std::shared_ptr<const ISubpassScheduler> PyramidSynthesizer::getSubpassScheduler(const PyramidSynthesizerState& state) const
+{
+	std::shared_ptr<const ISubpassScheduler> scheduler = state.config()._subpassScheduler;
+	return scheduler ? scheduler : std::make_shared<SequentialSubpassScheduler>();
+}
+
 std::unique_ptr<SynthesizerBase> PyramidSynthesizer::createSynthesizer(std::shared_ptr<ISearchIndex> catalog)
 {
 	return std::unique_ptr<PyramidSynthesizer>(new PyramidSynthesizer(catalog));
@@ -380,7 +862,7 @@ void ParallelPyramidSynthesizer::jitter(cv::Mat& sample, const PyramidSynthesize
 	int level = state.level();
 	
 	sample.forEach<cv::Vec2f>([this, &state, level](cv::Vec2f& coords, const int* idx) -> void {
-		coords += this->translateTexel(cv::Point2i(idx[1], idx[0]), state);
+		coords += this->translateTexel(state.getPosition(cv::Point2i(idx[1], idx[0])), state);
 
 		// Wrap the coords, so that they are in a range (0.f, 1.f].
 		Sample::wrapCoords(coords);
@@ -390,116 +872,10 @@ void ParallelPyramidSynthesizer::jitter(cv::Mat& sample, const PyramidSynthesize
 	state.config()._feedbackHandler.execute("Jittered", sample);
 }
 
-void ParallelPyramidSynthesizer::correct(cv::Mat& sample, const PyramidSynthesizerState& state) const
-{
-	// Get the total number of sub-passes. The number of passes must be executed along each axis.
-	const unsigned int subPasses = state.config()._correctionSubPasses;
-	const unsigned int totalSubPasses = subPasses * subPasses;
-	const unsigned int width = sample.cols, height = sample.rows;
-
-	std::shared_ptr<ISearchIndex> searchIndex = _catalog;
-	std::shared_ptr<IDescriptorExtractor> descriptorExtractor = searchIndex->getDescriptorExtractor();
-
-	// Request a reference of the exemplar.
-	std::shared_ptr<const Sample> exemplar;
-	searchIndex->getSearchSpace()->sample(exemplar);
-
-	// Get the guidance channel map for the current scale and reshape it. After reshaping, the matrix contains one row that can be appended to the descriptors.
-	std::optional<Sample> guidanceDescriptors;
-
-	if (state.config()._guidanceMap.has_value()) {
-		cv::Mat guidanceMap = (cv::Mat)state.config()._guidanceMap.value();
-		cv::resize(guidanceMap, guidanceMap, cv::Size(width, height));
-		guidanceDescriptors = Sample(guidanceMap.reshape(guidanceMap.channels(), 1));
-	}
-
-	// Apply each sub-pass subsequently.
-	for (unsigned int sp(0); sp < totalSubPasses; ++sp)
-	{
-		// Get the neighborhood descriptors for the current sub-pass. The descriptors are rebuild for each sub-pass, so that the sample converges against the expected result.
-		cv::Mat descriptors = descriptorExtractor->calculateNeighborhoodDescriptors(*exemplar, sample).t();
-
-		// Append guidance channels.
-		if (guidanceDescriptors.has_value())
-			for (int cn(0); cn < guidanceDescriptors.value().channels(); ++cn)
-				descriptors.push_back(guidanceDescriptors.value().getChannel(cn));
-
-		descriptors = descriptors.t();
-
-		sample.forEach<cv::Vec2f>([&sample, &searchIndex, &descriptors, &sp, &subPasses, &width, &height](cv::Vec2f& coords, const int* idx) -> void {
-			// Check if the pixel should be corrected within the current sub-pass.
-			int col = idx[1] % subPasses;
-			int row = idx[0] % subPasses;
-			int subPass = row * subPasses + col;
-
-			// Only correct the pixel, if it should be done within this sub-pass.
-			if (subPass != sp)
-				return;
-
-			// Match the descriptor with the search space.
-			SearchIndex::MatchType match;
-
-			if (searchIndex->findNearestNeighbor(descriptors, sample, cv::Point2i(idx[1], idx[0]), match))
-				coords = std::move(match.first);
-		});
-
-		// Send the temporary result to handlers.
-		state.config()._feedbackHandler.execute("Corrected", sample);
-	}
-}
-
-void ParallelPyramidSynthesizer::transferTo(const Sample& target, Sample& result, const PyramidSynthesizerState& state) const
+std::shared_ptr<const ISubpassScheduler> ParallelPyramidSynthesizer::getSubpassScheduler(const PyramidSynthesizerState& state) const
 {
-	std::shared_ptr<ISearchIndex> searchIndex = _catalog;
-	std::shared_ptr<IDescriptorExtractor> descriptorExtractor = searchIndex->getDescriptorExtractor();
-
-	const unsigned int subPasses = state.config()._correctionSubPasses;
-	const unsigned int totalSubPasses = subPasses * subPasses;
-
-	// Initialize a matrix that will contain the result.
-	cv::Mat sample(target.size(), CV_32FC2);
-	const int width = target.width(), height = target.height();
-
-	sample.forEach<cv::Vec2f>([&width, &height](cv::Vec2f& uv, const int* idx) -> void {
-		uv[0] = static_cast<float>(idx[1]) / static_cast<float>(width);
-		uv[1] = static_cast<float>(idx[0]) / static_cast<float>(height);
-	});
-
-	//// Transform the target into the search space.
-	Sample targetSpace;
-	searchIndex->getSearchSpace()->transform(target, targetSpace);
-
-	// For each pixel in the sample, lookup the best match.
-	// NOTE: This is similar to an initial correction pass.
-	for (unsigned int sp(0); sp < totalSubPasses; ++sp)
-	{
-		// Get the neighborhood descriptors of the target space.
-		const cv::Mat descriptors = descriptorExtractor->calculateNeighborhoodDescriptors(targetSpace);
-
-		sample.forEach<cv::Vec2f>([&sample, &searchIndex, &descriptors , &sp, &subPasses](cv::Vec2f& coords, const int* idx) -> void {
-			// Check if the pixel should be corrected within the current sub-pass.
-			int col = idx[1] % subPasses;
-			int row = idx[0] % subPasses;
-			int subPass = row * subPasses + col;
-
-			// Only correct the pixel, if it should be done within this sub-pass.
-			if (subPass != sp)
-				return;
-
-			// Get the descriptor at the current location.
-			SearchIndex::MatchType match;
-
-			if (searchIndex->findNearestNeighbor(descriptors, sample, cv::Point2i(idx[1], idx[0]), match))
-				coords = std::move(match.first);
-		});
-
-		// TODO: Run correction passes.
-		//state.config()._feedbackHandler.execute("Status", sample);
-	}
-
-	// Send the temporary result to handlers.
-	//state.config()._feedbackHandler.execute("Transferred", sample);
-	result = Sample(sample);
+	std::shared_ptr<const ISubpassScheduler> scheduler = state.config()._subpassScheduler;
+	return scheduler ? scheduler : std::make_shared<ParallelSubpassScheduler>();
 }
 
 std::unique_ptr<SynthesizerBase> ParallelPyramidSynthesizer::createSynthesizer(std::shared_ptr<ISearchIndex> catalog)
@@ -4,7 +4,12 @@
 
 #include <algorithm>
 
-#include "log2.h"
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include "CounterRandom.h"
+#include "DescriptorKernel.h"
+#include "Serialization.h"
 
 using namespace Texturize;
 
@@ -22,89 +27,132 @@ RandomWalkIndex::RandomWalkIndex(std::shared_ptr<ISearchSpace> searchSpace, cons
 {
 }
 
-RandomWalkIndex::PositionType RandomWalkIndex::getRandomPixelAround(const PositionType& point, int radius, int dominantDimensionExtent) const
+RandomWalkIndex::PositionType RandomWalkIndex::getRandomPixelAround(const PositionType& point, int radius, int dominantDimensionExtent, const std::uint64_t stream, const int counter) const
+{
+	return this->getRandomPixelAround(point, static_cast<CoordinateType>(radius) / static_cast<CoordinateType>(dominantDimensionExtent), stream, counter);
+}
+
+RandomWalkIndex::PositionType RandomWalkIndex::getRandomPixelAround(const PositionType& point, CoordinateType radius, const std::uint64_t stream, const int counter) const
 {
-	return this->getRandomPixelAround(point, static_cast<CoordinateType>(radius) / static_cast<CoordinateType>(dominantDimensionExtent));
+	// Draw both offsets from the stream, so that the result does not depend on the order in which pixels are processed.
+	const CoordinateType u = static_cast<CoordinateType>(CounterRandom::uniform(_seed, stream, static_cast<std::uint64_t>(counter) * 2));
+	const CoordinateType v = static_cast<CoordinateType>(CounterRandom::uniform(_seed, stream, static_cast<std::uint64_t>(counter) * 2 + 1));
+
+	return PositionType(point[0] + (u * 2 - 1) * radius, point[1] + (v * 2 - 1) * radius);
 }
 
-RandomWalkIndex::PositionType RandomWalkIndex::getRandomPixelAround(const PositionType& point, CoordinateType radius) const
+void RandomWalkIndex::walk(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, const int candidate, int& index, DistanceType& distance, const std::uint64_t key) const
 {
-	std::uniform_real_distribution<CoordinateType> distribution(-radius, radius);
-	return PositionType(point[0] + distribution(_rng), point[1] + distribution(_rng));
+	// If the neighborhood of the pixel crosses the edge of the sample, do not search further. This is since candidates are not well defined at edges.
+	int kernel;
+	_searchSpace->kernel(kernel);
+	const int margin = kernel / 2;
+
+	if (at.x < margin || at.x >= uv.cols - margin || at.y < margin || at.y >= uv.rows - margin)
+		return;
+
+	// Get the target descriptor in order to calculate the distance.
+	// NOTE: The descriptors are indexed by their UV-coordinates (i.e. one descriptor for each point in UV-space). Appended guidance channels are not compared.
+	const int pixel = at.y * uv.cols + at.x;
+	const float* targetDescriptor = descriptors.ptr<float>(pixel);
+	const int dimensions = this->getDescriptor(index).cols;
+	const std::uint64_t stream = CounterRandom::next(key, static_cast<std::uint64_t>(pixel), 0);
+
+	// Perform as long, as the environment is non-trivial, i.e. there is an environment which does not only contain the candidate pixel.
+	// The radius get's halved with each iteration. Initially it is half as large as the exemplar width.
+	int step(0);
+
+	for (int radius(_exemplarWidth >> 1); radius >= 2; radius >>= 1, ++step)
+	{
+		// Get a random point around the current candidate.
+		PositionType candidatePos = this->getRandomPixelAround(this->getPosition(index), radius, _exemplarWidth, stream, candidate * 32 + step);
+		Sample::wrapCoords(candidatePos);
+
+		// Compute the distance between the corrected pixel and the current best match.
+		cv::Point2i pixelCoords(static_cast<int>(candidatePos[0] * static_cast<CoordinateType>(_exemplarWidth)), static_cast<int>(candidatePos[1] * static_cast<CoordinateType>(_exemplarHeight)));
+		Sample::wrapCoords(_exemplarWidth, _exemplarHeight, pixelCoords);
+		int descriptorIndex = pixelCoords.y * _exemplarWidth + pixelCoords.x;
+		DistanceType candidateDistance = static_cast<DistanceType>(DescriptorKernel::distance(this->getDescriptor(descriptorIndex).ptr<float>(), targetDescriptor, dimensions, _normType));
+
+		// If the distance is lower than the one of the current candidate, replace the candidate and continue.
+		if (candidateDistance < distance) {
+			distance = candidateDistance;
+			index = descriptorIndex;
+		}
+	}
+}
+
+std::uint64_t RandomWalkIndex::getIdentity() const
+{
+	return Serialization::combine(CoherentIndex::getIdentity(), "RandomWalkIndex");
+}
+
+bool RandomWalkIndex::isPositionDependent() const
+{
+	return true;
 }
 
 bool RandomWalkIndex::findNearestNeighbor(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, MatchType& match, DistanceType minDist) const
 {
-	std::vector<MatchType> matches;
+	int index;
+	DistanceType distance;
 
-	if (!this->findNearestNeighbors(descriptors, uv, at, matches, 1, minDist))
+	// Perform a coherent search for the best candidate and refine it.
+	if (this->selectNearestCandidates(descriptors, uv, at, &index, &distance, 1, minDist) == 0)
 		return false;
 
-	match = matches.front();
+	this->walk(descriptors, uv, at, 0, index, distance);
+	match = std::make_pair(this->getPosition(index), distance);
 	return true;
 }
 
 bool RandomWalkIndex::findNearestNeighbors(const cv::Mat& descriptors, const cv::Mat& uv, const cv::Point2i& at, std::vector<MatchType>& matches, const unsigned int k, DistanceType minDist) const
 {
-	// Get the target descriptor in order to calculate the distance later on.
-	// NOTE: The descriptors are indexed by their UV-coordinates (i.e. one descriptor for each point in UV-space).
-	std::vector<float> targetDescriptor = descriptors.row(at.y * uv.rows + at.x);
-
-	// Perform a coherent search for the best candidate.
-	std::vector<MatchType> candidates;
+	// Perform a coherent search for the best candidates.
+	cv::AutoBuffer<int, 16> indices(k);
+	cv::AutoBuffer<DistanceType, 16> distances(k);
+	const int count = this->selectNearestCandidates(descriptors, uv, at, indices.data(), distances.data(), static_cast<int>(k), minDist);
 
-	if (!CoherentIndex::findNearestNeighbors(descriptors, uv, at, candidates, k, minDist))
+	if (count == 0)
 		return false;
 
-	// If the candidate is somewhere near the edge of the sample, do not search further. This is since candidates are not well defined at edges.
-	unsigned int level = log2(static_cast<unsigned int>(uv.cols));
-	int threshold = static_cast<int>(pow(2, level));
-
-	// Refine search for pixels inside the threshold.
-	std::vector<MatchType> refinedCandidates;
-
-	if ((at.x > threshold && at.x < uv.cols - threshold) && (at.y > threshold && at.y < uv.rows - threshold)) {
-		for each (const auto& candidate in candidates) {
-			// Randomly walk around the environment of the match, trying to find a better one.
-			// The radius around the pixel is calculated from the smaller dimension. Initially it is half as large as the exemplar width.
-			std::shared_ptr<const Sample> exemplar;
-			_searchSpace->sample(exemplar);
-			
-			// Create a candidate instance for the refined candidate.
-			MatchType refinedCandidate = candidate;
-
-			// Perform as long, as the environment is non-trivial, i.e. there is an environment which does not only contain the candidate pixel.
-			// The radius get's halved with each iteration.
-			for (int radius(exemplar->width() >> 1); radius >= 2; radius >>= 1)
-			{
-				// Get a random point around the current candidate.
-				PositionType candidatePos = this->getRandomPixelAround(candidate.first, radius, exemplar->width());
-				Sample::wrapCoords(candidatePos);
-
-				// Compute the distance between the corrected pixel and the current best match.
-				cv::Point2i pixelCoords(static_cast<int>(candidatePos[0] * static_cast<CoordinateType>(exemplar->width())), static_cast<int>(candidatePos[1] * static_cast<CoordinateType>(exemplar->height())));
-				int descriptorIndex = pixelCoords.x * exemplar->width() + pixelCoords.y;
-				DistanceType distance = static_cast<DistanceType>(cv::norm(this->getDescriptor(descriptorIndex), targetDescriptor, _normType));
-
-				// If the distance is lower than the one found within the coherent search, replace the candidate and continue.
-				if (distance < candidate.second)
-					refinedCandidate = std::make_pair<PositionType, DistanceType>(std::move(candidatePos), std::move(distance));
-			}
-		}
+	// Randomly walk around the environment of each match, trying to find a better one.
+	matches.resize(count);
+
+	for (int c(0); c < count; ++c) {
+		this->walk(descriptors, uv, at, c, indices[c], distances[c]);
+		matches[c] = std::make_pair(this->getPosition(indices[c]), distances[c]);
 	}
 
 	// Sort the matches by their distance.
-	std::sort(refinedCandidates.begin(), refinedCandidates.end(), [](MatchType& lhs, MatchType& rhs) {
+	std::sort(matches.begin(), matches.end(), [](const MatchType& lhs, const MatchType& rhs) {
 		return lhs.second < rhs.second;
 	});
 
-	// Return the matches.
-	if (refinedCandidates.size() == 0)
-		return false;
-	else if (k <= refinedCandidates.size())
-		matches = std::vector<MatchType>(refinedCandidates.begin(), refinedCandidates.begin() + k);
-	else
-		matches = refinedCandidates;
-
 	return true;
-}
\ No newline at end of file
+}
+
+int RandomWalkIndex::findNearestNeighborBatch(const cv::Mat& descriptors, const cv::Mat& uv, const std::vector<cv::Point2i>& pixels, cv::Mat& matches, cv::Mat& distances, DistanceType minDist, const std::uint64_t key) const
+{
+	const int count = static_cast<int>(pixels.size());
+	matches.create(count, 1, cv::DataType<PositionType>::type);
+	distances.create(count, 1, cv::DataType<DistanceType>::type);
+
+	// The random walk of each pixel draws from its own stream, so all pixels of the batch can be matched in parallel.
+	tbb::parallel_for(tbb::blocked_range<int>(0, count), [&](const tbb::blocked_range<int>& range) {
+		for (int p = range.begin(); p < range.end(); ++p) {
+			int index;
+			DistanceType& distance = distances.at<DistanceType>(p);
+
+			if (this->selectNearestCandidates(descriptors, uv, pixels[p], &index, &distance, 1, minDist) == 0) {
+				distance = std::numeric_limits<DistanceType>::infinity();
+				continue;
+			}
+
+			this->walk(descriptors, uv, pixels[p], 0, index, distance, key);
+			matches.at<PositionType>(p) = this->getPosition(index);
+		}
+	});
+
+	return static_cast<int>(std::count_if(distances.begin<DistanceType>(), distances.end<DistanceType>(), [](const DistanceType& distance) { return distance != std::numeric_limits<DistanceType>::infinity(); }));
+}
@@ -3,8 +3,10 @@
 #include <sampling.hpp>
 
 #include <algorithm>
+#include <sstream>
 
 #include "log2.h"
+#include "Serialization.h"
 
 using namespace Texturize;
 
@@ -27,4 +29,19 @@ std::shared_ptr<ISearchSpace> SearchIndex::getSearchSpace() const
 std::shared_ptr<IDescriptorExtractor> SearchIndex::getDescriptorExtractor() const
 {
 	return _descriptorExtractor;
+}
+
+std::uint64_t SearchIndex::getIdentity() const
+{
+	std::shared_ptr<const Sample> sample;
+	_searchSpace->sample(sample);
+
+	// The extractor state contains the projection of the descriptors, so indices with different projections do not share an identity.
+	std::ostringstream extractor(std::ios::out | std::ios::binary);
+	_descriptorExtractor->save(extractor);
+	const std::string state = extractor.str();
+
+	std::uint64_t identity = Serialization::combine(Serialization::HashBasis, Serialization::hash(*sample));
+	identity = Serialization::combine(identity, state.data(), state.size());
+	return Serialization::combine(identity, static_cast<int>(_normType));
 }
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <sampling.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+/// \brief Contains helpers, that write binary index data to streams and read it back.
+///
+/// All values are stored in the native byte order, so files are only exchangeable between machines of the same architecture.
+namespace Serialization {
+
+	/// \brief Writes `count` values to a stream.
+	template <typename T>
+	static inline void write(std::ostream& stream, const T* data, const size_t count)
+	{
+		stream.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(sizeof(T) * count));
+	}
+
+	/// \brief Reads `count` values from a stream.
+	template <typename T>
+	static inline void read(std::istream& stream, T* data, const size_t count)
+	{
+		stream.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(sizeof(T) * count));
+	}
+
+	/// \brief Writes a matrix, preceded by its size and type.
+	static inline void write(std::ostream& stream, const cv::Mat& matrix)
+	{
+		const int header[] = { matrix.rows, matrix.cols, matrix.type() };
+		write(stream, header, sizeof(header) / sizeof(int));
+
+		for (int row(0); row < matrix.rows; ++row)
+			write(stream, matrix.ptr<char>(row), matrix.cols * matrix.elemSize());
+	}
+
+	/// \brief Reads a matrix, written by `write`.
+	static inline void read(std::istream& stream, cv::Mat& matrix)
+	{
+		int header[3];
+		read(stream, header, sizeof(header) / sizeof(int));
+
+		if (!stream.good() || header[0] < 0 || header[1] < 0 || header[2] != CV_MAT_TYPE(header[2]))
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The stream does not contain a valid matrix.");
+
+		matrix.create(header[0], header[1], header[2]);
+		read(stream, matrix.data, matrix.total() * matrix.elemSize());
+	}
+
+	/// \brief The initial value of a 64 bit FNV-1a hash.
+	static const std::uint64_t HashBasis = 0xCBF29CE484222325ull;
+
+	/// \brief Continues a 64 bit FNV-1a hash with a block of memory.
+	static inline std::uint64_t combine(std::uint64_t hash, const void* data, const size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+		for (size_t i(0); i < size; ++i)
+			hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+
+		return hash;
+	}
+
+	/// \brief Continues a 64 bit FNV-1a hash with a scalar value.
+	template <typename T>
+	static inline std::uint64_t combine(const std::uint64_t hash, const T value)
+	{
+		return combine(hash, &value, sizeof(T));
+	}
+
+	/// \brief Continues a 64 bit FNV-1a hash with a null-terminated string, e.g. the name of a type.
+	static inline std::uint64_t combine(const std::uint64_t hash, const char* string)
+	{
+		return combine(hash, string, std::strlen(string));
+	}
+
+	/// \brief Calculates a 64 bit FNV-1a hash over the size and the texels of a sample.
+	///
+	/// The hash is used to detect, if stored index data has been built from a different sample. It is not suitable for cryptographic purposes.
+	static inline std::uint64_t hash(const Sample& sample)
+	{
+		const int header[] = { sample.width(), sample.height(), static_cast<int>(sample.channels()) };
+		std::uint64_t hash = combine(HashBasis, header, sizeof(header));
+
+		for (int cn(0); cn < static_cast<int>(sample.channels()); ++cn) {
+			const cv::Mat channel = sample.getChannel(cn);
+
+			for (int row(0); row < channel.rows; ++row)
+				hash = combine(hash, channel.ptr<unsigned char>(row), channel.cols * channel.elemSize());
+		}
+
+		return hash;
+	}
+}
@@ -0,0 +1,96 @@
+#include "stdafx.h"
+
+#include <sampling.hpp>
+#include <tbb/tbb.h>
+
+using namespace Texturize;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Sequential sub-pass scheduler implementation                                            /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void SequentialSubpassScheduler::schedule(const cv::Size& size, unsigned int subPasses, unsigned int subPass, const SpanFunction& fn) const
+{
+	TEXTURIZE_ASSERT(subPasses > 0);									// There must be at least one sub-pass along each axis.
+	TEXTURIZE_ASSERT(subPass < subPasses * subPasses);					// The sub-pass index must be within the range of sub-passes.
+
+	// Compute the origin of the sub-pass lattice. The stride equals the number of sub-passes along each axis.
+	const int stride = static_cast<int>(subPasses);
+	const int rowOffset = static_cast<int>(subPass / subPasses);
+	const int colOffset = static_cast<int>(subPass % subPasses);
+
+	for (int r(rowOffset); r < size.height; r += stride)
+		fn(r, colOffset, size.width, stride);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Parallel sub-pass scheduler implementation                                              /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+ParallelSubpassScheduler::ParallelSubpassScheduler(int rowGrain, int colGrain) :
+	_rowGrain(rowGrain), _colGrain(colGrain)
+{
+	TEXTURIZE_ASSERT(rowGrain > 0);										// The row grain size must be positive.
+	TEXTURIZE_ASSERT(colGrain > 0);										// The column grain size must be positive.
+}
+
+void ParallelSubpassScheduler::schedule(const cv::Size& size, unsigned int subPasses, unsigned int subPass, const SpanFunction& fn) const
+{
+	TEXTURIZE_ASSERT(subPasses > 0);									// There must be at least one sub-pass along each axis.
+	TEXTURIZE_ASSERT(subPass < subPasses * subPasses);					// The sub-pass index must be within the range of sub-passes.
+
+	const int stride = static_cast<int>(subPasses);
+	const int rowOffset = static_cast<int>(subPass / subPasses);
+	const int colOffset = static_cast<int>(subPass % subPasses);
+
+	// Calculate the extent of the lattice, i.e. the number of pixels along each axis, that belong to the sub-pass.
+	const int latticeRows = size.height > rowOffset ? (size.height - rowOffset + stride - 1) / stride : 0;
+	const int latticeCols = size.width > colOffset ? (size.width - colOffset + stride - 1) / stride : 0;
+
+	if (latticeRows == 0 || latticeCols == 0)
+		return;
+
+	// Distribute blocks of the lattice and map them back into sample space.
+	tbb::parallel_for(tbb::blocked_range2d<int>(0, latticeRows, _rowGrain, 0, latticeCols, _colGrain), [&](const tbb::blocked_range2d<int>& range) {
+		const int begin = colOffset + range.cols().begin() * stride;
+		const int end = std::min(colOffset + range.cols().end() * stride, size.width);
+
+		for (int r(range.rows().begin()); r < range.rows().end(); ++r)
+			fn(rowOffset + r * stride, begin, end, stride);
+	});
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Scanline sub-pass scheduler implementation                                              /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+ScanlineSubpassScheduler::ScanlineSubpassScheduler(bool parallel) :
+	_parallel(parallel)
+{
+}
+
+void ScanlineSubpassScheduler::schedule(const cv::Size& size, unsigned int subPasses, unsigned int subPass, const SpanFunction& fn) const
+{
+	TEXTURIZE_ASSERT(subPasses > 0);									// There must be at least one sub-pass along each axis.
+	TEXTURIZE_ASSERT(subPass < subPasses * subPasses);					// The sub-pass index must be within the range of sub-passes.
+
+	// Scan each pixel of a row and report those, that belong to the current sub-pass, as single-pixel span.
+	auto scanRow = [&size, &fn, subPasses, subPass](int r) -> void {
+		for (int c(0); c < size.width; ++c)
+		{
+			unsigned int col = c % subPasses;
+			unsigned int row = r % subPasses;
+
+			if (row * subPasses + col != subPass)
+				continue;
+
+			fn(r, c, c + 1, 1);
+		}
+	};
+
+	if (_parallel)
+		tbb::parallel_for(0, size.height, scanRow);
+	else
+		for (int r(0); r < size.height; ++r)
+			scanRow(r);
+}
@@ -0,0 +1,401 @@
+#include "stdafx.h"
+
+#include <sampling.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <system_error>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Serialization.h"
+
+using namespace Texturize;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Memory mapped synthesis bundle implementation                                           /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+	static const char BundleMagic[8] = { 'T', 'X', 'B', 'N', 'D', 'L', '0', '3' };
+
+	/// \brief The sections of a bundle, in the order they are stored.
+	enum Section {
+		ExemplarTexels,
+		SpaceEigenvectors,
+		SpaceEigenvalues,
+		SpaceMean,
+		ExtractorEigenvectors,
+		ExtractorEigenvalues,
+		ExtractorMean,
+		ExtractorBasis,
+		ExtractorBias,
+		ExemplarDescriptors,
+		Candidates,
+		GuidanceTexels,
+		SectionCount
+	};
+
+	/// \brief Describes the matrix, that is stored within a section.
+	struct SectionHeader {
+		std::uint64_t offset;
+		int rows, cols, type, reserved;
+	};
+
+	/// \brief The header at the beginning of a bundle file. All sections start at a multiple of `SynthesisBundle::SectionAlignment`.
+	struct BundleHeader {
+		char magic[8];
+		int kernelSize, exemplarWidth, exemplarChannels, guidanceChannels, seeding;
+		unsigned int seed;
+		int components, reserved;
+		std::uint64_t samples, key;
+		double explainedVariance, validatedVariance, exactVariance;
+		SectionHeader sections[SectionCount];
+	};
+
+	static_assert(sizeof(BundleHeader) <= SynthesisBundle::SectionAlignment, "The bundle header must fit into the first section.");
+
+	/// \brief Maps a file copy-on-write into the address space of the process.
+	///
+	/// Pages are shared with all other processes, that map the same file, until they are written to.
+	class MappedFile {
+	private:
+		unsigned char* _data{ nullptr };
+		size_t _size{ 0 };
+
+	public:
+		explicit MappedFile(const std::string& fileName)
+		{
+#ifdef _WIN32
+			HANDLE file = ::CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			LARGE_INTEGER size;
+
+			if (file == INVALID_HANDLE_VALUE)
+				TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The bundle file could not be opened.");
+
+			if (!::GetFileSizeEx(file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(BundleHeader))) {
+				::CloseHandle(file);
+				TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The file does not contain a bundle.");
+			}
+
+			// The view keeps the mapping object alive, so both handles can be closed immediately.
+			HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+			_data = mapping == nullptr ? nullptr : static_cast<unsigned char*>(::MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+			_size = static_cast<size_t>(size.QuadPart);
+
+			if (mapping != nullptr)
+				::CloseHandle(mapping);
+
+			::CloseHandle(file);
+#else
+			const int file = ::open(fileName.c_str(), O_RDONLY);
+			struct stat status;
+
+			if (file < 0)
+				TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The bundle file could not be opened.");
+
+			if (::fstat(file, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(BundleHeader))) {
+				::close(file);
+				TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The file does not contain a bundle.");
+			}
+
+			// The mapping remains valid after the descriptor has been closed.
+			void* data = ::mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+			_data = data == MAP_FAILED ? nullptr : static_cast<unsigned char*>(data);
+			_size = static_cast<size_t>(status.st_size);
+			::close(file);
+#endif
+
+			if (_data == nullptr)
+				TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The bundle file could not be mapped.");
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		~MappedFile()
+		{
+#ifdef _WIN32
+			::UnmapViewOfFile(_data);
+#else
+			::munmap(_data, _size);
+#endif
+		}
+
+	public:
+		unsigned char* data() const { return _data; }
+		size_t size() const { return _size; }
+	};
+
+	/// \brief Transfers the ownership of an object, that refers to the mapped memory, to a shared pointer, that keeps the mapping alive.
+	template <typename T>
+	static std::shared_ptr<T> share(std::unique_ptr<T> object, std::shared_ptr<const MappedFile> mapping)
+	{
+		return std::shared_ptr<T>(object.release(), [mapping](T* object) { delete object; });
+	}
+
+	/// \brief Returns the offset of the next section boundary.
+	static inline std::uint64_t align(const std::uint64_t offset)
+	{
+		const std::uint64_t alignment = static_cast<std::uint64_t>(SynthesisBundle::SectionAlignment);
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+}
+
+SynthesisBundle::SynthesisBundle(const std::string& fileName)
+{
+	auto mapping = std::make_shared<const MappedFile>(fileName);
+	const BundleHeader& header = *reinterpret_cast<const BundleHeader*>(mapping->data());
+
+	if (!std::equal(header.magic, header.magic + sizeof(header.magic), BundleMagic))
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The file does not contain a bundle.");
+
+	// Wrap each section into a matrix, that refers to the mapped memory.
+	std::array<cv::Mat, SectionCount> sections;
+
+	for (int s(0); s < SectionCount; ++s) {
+		const SectionHeader& section = header.sections[s];
+
+		if (section.rows < 0 || section.cols < 0 || section.type != CV_MAT_TYPE(section.type) || section.offset % SectionAlignment != 0 ||
+			section.offset + static_cast<std::uint64_t>(section.rows) * section.cols * CV_ELEM_SIZE(section.type) > mapping->size())
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The bundle contains an invalid section.");
+
+		if (section.rows > 0 && section.cols > 0)
+			sections[s] = cv::Mat(section.rows, section.cols, section.type, mapping->data() + section.offset);
+	}
+
+	const int pixels = sections[ExemplarTexels].rows * header.exemplarWidth;
+
+	if (header.exemplarChannels <= 0 || header.exemplarWidth <= 0 || header.exemplarChannels * header.exemplarWidth > sections[ExemplarTexels].cols || 
+		sections[ExemplarTexels].type() != CV_32FC1 || sections[ExtractorBasis].type() != CV_32FC1 || sections[ExtractorBias].type() != CV_32FC1 ||
+		sections[ExemplarDescriptors].type() != CV_32FC1 || sections[ExemplarDescriptors].rows != pixels || sections[ExemplarDescriptors].cols != sections[ExtractorBasis].rows ||
+		sections[Candidates].type() != CV_32SC1 || sections[Candidates].rows != pixels || (header.guidanceChannels > 0 && sections[GuidanceTexels].type() != CV_32FC1))
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The bundle sections do not match.");
+
+	// Restore the appearance space. The exemplar is wrapped, so that neither the sample nor the projection are copied.
+	auto projection = std::make_unique<cv::PCA>();
+	projection->eigenvectors = sections[SpaceEigenvectors];
+	projection->eigenvalues = sections[SpaceEigenvalues];
+	projection->mean = sections[SpaceMean];
+
+	auto exemplar = std::make_unique<Sample>(Sample::wrapTexels(sections[ExemplarTexels], static_cast<size_t>(header.exemplarChannels)));
+
+	if (exemplar->width() != header.exemplarWidth)
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The bundle exemplar does not match its size.");
+
+	_searchSpace = std::make_shared<AppearanceSpace>(share<const cv::PCA>(std::move(projection), mapping), share<const Sample>(std::move(exemplar), mapping), header.kernelSize);
+
+	// Restore the descriptor extractor, so that runtime descriptors are projected onto the same basis as the stored exemplar descriptors.
+	auto projector = std::make_unique<cv::PCA>();
+	projector->eigenvectors = sections[ExtractorEigenvectors];
+	projector->eigenvalues = sections[ExtractorEigenvalues];
+	projector->mean = sections[ExtractorMean];
+
+	auto extractor = std::make_unique<PCADescriptorExtractor>();
+	extractor->_projector = std::move(projector);
+	extractor->_basis = sections[ExtractorBasis];
+	extractor->_bias = sections[ExtractorBias];
+	extractor->_report.samples = static_cast<size_t>(header.samples);
+	extractor->_report.components = header.components;
+	extractor->_report.explainedVariance = header.explainedVariance;
+	extractor->_report.validatedVariance = header.validatedVariance;
+	extractor->_report.exactVariance = header.exactVariance;
+	_descriptorExtractor = share(std::move(extractor), mapping);
+
+	// Restore the search index.
+	std::optional<Sample> guidanceMap;
+
+	if (header.guidanceChannels > 0)
+		guidanceMap = Sample::wrapTexels(sections[GuidanceTexels], static_cast<size_t>(header.guidanceChannels));
+
+	std::unique_ptr<CoherentIndex> index(new CoherentIndex(_searchSpace, _descriptorExtractor, sections[ExemplarDescriptors], sections[Candidates], std::move(guidanceMap),
+		header.seed, static_cast<CoherentIndex::CandidateSeeding>(header.seeding)));
+	_searchIndex = share(std::move(index), mapping);
+}
+
+void SynthesisBundle::write(const std::string& fileName, const AppearanceSpace& searchSpace, const CoherentIndex& searchIndex, const std::uint64_t key)
+{
+	auto extractor = std::dynamic_pointer_cast<const PCADescriptorExtractor>(searchIndex.getDescriptorExtractor());
+
+	TEXTURIZE_ASSERT(extractor != nullptr);									// The index must use a PCA descriptor extractor.
+	TEXTURIZE_ASSERT(extractor->_projector != nullptr);						// The extractor must have been fit to the exemplar.
+
+	std::shared_ptr<const cv::PCA> projection;
+	std::shared_ptr<const Sample> exemplar;
+	int kernel;
+
+	searchSpace.getProjector(projection);
+	searchSpace.getExemplar(exemplar);
+	searchSpace.getKernel(kernel);
+
+	// Store the samples interleaved, so that they can be wrapped without converting them.
+	Sample texels(*exemplar), guidance;
+	texels.setLayout(Sample::Layout::Interleaved);
+
+	if (searchIndex._guidanceMap.has_value()) {
+		guidance = searchIndex._guidanceMap.value();
+		guidance.setLayout(Sample::Layout::Interleaved);
+	}
+
+	std::array<cv::Mat, SectionCount> sections;
+	sections[ExemplarTexels] = texels.getTexels();
+	sections[SpaceEigenvectors] = projection->eigenvectors;
+	sections[SpaceEigenvalues] = projection->eigenvalues;
+	sections[SpaceMean] = projection->mean;
+	sections[ExtractorEigenvectors] = extractor->_projector->eigenvectors;
+	sections[ExtractorEigenvalues] = extractor->_projector->eigenvalues;
+	sections[ExtractorMean] = extractor->_projector->mean;
+	sections[ExtractorBasis] = extractor->_basis;
+	sections[ExtractorBias] = extractor->_bias;
+	sections[ExemplarDescriptors] = searchIndex._exemplarDescriptors;
+	sections[Candidates] = searchIndex._candidates;
+	sections[GuidanceTexels] = searchIndex._guidanceMap.has_value() ? guidance.getTexels() : cv::Mat();
+
+	// Setup the header and lay out the sections.
+	BundleHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::copy(BundleMagic, BundleMagic + sizeof(BundleMagic), header.magic);
+	header.kernelSize = kernel;
+	header.exemplarWidth = exemplar->width();
+	header.exemplarChannels = static_cast<int>(exemplar->channels());
+	header.guidanceChannels = searchIndex._guidanceMap.has_value() ? static_cast<int>(guidance.channels()) : 0;
+	header.seeding = static_cast<int>(searchIndex._seeding);
+	header.seed = searchIndex._seed;
+	header.components = extractor->_report.components;
+	header.samples = static_cast<std::uint64_t>(extractor->_report.samples);
+	header.key = key;
+	header.explainedVariance = extractor->_report.explainedVariance;
+	header.validatedVariance = extractor->_report.validatedVariance;
+	header.exactVariance = extractor->_report.exactVariance;
+
+	std::uint64_t offset = SectionAlignment;
+
+	for (int s(0); s < SectionCount; ++s) {
+		const cv::Mat& matrix = sections[s];
+		header.sections[s] = { offset, matrix.rows, matrix.cols, matrix.type(), 0 };
+		offset = align(offset + static_cast<std::uint64_t>(matrix.rows) * matrix.cols * matrix.elemSize());
+	}
+
+	// Write the bundle into a temporary file, that replaces the bundle afterwards. Other processes may still map the previous bundle, so it must not be truncated. 
+	// The name of the temporary file is unique, since other processes may rebuild the same bundle concurrently.
+	const std::string temporaryFileName = fileName + "." + std::to_string(std::random_device()()) + ".tmp";
+
+	{
+		// Write the header and the sections, each one padded to the next section boundary.
+		std::ofstream stream(temporaryFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+		const std::vector<char> padding(SectionAlignment, 0);
+		std::uint64_t position = sizeof(header);
+
+		if (!stream.is_open())
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The bundle file could not be created.");
+
+		Serialization::write(stream, &header, 1);
+
+		for (int s(0); s < SectionCount; ++s) {
+			const cv::Mat& matrix = sections[s];
+			const std::uint64_t start = header.sections[s].offset;
+
+			Serialization::write(stream, padding.data(), static_cast<size_t>(start - position));
+			position = start;
+
+			for (int row(0); row < matrix.rows; ++row) {
+				Serialization::write(stream, matrix.ptr<char>(row), matrix.cols * matrix.elemSize());
+				position += matrix.cols * matrix.elemSize();
+			}
+		}
+
+		// Pad the last section, so that the whole file can be mapped page-wise.
+		Serialization::write(stream, padding.data(), static_cast<size_t>(align(position) - position));
+		stream.close();
+
+		if (stream.fail()) {
+			std::remove(temporaryFileName.c_str());
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The bundle could not be written to the file.");
+		}
+	}
+
+	// Replace the previous bundle. Processes, that have mapped it, keep their view of the previous file.
+	std::error_code error;
+	std::filesystem::rename(temporaryFileName, fileName, error);
+
+	if (error) {
+		std::remove(temporaryFileName.c_str());
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The bundle file could not be replaced.");
+	}
+}
+
+bool SynthesisBundle::matches(const std::string& fileName, const std::uint64_t key)
+{
+	std::ifstream stream(fileName, std::ios::in | std::ios::binary);
+	BundleHeader header;
+
+	if (!stream.is_open())
+		return false;
+
+	Serialization::read(stream, &header, 1);
+
+	// Bundles, that have been written by other versions, do not contain the key and are treated as outdated.
+	if (!stream.good() || !std::equal(header.magic, header.magic + sizeof(header.magic), BundleMagic))
+		return false;
+
+	return header.key == key;
+}
+
+std::uint64_t SynthesisBundle::identify(const std::vector<std::string>& fileNames, const std::vector<float>& parameters)
+{
+	std::uint64_t hash = Serialization::HashBasis;
+	std::vector<char> buffer(1 << 20);
+
+	// Hash the raw contents of each file, so that the files do not need to be decoded. The file names are not part of the key, so that the inputs can be moved.
+	for (const std::string& fileName : fileNames) {
+		std::ifstream stream(fileName, std::ios::in | std::ios::binary);
+
+		if (!stream.is_open())
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The bundle input could not be opened.");
+
+		std::uint64_t size(0);
+
+		while (stream) {
+			stream.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+			hash = Serialization::combine(hash, buffer.data(), static_cast<size_t>(stream.gcount()));
+			size += static_cast<std::uint64_t>(stream.gcount());
+		}
+
+		if (stream.bad())
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The bundle input could not be read.");
+
+		// Separate the files, so that moving bytes between them changes the key.
+		hash = Serialization::combine(hash, size);
+	}
+
+	for (const float parameter : parameters)
+		hash = Serialization::combine(hash, parameter);
+
+	return hash;
+}
+
+std::shared_ptr<AppearanceSpace> SynthesisBundle::getSearchSpace() const
+{
+	return _searchSpace;
+}
+
+std::shared_ptr<PCADescriptorExtractor> SynthesisBundle::getDescriptorExtractor() const
+{
+	return _descriptorExtractor;
+}
+
+std::shared_ptr<CoherentIndex> SynthesisBundle::getSearchIndex() const
+{
+	return _searchIndex;
+}
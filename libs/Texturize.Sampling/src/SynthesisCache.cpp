@@ -0,0 +1,168 @@
+#include "stdafx.h"
+
+#include <sampling.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <system_error>
+
+#include "Serialization.h"
+
+using namespace Texturize;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Synthesis cache implementation                                                          /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+	static const char CacheMagic[8] = { 'T', 'X', 'C', 'A', 'C', 'H', '0', '1' };
+
+	/// \brief Reads a uv map from a cache file.
+	///
+	/// Files, that are missing, truncated or corrupted (e.g. since a writer has crashed), are treated like missing entries, so the function returns `false` 
+	/// instead of raising an error.
+	static bool readMap(const std::string& fileName, cv::Mat& map)
+	{
+		std::ifstream stream(fileName, std::ios::in | std::ios::binary);
+		char magic[sizeof(CacheMagic)];
+		int header[3];
+
+		if (!stream.is_open())
+			return false;
+
+		Serialization::read(stream, magic, sizeof(magic));
+		Serialization::read(stream, header, sizeof(header) / sizeof(int));
+
+		if (!stream.good() || std::memcmp(magic, CacheMagic, sizeof(CacheMagic)) != 0 || header[0] <= 0 || header[1] <= 0 || header[2] != CV_32FC2)
+			return false;
+
+		map.create(header[0], header[1], header[2]);
+		Serialization::read(stream, map.data, map.total() * map.elemSize());
+
+		return stream.good();
+	}
+}
+
+SynthesisCache::SynthesisCache(size_t capacity, const std::string& directory) :
+	_capacity(capacity), _directory(directory)
+{
+}
+
+std::string SynthesisCache::getFileName(const std::uint64_t key) const
+{
+	std::stringstream fileName;
+	fileName << _directory << '/' << std::hex << std::setw(16) << std::setfill('0') << key << ".uv";
+
+	return fileName.str();
+}
+
+void SynthesisCache::insert(const std::uint64_t key, const cv::Mat& uv)
+{
+	const size_t size = uv.total() * uv.elemSize();
+
+	// Maps that exceed the capacity are not kept in memory.
+	if (size > _capacity || _lookup.find(key) != _lookup.end())
+		return;
+
+	// Evict the least recently used maps, until the new one fits.
+	while (_size + size > _capacity) {
+		const cv::Mat& evicted = _entries.back().second;
+		_size -= evicted.total() * evicted.elemSize();
+		_lookup.erase(_entries.back().first);
+		_entries.pop_back();
+	}
+
+	_entries.emplace_front(key, uv);
+	_lookup[key] = _entries.begin();
+	_size += size;
+}
+
+bool SynthesisCache::find(const std::uint64_t key, cv::Mat& uv)
+{
+	// Look up the map in memory and mark it as most recently used.
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto entry = _lookup.find(key);
+
+		if (entry != _lookup.end()) {
+			_entries.splice(_entries.begin(), _entries, entry->second);
+			uv = entry->second->second.clone();
+			return true;
+		}
+	}
+
+	// Try to read the map from the cache directory. The file is read without holding the lock, so that other threads can access the memory cache meanwhile.
+	cv::Mat map;
+
+	if (_directory.empty() || !readMap(this->getFileName(key), map))
+		return false;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		this->insert(key, map);
+	}
+
+	uv = map.clone();
+	return true;
+}
+
+void SynthesisCache::store(const std::uint64_t key, const cv::Mat& uv)
+{
+	TEXTURIZE_ASSERT(uv.type() == CV_32FC2);						// The uv map must be a two-channel single-precision floating point matrix.
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		this->insert(key, uv.clone());
+	}
+
+	if (_directory.empty())
+		return;
+
+	// Write the map into a temporary file, that replaces the cache file afterwards, so that readers never see a partially written file. The name of the 
+	// temporary file is unique, since other threads or processes may store the same map concurrently.
+	const std::string fileName = this->getFileName(key);
+	const std::string temporaryFileName = fileName + "." + std::to_string(std::random_device()()) + ".tmp";
+
+	{
+		std::ofstream stream(temporaryFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+
+		if (!stream.is_open())
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The cache file could not be created.");
+
+		Serialization::write(stream, CacheMagic, sizeof(CacheMagic));
+		Serialization::write(stream, uv);
+		stream.close();
+
+		if (stream.fail()) {
+			std::remove(temporaryFileName.c_str());
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The cache file could not be written.");
+		}
+	}
+
+	// If the file can not be replaced, another writer currently stores or reads the same map, so the temporary file is not required anymore.
+	std::error_code error;
+	std::filesystem::rename(temporaryFileName, fileName, error);
+
+	if (error)
+		std::remove(temporaryFileName.c_str());
+}
+
+void SynthesisCache::clear()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_entries.clear();
+	_lookup.clear();
+	_size = 0;
+}
+
+size_t SynthesisCache::size() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _size;
+}
@@ -0,0 +1,89 @@
+#include "stdafx.h"
+
+#include <sampling.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+#include "Serialization.h"
+
+using namespace Texturize;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Synthesis checkpoint implementation                                                     /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+	static const char CheckpointMagic[8] = { 'T', 'X', 'C', 'H', 'K', 'P', '0', '1' };
+}
+
+void SynthesisCheckpoint::save(const std::string& fileName) const
+{
+	const int header[] = { size.width, size.height, level, pass, finished ? 1 : 0 };
+	const std::string temporaryFileName = fileName + ".tmp";
+
+	{
+		std::ofstream stream(temporaryFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+
+		if (!stream.is_open())
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The checkpoint file could not be created.");
+
+		Serialization::write(stream, CheckpointMagic, sizeof(CheckpointMagic));
+		Serialization::write(stream, header, sizeof(header) / sizeof(int));
+		Serialization::write(stream, &distance, 1);
+		Serialization::write(stream, &rngState, 1);
+		Serialization::write(stream, &settings, 1);
+		Serialization::write(stream, uv);
+		stream.close();
+
+		// Closing flushes the remaining data, which may fail as well, e.g. if the disk is full.
+		if (stream.fail()) {
+			std::remove(temporaryFileName.c_str());
+			TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The checkpoint could not be written to the file.");
+		}
+	}
+
+	// Replace the previous checkpoint, after the new one has been written completely.
+	std::error_code error;
+	std::filesystem::rename(temporaryFileName, fileName, error);
+
+	if (error) {
+		std::remove(temporaryFileName.c_str());
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The checkpoint file could not be replaced.");
+	}
+}
+
+SynthesisCheckpoint SynthesisCheckpoint::load(const std::string& fileName)
+{
+	std::ifstream stream(fileName, std::ios::in | std::ios::binary);
+	char magic[sizeof(CheckpointMagic)];
+	int header[5];
+	SynthesisCheckpoint checkpoint;
+
+	if (!stream.is_open())
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The checkpoint file could not be opened.");
+
+	Serialization::read(stream, magic, sizeof(magic));
+
+	if (!stream.good() || std::memcmp(magic, CheckpointMagic, sizeof(CheckpointMagic)) != 0)
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The file does not contain a synthesis checkpoint.");
+
+	Serialization::read(stream, header, sizeof(header) / sizeof(int));
+	Serialization::read(stream, &checkpoint.distance, 1);
+	Serialization::read(stream, &checkpoint.rngState, 1);
+	Serialization::read(stream, &checkpoint.settings, 1);
+	Serialization::read(stream, checkpoint.uv);
+
+	if (!stream.good() || header[0] <= 0 || header[1] <= 0 || header[2] < -1 || header[3] < -1 || checkpoint.uv.type() != CV_32FC2)
+		TEXTURIZE_ERROR(TEXTURIZE_ERROR_IO, "The synthesis checkpoint is corrupted.");
+
+	checkpoint.size = cv::Size(header[0], header[1]);
+	checkpoint.level = header[2];
+	checkpoint.pass = header[3];
+	checkpoint.finished = header[4] != 0;
+
+	return checkpoint;
+}
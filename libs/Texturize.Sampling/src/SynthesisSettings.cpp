@@ -94,4 +94,27 @@ PyramidSynthesisSettings PyramidSynthesisSettings::random(float scale, Randomnes
 	cv::RNG rng = cv::RNG(state);
 
 	return PyramidSynthesisSettings(scale, cv::Point2f(rng.uniform(0.f, 1.f), rng.uniform(0.f, 1.f)), fn, kernel, state);
-}
\ No newline at end of file
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Correction statistics implementation                                                    /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+double CorrectionStatistics::changeRate() const
+{
+	return pixels == 0 ? 0. : static_cast<double>(changed) / static_cast<double>(pixels);
+}
+
+double CorrectionStatistics::meanDistance() const
+{
+	return pixels == 0 ? 0. : distance / static_cast<double>(pixels);
+}
+
+CorrectionStatistics& CorrectionStatistics::operator+=(const CorrectionStatistics& other)
+{
+	pixels += other.pixels;
+	changed += other.changed;
+	distance += other.distance;
+
+	return *this;
+}
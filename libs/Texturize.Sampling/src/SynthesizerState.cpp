@@ -14,7 +14,7 @@ SynthesizerState::SynthesizerState(const SynthesisSettings& config) :
 	TEXTURIZE_ASSERT(config.validate());						// The configuration must be valid.
 }
 
-SynthesisSettings SynthesizerState::config() const
+const SynthesisSettings& SynthesizerState::config() const
 {
 	return _config;
 }
@@ -33,7 +33,7 @@ PyramidSynthesizerState::PyramidSynthesizerState(const PyramidSynthesisSettings&
 {
 }
 
-PyramidSynthesisSettings PyramidSynthesizerState::config() const
+const PyramidSynthesisSettings& PyramidSynthesizerState::config() const
 {
 	return _configEx;
 }
@@ -61,11 +61,41 @@ float PyramidSynthesizerState::getSpacing() const
 
 void PyramidSynthesizerState::update(const int level, const cv::Mat& sample)
 {
+	this->update(level, sample, cv::Rect(cv::Point2i(0, 0), sample.size() * 2), sample.size() * 2);
+}
+
+void PyramidSynthesizerState::update(const int level, const cv::Mat& sample, const cv::Rect& window, const cv::Size& extent)
+{
+	TEXTURIZE_ASSERT(window.x >= 0 && window.x < extent.width);		// The window origin must be within the pyramid level.
+	TEXTURIZE_ASSERT(window.y >= 0 && window.y < extent.height);	// The window origin must be within the pyramid level.
+
 	_level = level;
 	_sample = sample;
+	_window = window;
+	_extent = extent;
 	_randomness = _configEx._randomnessSelector(level, sample);
 }
 
+cv::Rect PyramidSynthesizerState::getWindow() const
+{
+	return _window;
+}
+
+cv::Size PyramidSynthesizerState::getExtent() const
+{
+	return _extent;
+}
+
+cv::Point2i PyramidSynthesizerState::getPosition(const cv::Point2i& at) const
+{
+	// The window origin is within the level, so the position can only exceed the extent by less than one level size.
+	cv::Point2i position = at + _window.tl();
+	position.x -= position.x >= _extent.width ? _extent.width : 0;
+	position.y -= position.y >= _extent.height ? _extent.height : 0;
+
+	return position;
+}
+
 cv::Mat PyramidSynthesizerState::sample() const
 {
 	return _sample;
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <analysis.hpp>
+#include <sampling.hpp>
+
+using namespace Texturize;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Measurements                                                                            /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+
+	/// \brief Describes a correction setup, that gets compared against the other ones.
+	struct Configuration {
+		std::string name;
+		std::shared_ptr<const ISubpassScheduler> scheduler;
+		PyramidSynthesisSettings::CorrectionMode mode;
+		bool deterministic;
+	};
+
+	/// \brief The time and statistics of a single correction pass.
+	struct Pass {
+		int level;
+		int pass;
+		double milliseconds;
+		CorrectionStatistics statistics;
+	};
+
+	/// \brief Synthesizes a result and records each correction pass.
+	///
+	/// The time of a pass is measured between two calls of the progress handler. The first pass of a level therefore also contains upsampling and jitter.
+	static std::vector<Pass> measure(const SynthesizerBase& synthesizer, const Configuration& configuration, const int size, const int kernel, const unsigned int passes)
+	{
+		PyramidSynthesisSettings config(1.f, cv::Point2f(0.f, 0.f), 0.5f, kernel, 42);
+		config._correctionPasses = passes;
+		config._correctionMode = configuration.mode;
+		config._subpassScheduler = configuration.scheduler;
+		config._deterministic = configuration.deterministic;
+
+		std::vector<Pass> result;
+		Clock::time_point last = Clock::now();
+
+		config._progressHandler.add([&result, &last](int level, int pass, const cv::Mat&, const CorrectionStatistics& statistics) -> void {
+			const Clock::time_point now = Clock::now();
+
+			if (pass >= 0)
+				result.push_back({ level, pass, std::chrono::duration<double, std::milli>(now - last).count(), statistics });
+
+			last = now;
+		});
+
+		Sample sample;
+		synthesizer.synthesize(size, size, sample, config);
+
+		return result;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Benchmark                                                                               /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// \brief Compares the per-pass time, convergence and match quality of the correction schemes.
+///
+/// Usage: `Texturize.Benchmarks.Correction [exemplar size] [result size] [passes] [runs]`
+///
+/// The scanline scheduler resembles the full-image scans, that have been used before sub-pass scheduling, whilst the lattice scheduler only visits the pixels of the
+/// current sub-pass. Both use Gauss-Seidel sub-passes, which are compared against deterministic sub-passes and Jacobi passes. The exemplar is generated from a 
+/// fixed seed, so that each run synthesizes the same result. For each pass, the fastest time of all runs is reported, together with the change rate and mean match
+/// distance of the last run, which show how fast each mode converges and how well the result matches the exemplar.
+int main(int argc, const char** argv) {
+	const int exemplarSize = argc > 1 ? std::atoi(argv[1]) : 128;
+	const int resultSize = argc > 2 ? std::atoi(argv[2]) : 1024;
+	const unsigned int passes = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 4u;
+	const int runs = argc > 4 ? std::atoi(argv[4]) : 3;
+
+	if (exemplarSize <= 0 || resultSize <= 0 || passes == 0 || runs <= 0) {
+		std::cout << "Usage: Texturize.Benchmarks.Correction [exemplar size] [result size] [passes] [runs]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Setup a blurred noise exemplar, which contains features of a few pixels, with an appearance space and index.
+	const int kernel = 5;
+	cv::Mat texels(exemplarSize, exemplarSize, CV_32FC3);
+	cv::theRNG().state = 42;
+	cv::randu(texels, cv::Scalar::all(0.), cv::Scalar::all(1.));
+	cv::GaussianBlur(texels, texels, cv::Size(0, 0), 2., 2., cv::BORDER_WRAP);
+
+	Sample exemplar(texels);
+	std::unique_ptr<AppearanceSpace> searchSpace;
+	AppearanceSpace::calculate(exemplar, searchSpace, static_cast<size_t>(3), kernel);
+
+	auto index = std::make_shared<CoherentIndex>(std::move(searchSpace), 3);
+	auto synthesizer = ParallelPyramidSynthesizer::createSynthesizer(index);
+
+	const std::vector<Configuration> configurations = {
+		{ "scanline", std::make_shared<ScanlineSubpassScheduler>(true), PyramidSynthesisSettings::CorrectionMode::SubPasses, false },
+		{ "lattice", std::make_shared<ParallelSubpassScheduler>(), PyramidSynthesisSettings::CorrectionMode::SubPasses, false },
+		{ "lattice-deterministic", std::make_shared<ParallelSubpassScheduler>(), PyramidSynthesisSettings::CorrectionMode::SubPasses, true },
+		{ "jacobi", std::make_shared<ParallelSubpassScheduler>(), PyramidSynthesisSettings::CorrectionMode::Jacobi, false }
+	};
+
+	// Run a synthesis before measuring, so that caches and thread-local buffers are setup.
+	measure(*synthesizer, configurations[1], resultSize, kernel, passes);
+
+	std::cout << "configuration,level,pass,milliseconds,changed,distance" << std::endl;
+	std::cout << std::fixed << std::setprecision(4);
+
+	for (const Configuration& configuration : configurations) {
+		std::vector<Pass> fastest;
+
+		for (int r(0); r < runs; ++r) {
+			const std::vector<Pass> recorded = measure(*synthesizer, configuration, resultSize, kernel, passes);
+
+			if (fastest.empty()) {
+				fastest = recorded;
+				continue;
+			}
+
+			for (size_t p(0); p < recorded.size() && p < fastest.size(); ++p) {
+				fastest[p].milliseconds = std::min(fastest[p].milliseconds, recorded[p].milliseconds);
+				fastest[p].statistics = recorded[p].statistics;
+			}
+		}
+
+		for (const Pass& pass : fastest)
+			std::cout << configuration.name << "," << pass.level << "," << pass.pass << "," << pass.milliseconds << "," << pass.statistics.changeRate() << "," << pass.statistics.meanDistance() << std::endl;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,173 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include <analysis.hpp>
+#include <sampling.hpp>
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#include <crtdbg.h>
+#endif
+
+using namespace Texturize;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Allocation counting                                                                     /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Returned, if the allocations of the framework libraries can not be observed. CTest reports the test as skipped.
+#define TEST_SKIPPED 77
+
+namespace {
+	static std::atomic<bool> counting{ false };
+	static std::atomic<size_t> allocations{ 0 };
+
+	/// \brief Counts the allocations, that are done while calling a function.
+	template <typename TFunction>
+	static size_t countAllocations(TFunction function)
+	{
+		allocations = 0;
+		counting = true;
+		function();
+		counting = false;
+
+		return allocations;
+	}
+}
+
+#if defined(_MSC_VER)
+// With MSVC, each module resolves `operator new` on its own, so replacing it would only count the allocations of the test itself. Instead, the debug heap,
+// which is shared with the framework libraries, is hooked. Release builds do not provide a hook.
+#if defined(_DEBUG)
+static int countAllocation(int type, void*, size_t, int, long, const unsigned char*, int)
+{
+	if ((type == _HOOK_ALLOC || type == _HOOK_REALLOC) && counting.load(std::memory_order_relaxed))
+		allocations.fetch_add(1, std::memory_order_relaxed);
+
+	return TRUE;
+}
+
+static bool observeAllocations()
+{
+	::_CrtSetAllocHook(countAllocation);
+	return true;
+}
+#else
+static bool observeAllocations()
+{
+	return false;
+}
+#endif
+#else
+// The replacement is used by all shared libraries, loaded by the process.
+void* operator new(std::size_t size)
+{
+	if (counting.load(std::memory_order_relaxed))
+		allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void* memory = std::malloc(size == 0 ? 1 : size))
+		return memory;
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+static bool observeAllocations()
+{
+	return true;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+///// Tests                                                                                   /////
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// \brief Checks, that reading texels and neighborhoods into caller-provided buffers does not allocate.
+static bool testTexelAccess(const Sample& exemplar, const int kernel)
+{
+	const int channels = static_cast<int>(exemplar.channels());
+	std::vector<float> texel(channels), neighborhood(kernel * kernel * channels);
+
+	// Calculate the weights before counting, since they are cached on the first call.
+	Sample::getNeighborhoodWeights(kernel);
+
+	const size_t count = countAllocations([&]() {
+		for (int y(0); y < exemplar.height(); ++y) {
+			for (int x(0); x < exemplar.width(); ++x) {
+				exemplar.at(x, y, texel.data());
+				exemplar.getNeighborhood(x, y, kernel, neighborhood.data(), false);
+				exemplar.getNeighborhood(x, y, kernel, neighborhood.data(), true);
+			}
+		}
+	});
+
+	if (count != 0) {
+		std::cout << "Error: Reading " << exemplar.width() * exemplar.height() << " texels and neighborhoods did " << count << " allocations." << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/// \brief Checks, that the allocations of a synthesis do not grow with the number of pixels.
+///
+/// Sizes, buffers and matrices are allocated per level, sub-pass and row, so their number grows linearly with the edge length of the result. Synthesizing a
+/// result with four times the edge length should therefore do about four times the allocations. Any allocation per pixel would make it sixteen times.
+static bool testSynthesis(const SynthesizerBase& synthesizer, const int kernel)
+{
+	const int smallSize = 32, largeSize = 128;
+	PyramidSynthesisSettings config(1.f, cv::Point2f(0.f, 0.f), 0.5f, kernel, 42);
+	Sample result;
+
+	// Run a synthesis before counting, so that caches and thread-local buffers are setup.
+	synthesizer.synthesize(largeSize, largeSize, result, config);
+
+	const size_t small = countAllocations([&]() { synthesizer.synthesize(smallSize, smallSize, result, config); });
+	const size_t large = countAllocations([&]() { synthesizer.synthesize(largeSize, largeSize, result, config); });
+
+	std::cout << "Synthesis allocations: " << small << " (" << smallSize << "x" << smallSize << "), " << large << " (" << largeSize << "x" << largeSize << ")" << std::endl;
+
+	if (large >= small * 8) {
+		std::cout << "Error: The number of allocations grows with the number of pixels." << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, const char** argv) {
+	if (!observeAllocations()) {
+		std::cout << "Allocations can not be observed in this configuration." << std::endl;
+		return TEST_SKIPPED;
+	}
+
+	// Setup a random exemplar with an appearance space and index.
+	const int kernel = 5;
+	cv::Mat texels(64, 64, CV_32FC3);
+	cv::randu(texels, cv::Scalar::all(0.), cv::Scalar::all(1.));
+
+	Sample exemplar(texels), interleaved(texels);
+	interleaved.setLayout(Sample::Layout::Interleaved);
+
+	std::unique_ptr<AppearanceSpace> searchSpace;
+	AppearanceSpace::calculate(exemplar, searchSpace, static_cast<size_t>(3), kernel);
+
+	auto index = std::make_shared<CoherentIndex>(std::move(searchSpace), 3);
+	auto synthesizer = ParallelPyramidSynthesizer::createSynthesizer(index);
+
+	bool succeeded = testTexelAccess(exemplar, kernel) && testTexelAccess(interleaved, kernel);
+	succeeded = testSynthesis(*synthesizer, kernel) && succeeded;
+
+	return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}